@@ -0,0 +1,578 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QFile>
+#include <QStringList>
+#include <algorithm> // for sort
+#include <iostream>
+#include <math.h> // for sqrt, fabs
+#include <sstream>
+#include <stdlib.h> // for getenv
+#include <string>
+#include <vector>
+#include "fileio.h"
+#include "library.h"
+#include "libraryjournal.h"
+#include "log.h"
+#include "message.h"
+#include "midi.h"
+#include "midiout.h"
+#include "patch.h"
+#include "patchgenerator.h"
+#include "sequence.h"
+#include "version.h"
+
+
+// Results are accumulated here, so the compiler can't drop the work.
+static volatile unsigned long sink = 0;
+
+// Fixed seed, so every run works on the same patches:
+static PatchGenerator generator(1);
+
+
+class BenchmarkCase {
+    public:
+        virtual ~BenchmarkCase() {}
+        virtual void run(const qint64 &iterations) = 0;
+        // Reported with the results, e.g. the number of loaded programs:
+        virtual int check() {
+            return -1;
+        }
+};
+
+
+struct BenchmarkResult {
+    std::string name;
+    int programs;
+    int check;
+    qint64 iterations; // per sample
+    std::vector<double> samples; // nanoseconds per operation
+};
+
+
+// Doubles the iterations of a case until a sample takes at least minSampleTime
+// (which also warms it up) and then collects a fixed number of samples. The
+// statistics are computed on the time per operation of the samples.
+class BenchmarkRunner {
+    public:
+        BenchmarkRunner(const qint64 &minSampleTime, const int &samples, const QString &filter):
+            minSampleTime(minSampleTime),
+            samples(samples),
+            filter(filter) {
+        }
+
+        void run(const std::string &name, BenchmarkCase &benchmark, const int &programs = -1, const int &maxSamples = -1) {
+            if (!filter.isEmpty() && !QString::fromStdString(name).contains(filter)) {
+                return;
+            }
+            std::cerr << "running " << name;
+            if (programs >= 0) {
+                std::cerr << " (" << programs << " programs)";
+            }
+            std::cerr << std::endl;
+
+            // Calibrate, this also warms up caches and the allocator:
+            qint64 iterations = 1;
+            while (measure(benchmark, iterations) < minSampleTime && iterations < (1LL << 30)) {
+                iterations *= 2;
+            }
+
+            BenchmarkResult result;
+            result.name = name;
+            result.programs = programs;
+            result.iterations = iterations;
+            const int &count = maxSamples > 0 ? std::min(samples, maxSamples) : samples;
+            for (int i = 0; i < count; i++) {
+                result.samples.push_back((double) measure(benchmark, iterations) / iterations);
+            }
+            result.check = benchmark.check();
+            results.push_back(result);
+        }
+
+        std::string toJson() {
+            std::ostringstream os;
+            os << "{\n  \"version\": \"" << VERSION << "\",\n"
+               << "  \"qt_version\": \"" << qVersion() << "\",\n"
+               << "  \"benchmarks\": [";
+            for (unsigned int i = 0; i < results.size(); i++) {
+                BenchmarkResult &result = results[i];
+                std::vector<double> &s = result.samples;
+                std::sort(s.begin(), s.end());
+
+                double sum = 0;
+                for (unsigned int j = 0; j < s.size(); j++) {
+                    sum += s[j];
+                }
+                const double &mean = sum / s.size();
+                double squares = 0;
+                for (unsigned int j = 0; j < s.size(); j++) {
+                    squares += (s[j] - mean) * (s[j] - mean);
+                }
+                const double &stddev = s.size() > 1 ? sqrt(squares / (s.size() - 1)) : 0;
+                const double &med = median(s);
+                std::vector<double> deviations;
+                for (unsigned int j = 0; j < s.size(); j++) {
+                    deviations.push_back(fabs(s[j] - med));
+                }
+                std::sort(deviations.begin(), deviations.end());
+
+                os << (i ? ",\n" : "\n") << "    {\"name\": \"" << result.name << "\"";
+                if (result.programs >= 0) {
+                    os << ", \"programs\": " << result.programs;
+                }
+                if (result.check >= 0) {
+                    os << ", \"check\": " << result.check;
+                }
+                os << ", \"samples\": " << s.size()
+                   << ", \"iterations\": " << result.iterations
+                   << ", \"ns_per_op\": {\"median\": " << med
+                   << ", \"mean\": " << mean
+                   << ", \"stddev\": " << stddev
+                   << ", \"ci95\": " << (s.size() > 1 ? 1.96 * stddev / sqrt((double) s.size()) : 0)
+                   << ", \"mad\": " << median(deviations)
+                   << ", \"min\": " << s.front()
+                   << ", \"max\": " << s.back() << "}}";
+            }
+            os << "\n  ]\n}\n";
+            return os.str();
+        }
+
+    private:
+        static qint64 measure(BenchmarkCase &benchmark, const qint64 &iterations) {
+            QElapsedTimer timer;
+            timer.start();
+            benchmark.run(iterations);
+            return timer.nsecsElapsed();
+        }
+
+        static double median(const std::vector<double> &sorted) {
+            const unsigned int &n = sorted.size();
+            if (n == 0) {
+                return 0;
+            }
+            return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+        }
+
+        qint64 minSampleTime; // nanoseconds
+        int samples;
+        QString filter;
+        std::vector<BenchmarkResult> results;
+};
+
+
+//
+// Codec
+//
+
+
+class ParseSysex : public BenchmarkCase {
+    public:
+        ParseSysex() {
+            Patch patch;
+            generator.generate(patch);
+            patch.generateSysex(&sysex);
+        }
+        void run(const qint64 &iterations) {
+            Message payload;
+            payload.reserve(92);
+            for (qint64 i = 0; i < iterations; i++) {
+                payload.clear();
+                sink += Midi::parseSysex(&sysex, &payload);
+            }
+        }
+
+    private:
+        Message sysex;
+};
+
+
+class GenerateSysex : public BenchmarkCase {
+    public:
+        GenerateSysex() {
+            Patch patch;
+            generator.generate(patch);
+            unsigned char data[92];
+            patch.packData(data);
+            payload.assign(data, data + 92);
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                Message sysex;
+                Midi::generateSysex(&payload, 0x01, 0x00, &sysex);
+                sink += sysex.size();
+            }
+        }
+
+    private:
+        Message payload;
+};
+
+
+class PatchUnpack : public BenchmarkCase {
+    public:
+        PatchUnpack() {
+            Patch source;
+            generator.generate(source);
+            source.packData(data);
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                sink += patch.unpackData(data);
+            }
+        }
+
+    private:
+        unsigned char data[92];
+        Patch patch;
+};
+
+
+class PatchPack : public BenchmarkCase {
+    public:
+        PatchPack() {
+            generator.generate(patch);
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                patch.packData(data);
+                sink += data[i % 92];
+            }
+        }
+
+    private:
+        unsigned char data[92];
+        Patch patch;
+};
+
+
+class PatchEquals : public BenchmarkCase {
+    public:
+        PatchEquals() {
+            generator.generate(a);
+            b.set(a); // equal patches compare all parameters
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                sink += a.equals(b);
+            }
+        }
+
+    private:
+        Patch a;
+        Patch b;
+};
+
+
+class SequenceUnpack : public BenchmarkCase {
+    public:
+        SequenceUnpack() {
+            for (int i = 0; i < 32; i++) {
+                data[i] = (i * 37) & 0xff;
+            }
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                sequence.unpackData(data);
+                sink += data[i % 32];
+            }
+        }
+
+    private:
+        unsigned char data[32];
+        Sequence sequence;
+};
+
+
+class SequencePack : public BenchmarkCase {
+    public:
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                sequence.packData(data);
+                sink += data[i % 32];
+            }
+        }
+
+    private:
+        unsigned char data[32];
+        Sequence sequence;
+};
+
+
+class ConvertCC : public BenchmarkCase {
+    public:
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                const unsigned char &cc = i & 0x7f;
+                int id = Patch::ccToId(cc, 0);
+                sink += Patch::convertCCValue(i & 0x7f, id, 0);
+            }
+        }
+};
+
+
+class CalculateHash : public BenchmarkCase {
+    public:
+        CalculateHash() {
+            Patch patch;
+            generator.generate(patch);
+            patch.packData(data);
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                sink += Library::calculateHash(data, 92).size();
+            }
+        }
+
+    private:
+        unsigned char data[92];
+};
+
+
+//
+// Library
+//
+
+
+class LibrarySave : public BenchmarkCase {
+    public:
+        LibrarySave(MidiOut *midiout, const int &programs, const QString &path):
+            library(midiout),
+            path(path) {
+            fill(library, programs);
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                sink += library.saveLibrary(path);
+            }
+        }
+
+        static void fill(Library &library, const int &programs) {
+            library.setNumberOfHWPrograms(programs);
+            Patch patch;
+            for (int i = 0; i < programs; i++) {
+                generator.generate(patch);
+                library.storePatch(i, patch);
+            }
+        }
+
+    private:
+        Library library;
+        QString path;
+};
+
+
+class LibraryLoad : public BenchmarkCase {
+    public:
+        LibraryLoad(MidiOut *midiout, const QString &path):
+            midiout(midiout),
+            path(path),
+            loaded(-1) {
+        }
+        void run(const qint64 &iterations) {
+            // Like FileWorker::loadLibrary(); Library::loadLibrary() reads
+            // at most FileIO::MAX_READ_SIZE, less than the big libraries.
+            for (qint64 i = 0; i < iterations; i++) {
+                Library library(midiout);
+                Message data;
+                sink += FileIO::loadFromDisk(path, data, FileIO::MAX_LIBRARY_SIZE) && library.parseLibrary(data, false);
+                loaded = library.getNumberOfPrograms();
+            }
+        }
+        int check() {
+            return loaded;
+        }
+
+    private:
+        MidiOut *midiout;
+        QString path;
+        int loaded;
+};
+
+
+class LibraryOpenIndexed : public BenchmarkCase {
+    public:
+        LibraryOpenIndexed(MidiOut *midiout, const QString &path):
+            midiout(midiout),
+            path(path),
+            loaded(-1) {
+        }
+        void run(const qint64 &iterations) {
+            for (qint64 i = 0; i < iterations; i++) {
+                Library library(midiout);
+                sink += library.openIndexed(path);
+                loaded = library.getNumberOfPrograms();
+            }
+        }
+        int check() {
+            return loaded;
+        }
+
+    private:
+        MidiOut *midiout;
+        QString path;
+        int loaded;
+};
+
+
+class JournalStorePatch : public BenchmarkCase {
+    public:
+        JournalStorePatch(MidiOut *midiout, const QString &directory):
+            library(midiout),
+            journal(directory),
+            next(0) {
+            journal.replay(library);
+            library.setJournal(&journal);
+            generator.generate(a);
+            generator.generate(b);
+        }
+        ~JournalStorePatch() {
+            library.setJournal(NULL);
+        }
+        void run(const qint64 &iterations) {
+            // Alternate, so every store is an edit. Compaction is part of
+            // the cost, like in Editor::process():
+            for (qint64 i = 0; i < iterations; i++) {
+                library.storePatch(next++ % 16, (i % 2) ? a : b);
+                if (journal.needsCompaction()) {
+                    journal.compact(library);
+                }
+            }
+        }
+
+    private:
+        Library library;
+        LibraryJournal journal;
+        Patch a;
+        Patch b;
+        int next;
+};
+
+
+// A timed load that didn't load the whole library measured something else:
+static bool loadedAll(const std::string &name, const int &loaded, const int &expected) {
+    if (loaded >= 0 && loaded != expected) {
+        std::cerr << name << ": loaded " << loaded << " of " << expected << " programs" << std::endl;
+        return false;
+    }
+    return true; // -1: filtered out
+}
+
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    // Keep stdout for the results:
+    if (!getenv("SHRUTHI_LOG")) {
+        Log::configure("warning");
+    }
+    Log::start();
+
+    // Options: --quick (fewer, shorter samples), --filter <text>, --output <path>
+    const QStringList &args = app.arguments();
+    const bool &quick = args.contains("--quick");
+    const int &filterArg = args.indexOf("--filter");
+    const int &outputArg = args.indexOf("--output");
+    const QString &filter = (filterArg >= 0 && filterArg + 1 < args.size()) ? args.at(filterArg + 1) : QString();
+
+    BenchmarkRunner runner(quick ? 2000000LL : 20000000LL, quick ? 10 : 30, filter);
+
+    ParseSysex parseSysex;
+    runner.run("midi.parse_sysex", parseSysex);
+    GenerateSysex generateSysex;
+    runner.run("midi.generate_sysex", generateSysex);
+    PatchUnpack patchUnpack;
+    runner.run("patch.unpack_data", patchUnpack);
+    PatchPack patchPack;
+    runner.run("patch.pack_data", patchPack);
+    PatchEquals patchEquals;
+    runner.run("patch.equals", patchEquals);
+    SequenceUnpack sequenceUnpack;
+    runner.run("sequence.unpack_data", sequenceUnpack);
+    SequencePack sequencePack;
+    runner.run("sequence.pack_data", sequencePack);
+    ConvertCC convertCC;
+    runner.run("patch.cc_to_id_convert", convertCC);
+    CalculateHash calculateHash;
+    runner.run("library.calculate_hash", calculateHash);
+
+    MidiOut midiout; // never opened
+    {
+        const QString &directory = QDir::temp().filePath("shruthi-benchmark-journal");
+        JournalStorePatch journalStorePatch(&midiout, directory);
+        runner.run("journal.store_patch", journalStorePatch);
+        QFile::remove(QDir(directory).filePath("library.journal"));
+        QFile::remove(QDir(directory).filePath("library.slb"));
+    }
+    const int sizes[] = {1000, 10000, 100000};
+    for (int i = 0; i < 3; i++) {
+        const QString &path = QDir::temp().filePath(QString("shruthi-benchmark-%1.syx").arg(sizes[i]));
+        // The big libraries take seconds per operation:
+        const int &maxSamples = sizes[i] >= 100000 ? 5 : (sizes[i] >= 10000 ? 10 : -1);
+        {
+            LibrarySave save(&midiout, sizes[i], path);
+            runner.run("library.save", save, sizes[i], maxSamples);
+            if (!QFile::exists(path)) {
+                save.run(1); // filtered out, but the load benchmark needs the file
+            }
+        }
+        LibraryLoad load(&midiout, path);
+        runner.run("library.load", load, sizes[i], maxSamples);
+        QFile::remove(path);
+        if (!loadedAll("library.load", load.check(), sizes[i])) {
+            Log::stop();
+            return 1;
+        }
+
+        const QString &indexedPath = QDir::temp().filePath(QString("shruthi-benchmark-%1.slb").arg(sizes[i]));
+        {
+            Library library(&midiout);
+            LibrarySave::fill(library, sizes[i]);
+            QByteArray data;
+            library.serializeIndexed(data);
+            FileIO::saveToDisk(indexedPath, data);
+        }
+        LibraryOpenIndexed openIndexed(&midiout, indexedPath);
+        runner.run("library.open_indexed", openIndexed, sizes[i]);
+        QFile::remove(indexedPath);
+        if (!loadedAll("library.open_indexed", openIndexed.check(), sizes[i])) {
+            Log::stop();
+            return 1;
+        }
+    }
+
+    const std::string &json = runner.toJson();
+    if (outputArg >= 0 && outputArg + 1 < args.size()) {
+        QFile file(args.at(outputArg + 1));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json.c_str(), json.size()) != (qint64) json.size()) {
+            std::cerr << "could not write " << args.at(outputArg + 1).toStdString() << std::endl;
+            Log::stop();
+            return 1;
+        }
+    } else {
+        std::cout << json;
+    }
+
+    Log::stop();
+    return 0;
+}
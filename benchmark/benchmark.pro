@@ -0,0 +1,97 @@
+# Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For 
+# informations about the Shruthi, see <http:#www.mutable-instruments.net/shruthi1>. 
+#
+# Copyright (C) 2011-2018 Manuel Krönig
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+# Micro-benchmarks of the codec and library hot paths. Build and run with
+#   qmake benchmark.pro && make && ./shruthi-benchmark > results.json
+
+
+#
+# Source files
+#
+
+TARGET = shruthi-benchmark
+
+INCLUDEPATH += ..
+DEPENDPATH += ..
+
+HEADERS = \
+    ../fileio.h \
+    ../library.h \
+    ../libraryfile.h \
+    ../libraryjournal.h \
+    ../log.h \
+    ../metrics.h \
+    ../midi.h \
+    ../midiin.h \
+    ../midiout.h \
+    ../midischeduler.h \
+    ../patch.h \
+    ../patchgenerator.h \
+    ../queueitem.h \
+    ../rawmidi.h \
+    ../sequence.h \
+    ../session.h \
+    ../trace.h
+
+SOURCES = \
+    benchmark.cpp \
+    ../RtMidi.cpp \
+    ../fileio.cpp \
+    ../labels.cpp \
+    ../library.cpp \
+    ../libraryfile.cpp \
+    ../libraryjournal.cpp \
+    ../log.cpp \
+    ../metrics.cpp \
+    ../midi.cpp \
+    ../midiin.cpp \
+    ../midiout.cpp \
+    ../midischeduler.cpp \
+    ../patch.cpp \
+    ../patchgenerator.cpp \
+    ../rawmidi.cpp \
+    ../sequence.cpp \
+    ../session.cpp \
+    ../trace.cpp
+
+
+#
+# Settings
+#
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+unix:!macx {
+    DEFINES += __LINUX_ALSA__
+    LIBS += -lasound
+}
+
+macx {
+    DEFINES += __MACOSX_CORE__
+    LIBS += -framework CoreMidi -framework CoreAudio -framework CoreFoundation
+}
+
+win32 {
+    DEFINES += __WINDOWS_MM__
+    LIBS += -lwinmm
+}
@@ -0,0 +1,190 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "broadcast.h"
+#include <QStringList>
+#include "log.h"
+#include "metrics.h"
+#include "midiout.h"
+
+
+BroadcastPort::BroadcastPort(const int &port, const unsigned char &channel):
+    midiout(new MidiOut),
+    port(port),
+    channel(channel),
+    running(true) {
+}
+
+
+BroadcastPort::~BroadcastPort() {
+    stop();
+    delete midiout;
+    midiout = NULL;
+}
+
+
+void BroadcastPort::setBackend(const int &backend) {
+    midiout->setBackend(backend);
+    if (!midiout->open(port)) {
+        LOG_WARNING(LogCategory::MIDI) << "BroadcastPort::setBackend(): could not open port" << port;
+    }
+}
+
+
+void BroadcastPort::enqueue(const int &key, const std::vector<Message> &messages) {
+    QMutexLocker locker(&mutex);
+    if (key < 0) {
+        // A patch makes all pending changes obsolete:
+        pending.clear();
+    } else {
+        for (unsigned int i = 0; i < pending.size(); i++) {
+            if (pending.at(i).key == key) {
+                static MetricsCounter *coalesced = Metrics::counter("broadcast.coalesced");
+                coalesced->add(1);
+                pending.at(i).messages = messages;
+                return;
+            }
+        }
+    }
+    Pending p;
+    p.key = key;
+    p.messages = messages;
+    pending.push_back(p);
+    condition.wakeOne();
+}
+
+
+void BroadcastPort::stop() {
+    {
+        QMutexLocker locker(&mutex);
+        running = false;
+        condition.wakeOne();
+    }
+    wait();
+}
+
+
+void BroadcastPort::run() {
+    static MetricsCounter *batches = Metrics::counter("broadcast.batches");
+    std::vector<Message> batch;
+    while (true) {
+        {
+            QMutexLocker locker(&mutex);
+            while (running && pending.empty()) {
+                condition.wait(&mutex);
+            }
+            if (!running) {
+                return;
+            }
+            batch.clear();
+            for (unsigned int i = 0; i < pending.size(); i++) {
+                const std::vector<Message> &messages = pending.at(i).messages;
+                batch.insert(batch.end(), messages.begin(), messages.end());
+            }
+            pending.clear();
+        }
+
+        // Channel messages are encoded for channel 0:
+        for (unsigned int i = 0; i < batch.size(); i++) {
+            Message &message = batch.at(i);
+            if (!message.empty() && message.at(0) < 0xf0) {
+                message[0] |= channel;
+            }
+        }
+        if (!midiout->writeBatch(batch)) {
+            LOG_DEBUG(LogCategory::MIDI) << "BroadcastPort::run(): could not send to port" << port;
+        }
+        batches->add(1);
+    }
+}
+
+
+Broadcast::Broadcast() {
+}
+
+
+Broadcast::~Broadcast() {
+    for (unsigned int i = 0; i < ports.size(); i++) {
+        delete ports.at(i);
+    }
+    ports.clear();
+}
+
+
+bool Broadcast::addOutputs(const QString &spec) {
+    const QStringList &outputs = spec.split(",");
+    for (int i = 0; i < outputs.size(); i++) {
+        const QStringList &fields = outputs.at(i).split(":");
+        bool ok = true;
+        bool okChannel = true;
+        const int &port = fields.at(0).toInt(&ok);
+        const int &channel = fields.size() > 1 ? fields.at(1).toInt(&okChannel) : 1;
+        if (!ok || !okChannel || port < 0 || channel < 1 || channel > 16 || fields.size() > 2) {
+            LOG_WARNING(LogCategory::MIDI) << "Broadcast::addOutputs(): invalid output" << outputs.at(i);
+            return false;
+        }
+        BroadcastPort *output = new BroadcastPort(port, channel - 1);
+        output->start();
+        ports.push_back(output);
+    }
+    LOG_INFO(LogCategory::MIDI) << "Broadcast:" << (unsigned int) ports.size() << "outputs.";
+    return true;
+}
+
+
+bool Broadcast::isEnabled() const {
+    return !ports.empty();
+}
+
+
+void Broadcast::setBackend(const int &backend) {
+    for (unsigned int i = 0; i < ports.size(); i++) {
+        ports.at(i)->setBackend(backend);
+    }
+}
+
+
+void Broadcast::nrpn(const int &nrpn, const int &value) {
+    std::vector<Message> messages;
+    MidiOut::encodeNrpn(messages, 0, nrpn, value);
+    send(nrpn, messages);
+}
+
+
+void Broadcast::controlChange(const unsigned char &controller, const unsigned char &value) {
+    Message message(3);
+    message[0] = 0xb0;
+    message[1] = controller;
+    message[2] = value;
+    // Keys of CCs don't collide with NRPNs:
+    send(0x4000 + controller, std::vector<Message>(1, message));
+}
+
+
+void Broadcast::patch(const Message &sysex) {
+    send(-1, std::vector<Message>(1, sysex));
+}
+
+
+void Broadcast::send(const int &key, const std::vector<Message> &messages) {
+    for (unsigned int i = 0; i < ports.size(); i++) {
+        ports.at(i)->enqueue(key, messages);
+    }
+}
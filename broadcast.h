@@ -0,0 +1,101 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_BROADCAST_H
+#define SHRUTHI_BROADCAST_H
+
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <deque>
+#include <vector>
+#include "message.h"
+class MidiOut;
+
+
+// An output port of the broadcast edit mode, with its own sender thread. The
+// messages queued while the port is busy are written in one batch; pending
+// changes of a parameter are replaced by a newer change.
+class BroadcastPort : public QThread {
+    public:
+        BroadcastPort(const int &port, const unsigned char &channel);
+        ~BroadcastPort();
+
+        void setBackend(const int &backend); // (re)opens the port
+        // key identifies the parameter, -1 for a patch (replaces everything
+        // pending):
+        void enqueue(const int &key, const std::vector<Message> &messages);
+        void stop();
+
+    protected:
+        void run();
+
+    private:
+        BroadcastPort(const BroadcastPort&); //forbid copying
+        BroadcastPort &operator=(const BroadcastPort&); //forbid assignment
+
+        struct Pending {
+            int key;
+            std::vector<Message> messages;
+        };
+
+        MidiOut *midiout;
+        int port;
+        unsigned char channel;
+
+        QMutex mutex;
+        QWaitCondition condition;
+        std::deque<Pending> pending;
+        bool running;
+};
+
+
+// Broadcast edit mode: the parameter changes and patches of the editor are
+// mirrored to several Shruthis, each on its own output port. A change is
+// encoded once and handed to the sender threads of all ports, so all units
+// get it at the same time instead of one after the other.
+class Broadcast {
+    public:
+        Broadcast();
+        ~Broadcast();
+
+        // Configuration, before the editor thread starts. spec is a comma
+        // separated list of "<output port>[:<channel 1-16>]".
+        bool addOutputs(const QString &spec);
+        bool isEnabled() const;
+        void setBackend(const int &backend);
+
+        void nrpn(const int &nrpn, const int &value);
+        void controlChange(const unsigned char &controller, const unsigned char &value);
+        void patch(const Message &sysex);
+
+    private:
+        Broadcast(const Broadcast&); //forbid copying
+        Broadcast &operator=(const Broadcast&); //forbid assignment
+
+        void send(const int &key, const std::vector<Message> &messages);
+
+        std::vector<BroadcastPort*> ports;
+};
+
+
+#endif // SHRUTHI_BROADCAST_H
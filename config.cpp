@@ -22,8 +22,11 @@
 
 
 Config::Config() {
+    mMidiBackend = 0;
     mMidiInputPort = 0;
     mMidiOutputPort = 0;
+    mMidiThruPort = -1;
+    mMidiVirtualPorts = false;
     mMidiChannel = 0;
     mShruthiFilterBoard = 0;
 }
@@ -31,8 +34,11 @@ Config::Config() {
 
 void Config::save() {
     QSettings settings(QSettings::IniFormat, QSettings::UserScope, "shruthi-editor", "Shruthi-Editor");
+    settings.setValue("midi/backend", mMidiBackend);
     settings.setValue("midi/inputPort", mMidiInputPort);
     settings.setValue("midi/outputPort", mMidiOutputPort);
+    settings.setValue("midi/thruPort", mMidiThruPort);
+    settings.setValue("midi/virtualPorts", mMidiVirtualPorts);
     settings.setValue("midi/channel", mMidiChannel);
     settings.setValue("shruthi/filterBoard", mShruthiFilterBoard);
 }
@@ -40,13 +46,26 @@ void Config::save() {
 
 void Config::load() {
     QSettings settings(QSettings::IniFormat, QSettings::UserScope, "shruthi-editor", "Shruthi-Editor");
+    mMidiBackend = settings.value("midi/backend", 0).toInt();
     mMidiInputPort = settings.value("midi/inputPort", 0).toInt();
     mMidiOutputPort = settings.value("midi/outputPort", 0).toInt();
+    mMidiThruPort = settings.value("midi/thruPort", -1).toInt();
+    mMidiVirtualPorts = settings.value("midi/virtualPorts", false).toBool();
     mMidiChannel = settings.value("midi/channel", 0).toInt();
     mShruthiFilterBoard = settings.value("shruthi/filterBoard", 0).toInt();
 }
 
 
+void Config::setMidiBackend(int backend) {
+    mMidiBackend = backend;
+}
+
+
+const int &Config::midiBackend() const {
+    return mMidiBackend;
+}
+
+
 void Config::setMidiInputPort(int in) {
     mMidiInputPort = in;
 }
@@ -67,6 +86,26 @@ const int &Config::midiOutputPort() const {
 }
 
 
+void Config::setMidiThruPort(int thru) {
+    mMidiThruPort = thru;
+}
+
+
+const int &Config::midiThruPort() const {
+    return mMidiThruPort;
+}
+
+
+void Config::setMidiVirtualPorts(bool enabled) {
+    mMidiVirtualPorts = enabled;
+}
+
+
+const bool &Config::midiVirtualPorts() const {
+    return mMidiVirtualPorts;
+}
+
+
 void Config::setMidiChannel(unsigned char channel) {
     mMidiChannel = channel;
 }
@@ -89,15 +128,21 @@ void Config::setShruthiFilterBoard(int value) {
 
 void Config::set(const Config &other) {
     mMidiChannel = other.mMidiChannel;
+    mMidiBackend = other.mMidiBackend;
     mMidiInputPort = other.mMidiInputPort;
     mMidiOutputPort = other.mMidiOutputPort;
+    mMidiThruPort = other.mMidiThruPort;
+    mMidiVirtualPorts = other.mMidiVirtualPorts;
     mShruthiFilterBoard = other.mShruthiFilterBoard;
 }
 
 
 bool Config::equals(const Config &other) {
     return mMidiChannel == other.mMidiChannel &&
+            mMidiBackend == other.mMidiBackend &&
             mMidiInputPort == other.mMidiInputPort &&
             mMidiOutputPort == other.mMidiOutputPort &&
+            mMidiThruPort == other.mMidiThruPort &&
+            mMidiVirtualPorts == other.mMidiVirtualPorts &&
             mShruthiFilterBoard == other.mShruthiFilterBoard;
 }
@@ -26,10 +26,16 @@ class Config {
         Config();
         void load();
         void save();
+        const int &midiBackend() const;
+        void setMidiBackend(int backend);
         const int &midiInputPort() const;
         void setMidiInputPort(int in);
         const int &midiOutputPort() const;
         void setMidiOutputPort(int out);
+        const int &midiThruPort() const;
+        void setMidiThruPort(int thru);
+        const bool &midiVirtualPorts() const;
+        void setMidiVirtualPorts(bool enabled);
         const unsigned char &midiChannel() const;
         void setMidiChannel(unsigned char);
         const int &shruthiFilterBoard() const;
@@ -38,8 +44,11 @@ class Config {
         bool equals(const Config &other);
 
     private:
+        int mMidiBackend;
         int mMidiInputPort;
         int mMidiOutputPort;
+        int mMidiThruPort;
+        bool mMidiVirtualPorts;
         unsigned char mMidiChannel;
         int mShruthiFilterBoard;
 };
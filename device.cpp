@@ -0,0 +1,318 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "device.h"
+#include <QByteArray>
+#include <QTimer>
+#include <algorithm> // for min
+#include "fileio.h"
+#include "flag.h"
+#include "library.h"
+#include "log.h"
+#include "metrics.h"
+#include "midiin.h"
+#include "midiout.h"
+
+
+Device::Device(const int &unit, const int &input, const int &output, const unsigned char &channel, const int &filter):
+    mUnit(unit),
+    input(input),
+    output(output),
+    channel(channel),
+    filter(filter),
+    firmwareVersion(0),
+    backend(-1),
+    midiin(new MidiIn),
+    midiout(new MidiOut),
+    library(new Library(midiout)),
+    job(IDLE),
+    waitingForInfo(false) {
+    midiin->setParent(this);
+    midiin->setShruthiFilterBoard(filter);
+    connect(midiin, SIGNAL(enqueue(QueueItem)), this, SLOT(process(QueueItem)));
+    library->setMidiChannel(channel);
+
+    // Children of the device, so they move to its thread with it:
+    infoTimer = new QTimer(this);
+    infoTimer->setSingleShot(true);
+    infoTimer->setInterval(INFO_TIMEOUT);
+    connect(infoTimer, SIGNAL(timeout()), this, SLOT(infoTimeout()));
+    watchdog = new QTimer(this);
+    watchdog->setInterval(Library::FETCH_TIMEOUT / 10);
+    connect(watchdog, SIGNAL(timeout()), this, SLOT(transferWatchdog()));
+    sendTimer = new QTimer(this);
+    sendTimer->setSingleShot(true);
+    connect(sendTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
+}
+
+
+Device::~Device() {
+    delete library;
+    library = NULL;
+    delete midiout;
+    midiout = NULL;
+}
+
+
+const int &Device::unit() const {
+    return mUnit;
+}
+
+
+void Device::setMidiBackend(int backend) {
+    LOG_DEBUG(LogCategory::MIDI) << "Device::setMidiBackend():" << mUnit << backend;
+    if (this->backend != backend) {
+        this->backend = backend;
+        midiin->setMidiBackend(backend);
+        midiout->setBackend(backend);
+    }
+}
+
+
+bool Device::openPorts() {
+    // The ports are opened on first use:
+    if (midiout->isOpen()) {
+        return true;
+    }
+    midiin->setMidiInputPort(input);
+    return midiout->open(output);
+}
+
+
+void Device::backup(QString path) {
+    LOG_INFO(LogCategory::LIBRARY) << "Device::backup():" << mUnit << path;
+    if (job != IDLE) {
+        emit finished(mUnit, false, "busy");
+        return;
+    }
+    this->path = path;
+    job = BACKUP;
+    // The backup only has the programs of the device:
+    delete library;
+    library = new Library(midiout);
+    library->setMidiChannel(channel);
+    if (!openPorts()) {
+        finish(false, "could not open the MIDI ports");
+        return;
+    }
+    // The number of programs depends on the installed banks:
+    waitingForInfo = midiout->versionRequest() && midiout->numBanksRequest();
+    if (waitingForInfo) {
+        library->setFirmwareVersionRequested();
+        infoTimer->start();
+    } else {
+        startTransfer();
+    }
+}
+
+
+void Device::restore(QString path) {
+    LOG_INFO(LogCategory::LIBRARY) << "Device::restore():" << mUnit << path;
+    if (job != IDLE) {
+        emit finished(mUnit, false, "busy");
+        return;
+    }
+    this->path = path;
+    job = RESTORE;
+    // Indexed library (*.slb), like the backups are saved:
+    if (!library->openIndexed(path)) {
+        finish(false, "could not open " + path);
+        return;
+    }
+    if (!openPorts()) {
+        finish(false, "could not open the MIDI ports");
+        return;
+    }
+    waitingForInfo = midiout->versionRequest() && midiout->numBanksRequest();
+    if (waitingForInfo) {
+        library->setFirmwareVersionRequested();
+        infoTimer->start();
+    } else {
+        startTransfer();
+    }
+}
+
+
+void Device::cancel() {
+    if (job == IDLE) {
+        return;
+    }
+    library->abortFetching();
+    library->abortSending();
+    finish(false, "cancelled");
+}
+
+
+void Device::startTransfer() {
+    waitingForInfo = false;
+    infoTimer->stop();
+    const int &last = library->getNumberOfHWPrograms() - 1;
+    if (job == BACKUP) {
+        library->growVectorsTo(last + 1);
+        if (library->startFetching(Flag::PATCH | Flag::SEQUENCE, 0, last)) {
+            watchdog->start();
+        } else {
+            finish(false, "could not start fetching");
+        }
+    } else if (job == RESTORE) {
+        // Programs beyond the installed banks are not sent:
+        const int &to = std::min(last, library->getNumberOfPrograms() - 1);
+        watchdog->start(); // for the read-back verification
+        sendReturnHandler(library->startSending(Flag::PATCH | Flag::SEQUENCE | Flag::VERIFY, 0, to));
+    }
+}
+
+
+void Device::process(QueueItem item) {
+    if (item.action != QueueAction::SYSEX_RECEIVED) {
+        // Parameter changes and notes of the device are not used
+        return;
+    }
+    receivedSysex(item.int0, item.int1, item.size, item.message);
+    if (item.message) {
+        delete[] item.message;
+    }
+}
+
+
+void Device::receivedSysex(const unsigned int &command, const unsigned int &argument, const unsigned int &size, const unsigned char *message) {
+    if (command == 0x0c && argument == 0x00) {
+        // Version info
+        if (size == 2) {
+            firmwareVersion = message[0] * 1000 + message[1];
+            library->setFirmwareVersion(firmwareVersion);
+        }
+    } else if (command == 0x0b && size == 0) {
+        // Number of banks, see Editor::actionSysexReceived():
+        library->setNumberOfHWPrograms(16 + argument * 64);
+        if (waitingForInfo) {
+            startTransfer();
+        }
+    } else if (command == 0x01 && argument == 0x00 && library->isVerifying()) {
+        library->verifiedPatch(size == 92 ? message : NULL);
+        sendReturnHandler(true);
+    } else if (command == 0x02 && argument == 0x00 && library->isVerifying()) {
+        library->verifiedSequence(size == 32 ? message : NULL);
+        sendReturnHandler(true);
+    } else if (command == 0x01 && argument == 0x00 && library->isFetchingPatches()) {
+        if (size == 92 && library->receivedPatch(message)) {
+            fetchReturnHandler(true);
+        } else {
+            fetchReturnHandler(library->retryFetching());
+        }
+    } else if (command == 0x02 && argument == 0x00 && library->isFetchingSequences()) {
+        if (size == 32) {
+            fetchReturnHandler(library->receivedSequence(message));
+        } else {
+            fetchReturnHandler(library->retryFetching());
+        }
+    }
+}
+
+
+void Device::infoTimeout() {
+    // A Shruthi without a reply has the internal programs only:
+    LOG_INFO(LogCategory::LIBRARY) << "Device::infoTimeout(): unit" << mUnit << "did not reply.";
+    if (waitingForInfo) {
+        startTransfer();
+    }
+}
+
+
+void Device::transferWatchdog() {
+    if (job == BACKUP) {
+        fetchReturnHandler(library->checkFetching());
+    } else if (job == RESTORE && !library->checkVerifying()) {
+        sendReturnHandler(true);
+    }
+}
+
+
+void Device::fetchReturnHandler(const bool &ret) {
+    if (job != BACKUP) {
+        return;
+    }
+    if (!ret) {
+        library->abortFetching();
+        finish(false, "could not fetch the library");
+        return;
+    }
+    if (library->isFetchingPatches() || library->isFetchingSequences()) {
+        emit progress(mUnit, library->fetchProgress());
+        return;
+    }
+
+    const unsigned int &failures = library->fetchFailures().size();
+    QByteArray ba;
+    library->serializeIndexed(ba);
+    if (!FileIO::saveToDisk(path, ba)) {
+        finish(false, "could not save " + path);
+    } else if (failures > 0) {
+        finish(true, QString("saved, %1 program(s) could not be fetched").arg(failures));
+    } else {
+        finish(true, "saved");
+    }
+}
+
+
+void Device::sendNext() {
+    if (job == RESTORE) {
+        sendReturnHandler(library->keepSending());
+    }
+}
+
+
+void Device::sendReturnHandler(const bool &ret) {
+    if (job != RESTORE) {
+        return;
+    }
+    if (!ret) {
+        library->abortSending();
+        finish(false, "could not send the library");
+        return;
+    }
+    if (library->isSending()) {
+        emit progress(mUnit, library->sendProgress());
+        if (!sendTimer->isActive()) {
+            sendTimer->start(library->sendTimeout());
+        }
+        return;
+    }
+    if (library->isVerifying()) {
+        // Done when the last read-back arrived
+        return;
+    }
+    finish(true, ("sent. " + library->verifyReport()).trimmed());
+}
+
+
+void Device::finish(const bool &ok, const QString &status) {
+    watchdog->stop();
+    sendTimer->stop();
+    infoTimer->stop();
+    waitingForInfo = false;
+    job = IDLE;
+    static MetricsCounter *failed = Metrics::counter("rack.failed_jobs");
+    if (!ok) {
+        failed->add(1);
+    }
+    LOG_INFO(LogCategory::LIBRARY) << "Device::finish(): unit" << mUnit << ok << status;
+    emit finished(mUnit, ok, status);
+}
@@ -0,0 +1,102 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_DEVICE_H
+#define SHRUTHI_DEVICE_H
+
+
+#include <QObject>
+#include <QString>
+#include "queueitem.h"
+class Library;
+class MidiIn;
+class MidiOut;
+class QTimer;
+
+
+// A Shruthi of the rack, in addition to the one of the editor, with its own
+// port pair, channel, firmware version, filter board and library mirror.
+//
+// Each device runs on its own thread and talks to its Shruthi on its own MIDI
+// link, so the backups (fetch the library and save it) and restores (load a
+// library and send it) of all devices run in parallel.
+class Device : public QObject {
+        Q_OBJECT
+
+    public:
+        Device(const int &unit, const int &input, const int &output, const unsigned char &channel, const int &filter = 0);
+        ~Device();
+
+        const int &unit() const;
+
+    private:
+        Device(const Device&); //forbid copying
+        Device &operator=(const Device&); //forbid assignment
+
+        static const int IDLE = 0;
+        static const int BACKUP = 1;
+        static const int RESTORE = 2;
+        static const int INFO_TIMEOUT = 1000; // ms
+
+        bool openPorts();
+        void startTransfer();
+        void receivedSysex(const unsigned int &command, const unsigned int &argument, const unsigned int &size, const unsigned char *message);
+        void fetchReturnHandler(const bool &ret);
+        void sendReturnHandler(const bool &ret);
+        void finish(const bool &ok, const QString &status);
+
+        int mUnit;
+        int input;
+        int output;
+        unsigned char channel;
+        int filter;
+        int firmwareVersion;
+        int backend;
+
+        MidiIn *midiin; // child, moves to the device thread with it
+        MidiOut *midiout;
+        Library *library;
+
+        int job;
+        bool waitingForInfo; // number of banks requested
+        QString path;
+        QTimer *infoTimer;
+        QTimer *watchdog;
+        QTimer *sendTimer;
+
+    public slots:
+        void setMidiBackend(int backend);
+        void backup(QString path);
+        void restore(QString path);
+        void cancel();
+
+    private slots:
+        void process(QueueItem item);
+        void infoTimeout();
+        void transferWatchdog();
+        void sendNext();
+
+    signals:
+        void progress(int unit, QString status);
+        void finished(int unit, bool ok, QString status);
+};
+
+
+#endif // SHRUTHI_DEVICE_H
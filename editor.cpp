@@ -18,44 +18,95 @@
 
 
 #include "editor.h"
-#ifdef DEBUGMSGS
-#include <QDebug>
-#endif
+#include <QDateTime>
+#include <QThread>
 #include <QTimer>
 #include <algorithm> // for max, min
-#include <iostream>
 #include <stddef.h> // for NULL
+#include <string>
+#include "broadcast.h"
 #include "fileio.h"
+#include "fileworker.h"
 #include "flag.h"
 #include "library.h"
+#include "libraryfile.h"
+#include "libraryjournal.h"
+#include "log.h"
+#include "metrics.h"
 #include "message.h"
 #include "midi.h"
 #include "midiout.h"
+#include "morph.h"
+#include "parameterrecorder.h"
 #include "patch.h"
+#include "patchgenerator.h"
 #include "sequence.h"
 #include "sequence_parameter.h"
+#include "trace.h"
+#include "voiceallocator.h"
 
 
 Editor::Editor():
     midiout(new MidiOut),
+    virtualOut(new MidiOut),
+    voices(new VoiceAllocator(midiout)),
+    broadcast(new Broadcast),
+    generator(new PatchGenerator(QDateTime::currentMSecsSinceEpoch())),
     patch(new Patch),
     sequence(new Sequence),
-    library(new Library(midiout)) {
-#ifdef DEBUGMSGS
-    qDebug("Editor::Editor()");
-#endif
+    library(new Library(midiout)),
+    journal(NULL),
+    transfers(new TransferQueue),
+    transferRunning(false),
+    recallProgram(false),
+    morph(new Morph),
+    recorder(new ParameterRecorder),
+    playbackStart(0),
+    playbackScheduled(false),
+    fileWorker(new FileWorker(this)),
+    fileThread(new QThread) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::Editor()";
     shruthiFilterBoard = 0;
     firmwareVersion = 0;
 
+    // Child of the editor, so it moves to the editor thread with it:
+    transferWatchdog = new QTimer(this);
+    transferWatchdog->setInterval(Library::FETCH_TIMEOUT / 10);
+    connect(transferWatchdog, SIGNAL(timeout()), this, SLOT(libraryTransferWatchdog()));
+    sendTimer = new QTimer(this);
+    sendTimer->setSingleShot(true);
+    connect(sendTimer, SIGNAL(timeout()), this, SLOT(librarySendNext()));
+    morphTimer = new QTimer(this);
+    morphTimer->setInterval(Morph::FRAME_INTERVAL);
+    connect(morphTimer, SIGNAL(timeout()), this, SLOT(morphFrame()));
+    recorderTimer = new QTimer(this);
+    connect(recorderTimer, SIGNAL(timeout()), this, SLOT(recorderPlayback()));
+
+    for (int i = 0; i < QueueAction::COUNT; i++) {
+        processTime[i] = Metrics::histogram(std::string("editor.process.") + QueueAction::name(i));
+    }
+    itemWait = Metrics::histogram("editor.item.wait");
+
     // Relay status bar messages:
     connect(library, SIGNAL(displayStatusbar(QString)), this, SIGNAL(displayStatusbar(QString)));
+
+    // File I/O:
+    fileThread->setObjectName("File I/O");
+    fileWorker->moveToThread(fileThread);
+    connect(this, SIGNAL(fileLoad(QString,int)), fileWorker, SLOT(loadFile(QString,int)));
+    connect(this, SIGNAL(fileSave(QString,QByteArray,int)), fileWorker, SLOT(saveFile(QString,QByteArray,int)));
+    connect(this, SIGNAL(libraryLoad(QString,int,int)), fileWorker, SLOT(loadLibrary(QString,int,int)));
+    connect(this, SIGNAL(librarySave(QString,QByteArray,int)), fileWorker, SLOT(saveLibrary(QString,QByteArray,int)));
+    connect(this, SIGNAL(libraryImport(QStringList,int,int)), fileWorker, SLOT(importLibraries(QStringList,int,int)));
+    connect(fileWorker, SIGNAL(enqueue(QueueItem)), this, SIGNAL(enqueue(QueueItem)));
+    connect(fileWorker, SIGNAL(progressChanged(int)), this, SIGNAL(fileProgress(int)));
+    connect(fileWorker, SIGNAL(displayStatusbar(QString)), this, SIGNAL(displayStatusbar(QString)));
+    fileThread->start();
 }
 
 
 void Editor::run() {
-#ifdef DEBUGMSGS
-    qDebug("Editor::run()");
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::run()";
     emit setStatusbarVersionLabel(patch->getVersionString());
     redrawLibraryItems(Flag::PATCH|Flag::SEQUENCE, 0, library->getNumberOfPrograms() - 1);
     redrawAllPatchParameters();
@@ -63,52 +114,125 @@ void Editor::run() {
 }
 
 
+void Editor::setMidiBackend(int backend) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::setMidiBackend:" << backend;
+    midiout->setBackend(backend);
+    broadcast->setBackend(backend);
+}
+
+
 bool Editor::setMidiOutputPort(int out) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::setMidiPorts:" << out;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::setMidiPorts:" << out;
     bool status = midiout->open(out);
     emit midiOutputStatusChanged(status);
     return status;
 }
 
 
+void Editor::setMidiVirtualPorts(bool enabled) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::setMidiVirtualPorts:" << enabled;
+    if (enabled) {
+        virtualOut->openVirtual("Automation Out");
+    } else {
+        virtualOut->close();
+    }
+}
+
+
 void Editor::setMidiChannel(unsigned char channel) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::setMidiChannel:" << channel;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::setMidiChannel:" << channel;
     Editor::channel = channel;
     library->setMidiChannel(channel);
 }
 
 
 void Editor::setShruthiFilterBoard(int filter) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::setShruthiFilterBoard:" << filter;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::setShruthiFilterBoard:" << filter;
     Editor::shruthiFilterBoard = filter;
+    generator->setFilterBoard(filter);
+}
+
+
+MidiOut *Editor::getMidiOut() {
+    // MidiOut is thread-safe, so it can be shared with the thru callback.
+    return midiout;
+}
+
+
+VoiceAllocator *Editor::getVoiceAllocator() {
+    return voices;
+}
+
+
+Broadcast *Editor::getBroadcast() {
+    return broadcast;
+}
+
+
+PatchGenerator *Editor::getPatchGenerator() {
+    return generator;
+}
+
+
+void Editor::openJournal(const QString &directory) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::openJournal:" << directory;
+    journal = new LibraryJournal(directory);
+    // Restore the library of the last session, then record all edits:
+    journal->replay(*library);
+    library->setJournal(journal);
 }
 
 
 Editor::~Editor() {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::~Editor()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::~Editor()";
+    fileWorker->cancel();
+    fileThread->quit();
+    fileThread->wait();
+    delete fileWorker;
+    fileWorker = NULL;
+    delete fileThread;
+    fileThread = NULL;
+    // A fresh snapshot makes the next start instant:
+    if (journal && !journal->isClean()) {
+        journal->compact(*library);
+    }
+    library->setJournal(NULL);
+    delete journal;
+    journal = NULL;
     delete library;
     library = NULL;
+    delete transfers;
+    transfers = NULL;
+    delete morph;
+    morph = NULL;
+    delete recorder;
+    recorder = NULL;
     delete sequence;
     sequence = NULL;
     delete patch;
     patch = NULL;
+    delete voices;
+    voices = NULL;
+    delete broadcast;
+    broadcast = NULL;
+    delete generator;
+    generator = NULL;
     delete midiout;
     midiout = NULL;
+    delete virtualOut;
+    virtualOut = NULL;
 }
 
 
 void Editor::process(QueueItem item) {
+    const qint64 &start = Trace::now();
+    itemWait->record(start - item.created);
+    Trace::setCurrent(item.traceId);
+
     switch(item.action) {
         case QueueAction::PATCH_PARAMETER_CHANGE_EDITOR:
             actionPatchParameterChangeEditor(item.int0, item.int1);
+            recordPatchParameter(item.created, ParameterRecorder::EDITOR, item.int0);
             break;
         case QueueAction::SEQUENCE_PARAMETER_CHANGE_EDITOR:
             actionSequenceParameterChangeEditor(item.int0, item.int1);
@@ -123,7 +247,8 @@ void Editor::process(QueueItem item) {
             actionShruthiInfoRequest();
             break;
         case QueueAction::PATCH_PARAMETER_CHANGE_MIDI:
-            actionPatchParameterChangeMidi(item.int0, item.int1);
+            actionPatchParameterChangeMidi(item.int0, item.int1, item.int2 == 0);
+            recordPatchParameter(item.created, ParameterRecorder::SHRUTHI, item.int0);
             break;
         case QueueAction::NOTE_ON:
             actionNoteOn(item.int0,item.int1);
@@ -146,6 +271,15 @@ void Editor::process(QueueItem item) {
         case QueueAction::FILEIO_SAVE:
             actionFileIOSave(item.string, item.int0);
             break;
+        case QueueAction::FILEIO_LOADED:
+            actionFileIOLoaded(item.string, item.int0, item.int1, item.size, item.message);
+            break;
+        case QueueAction::FILEIO_SAVED:
+            actionFileIOSaved(item.string, item.int0, item.int1);
+            break;
+        case QueueAction::FILEIO_CANCEL:
+            fileWorker->cancel();
+            break;
         case QueueAction::RESET_PATCH:
             actionResetPatch(item.int0);
             break;
@@ -164,6 +298,9 @@ void Editor::process(QueueItem item) {
         case QueueAction::LIBRARY_SEND:
             actionLibrarySend(item.int0, item.int1, item.int2);
             break;
+        case QueueAction::LIBRARY_CANCEL_TRANSFER:
+            actionLibraryCancelTransfer(item.int1, item.int2); // ignore flags (item.int0)
+            break;
         case QueueAction::LIBRARY_REMOVE:
             actionLibraryRemove(item.int1, item.int2); // ignore flags (item.int0)
             break;
@@ -179,30 +316,87 @@ void Editor::process(QueueItem item) {
         case QueueAction::LIBRARY_SAVE:
             actionLibrarySave(item.string, item.int0);
             break;
+        case QueueAction::LIBRARY_LOADED:
+            actionLibraryLoaded(item.int0, item.int1, item.int2);
+            break;
+        case QueueAction::LIBRARY_SAVED:
+            actionLibrarySaved(item.int1, item.int2);
+            break;
+        case QueueAction::LIBRARY_IMPORT:
+            emit libraryImport(item.strings, item.int0, firmwareVersion);
+            break;
+        case QueueAction::LIBRARY_IMPORTED:
+            actionLibraryImported(item.int0, item.int2, item.strings);
+            break;
         case QueueAction::RESET_SEQUENCE:
             actionResetSequence();
             break;
         case QueueAction::RANDOMIZE_PATCH:
             actionRandomizePatch();
             break;
+        case QueueAction::UPGRADE_PATCH:
+            actionUpgradePatch();
+            break;
+        case QueueAction::LIBRARY_UPGRADE:
+            actionLibraryUpgrade(item.int1, item.int2); // ignore flags (item.int0)
+            break;
+        case QueueAction::LIBRARY_GENERATE:
+            actionLibraryGenerate(item.int1, item.int2); // ignore flags (item.int0)
+            break;
+        case QueueAction::MORPH_START:
+            actionMorphStart(item.int0, item.int1);
+            break;
+        case QueueAction::MORPH_POSITION:
+            actionMorphPosition(item.int0);
+            break;
+        case QueueAction::MORPH_RAMP:
+            actionMorphRamp(item.int0, item.int1);
+            break;
+        case QueueAction::MORPH_STOP:
+            actionMorphStop();
+            break;
+        case QueueAction::RECORDER_RECORD:
+            actionRecorderRecord();
+            break;
+        case QueueAction::RECORDER_PLAY:
+            actionRecorderPlay(item.int0, item.int1, item.int2);
+            break;
+        case QueueAction::RECORDER_STOP:
+            actionRecorderStop();
+            break;
         case QueueAction::NOOP:
             break;
         default:
-#ifdef DEBUGMSGS
-            qDebug() << "Editor::process():" << item.action << ":" << item.int0 << "," << item.int1 << "," << item.string;
-#endif
+            LOG_TRACE(LogCategory::EDITOR) << "Editor::process():" << item.action << ":" << item.int0 << "," << item.int1 << "," << item.string;
             break;
     }
+
+    // Write a new snapshot when the journal got big or the library was
+    // replaced:
+    if (journal && journal->needsCompaction() && !journal->compact(*library) &&
+            journal->compactionFailures() == 1) {
+        if (journal->isRecording()) {
+            emit displayStatusbar("Could not write the library snapshot, the journal keeps the edits.");
+        } else {
+            emit displayStatusbar("Could not write the library snapshot, the replaced library is not saved.");
+        }
+    }
+
+    if (item.action >= 0 && item.action < QueueAction::COUNT) {
+        processTime[item.action]->record(Trace::now() - start);
+    }
+    Trace::complete(QueueAction::name(item.action), item.traceId, start);
+    Trace::end(QueueAction::name(item.action), item.traceId);
+    Trace::setCurrent(0);
     emit finished();
 }
 
 
 void Editor::actionPatchParameterChangeEditor(int id, int value) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionPatchParameterChangeEditor(" << id << "," << value << ")";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionPatchParameterChangeEditor(" << id << "," << value << ")";
     if (patch->getValue(id) != value) {
         patch->setValue(id, value);
+        mirrorPatchParameter(id, value);
 
         //strange hack to fix arpeggiator range
         //firmware 1.03 maps 1->1, 2->1, 3->2, 4->3
@@ -211,30 +405,46 @@ void Editor::actionPatchParameterChangeEditor(int id, int value) {
             value += 1;
         }
 
+        // A polychain gets the change on all units at once:
+        const bool &polychain = voices->isEnabled();
         if (Patch::sendAsNRPN(id)) {
-            if (!midiout->nrpn(channel, id, value)) {
+            const bool &sent = polychain ? midiout->nrpnBroadcast(voices->channels(), id, value) : midiout->nrpn(channel, id, value);
+            if (!sent) {
                 emit displayStatusbar("Could not send changes as NRPN.");
             }
         } else {
-            const PatchParameter &param = Patch::parameter(id, shruthiFilterBoard);
-            const int &cc = param.cc;
-            const int &val = 127.0 * (value - param.min) / param.max;
+            const int &cc = Patch::parameter(id, shruthiFilterBoard).cc;
+            const int &val = Patch::convertToCCValue(id, value, shruthiFilterBoard);
             if (cc >= 0) {
-                if (!midiout->controlChange(channel, cc, val)) {
+                Message message(3);
+                message[0] = 0xb0 | channel;
+                message[1] = cc;
+                message[2] = val;
+                const bool &sent = polychain ? midiout->writeBroadcast(voices->channels(), message) : midiout->controlChange(channel, cc, val);
+                if (!sent) {
                     emit displayStatusbar("Could not send changes as CC.");
                 }
             } else {
                 emit displayStatusbar("Could not send changes.");
             }
         }
+
+        if (broadcast->isEnabled()) {
+            if (Patch::sendAsNRPN(id)) {
+                broadcast->nrpn(id, value);
+            } else {
+                const int &cc = Patch::parameter(id, shruthiFilterBoard).cc;
+                if (cc >= 0) {
+                    broadcast->controlChange(cc, Patch::convertToCCValue(id, value, shruthiFilterBoard));
+                }
+            }
+        }
     }
 }
 
 
 void Editor::actionFetchRequest(const int &what) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionFetchRequest()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionFetchRequest()";
     bool statusP = true;
     if (what&Flag::PATCH) {
         statusP = midiout->patchTransferRequest();
@@ -277,14 +487,15 @@ void Editor::actionFetchRequest(const int &what) {
 
 
 void Editor::actionSendData(const int &what) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionSendData()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionSendData()";
     bool statusP = true;
     if (what&Flag::PATCH) {
         Message temp;
         patch->generateSysex(&temp);
         statusP = midiout->write(temp);
+        if (broadcast->isEnabled()) {
+            broadcast->patch(temp);
+        }
     }
     bool statusS = true;
     if (what&Flag::SEQUENCE) {
@@ -316,26 +527,20 @@ void Editor::actionSendData(const int &what) {
 
 
 void Editor::actionShruthiInfoRequest() {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionShruthiInfoRequest()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionShruthiInfoRequest()";
     if (midiout->versionRequest() && midiout->numBanksRequest()) {
         library->setFirmwareVersionRequested();
         //emit displayStatusbar("Version request sent.");
-#ifdef DEBUGMSGS
-        std::cout  << "Version and number of banks requests sent." << std::endl;
+        LOG_DEBUG(LogCategory::EDITOR) << "Version and number of banks requests sent.";
     } else {
         //emit displayStatusbar("Could not send version request.");
-        std::cout  << "Could not send version and/or number of banks request." << std::endl;
-#endif
+        LOG_DEBUG(LogCategory::EDITOR) << "Could not send version and/or number of banks request.";
     }
 }
 
 
-void Editor::actionPatchParameterChangeMidi(int id, int value) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionPatchParameterChangeMidi(" << id << "," << value << ")";
-#endif
+void Editor::actionPatchParameterChangeMidi(int id, int value, const bool &mirror) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionPatchParameterChangeMidi(" << id << "," << value << ")";
     if (!Patch::enabled(id)) {
         return;
     }
@@ -344,37 +549,57 @@ void Editor::actionPatchParameterChangeMidi(int id, int value) {
         value-=256; //2s complement
     }
     patch->setValue(id, value);
+    // Changes of the automation input came from the virtual port and would
+    // loop back (e.g. DAW with input monitoring):
+    if (mirror) {
+        mirrorPatchParameter(id, value);
+    }
     if (Patch::hasUI(id)) {
         emit redrawPatchParameter(id, value);
     }
 }
 
 
+void Editor::mirrorPatchParameter(const int &id, const int &value) {
+    // Send changes of the editor and the Shruthi to the virtual output, so
+    // they can be recorded (e.g. by a DAW). Prefer CCs, since they are widely
+    // supported by sequencers.
+    if (!virtualOut->isOpen()) {
+        return;
+    }
+    const int &cc = Patch::parameter(id, shruthiFilterBoard).cc;
+    if (cc >= 0) {
+        virtualOut->controlChange(channel, cc, Patch::convertToCCValue(id, value, shruthiFilterBoard));
+    } else if (Patch::sendAsNRPN(id)) {
+        virtualOut->nrpn(channel, id, value);
+    }
+}
+
+
 void Editor::actionNoteOn(unsigned char note, unsigned char velocity) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionNoteOn(" << channel << "," << note << "," << velocity << ")";
-#endif
-    if (!midiout->noteOn(channel, note, velocity)) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionNoteOn(" << channel << "," << note << "," << velocity << ")";
+    if (voices->isEnabled()) {
+        voices->noteOn(note, velocity);
+    } else if (!midiout->noteOn(channel, note, velocity)) {
         emit displayStatusbar("Could not send note on message.");
     }
 }
 
 
 void Editor::actionNoteOff(unsigned char note) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionNoteOff(" << channel << "," << note << ")";
-#endif
-    if (!midiout->noteOff(channel, note)) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionNoteOff(" << channel << "," << note << ")";
+    if (voices->isEnabled()) {
+        voices->noteOff(note);
+    } else if (!midiout->noteOff(channel, note)) {
         emit displayStatusbar("Could not send note off message.");
     }
 }
 
 
 void Editor::actionNotePanic() {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionNotePanic(" << channel << ")";
-#endif
-    if (midiout->allNotesOff(channel)) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionNotePanic(" << channel << ")";
+    const bool &sent = voices->isEnabled() ? voices->allNotesOff() : midiout->allNotesOff(channel);
+    if (sent) {
         emit displayStatusbar("Sent all notes off message.");
     } else {
         emit displayStatusbar("Could not send all notes off message.");
@@ -384,9 +609,7 @@ void Editor::actionNotePanic() {
 
 void Editor::actionSysexReceived(unsigned int command, unsigned int argument,
                                  unsigned int size, unsigned char* message) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionSysexReceived(" << size << ",...)";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionSysexReceived(" << size << ",...)";
     if (size == 0 && command == 0 && argument == 0) {
         emit displayStatusbar("Received invalid SysEx.");
     } else if (command == 0x0c && argument == 0x00) {
@@ -399,14 +622,23 @@ void Editor::actionSysexReceived(unsigned int command, unsigned int argument,
         const int &patchNo = message[0] | message[1] << 8;
         const int &sequenceNo = message[2] | message[3] << 8;
         library->rememberShruthiProgram(patchNo, sequenceNo);
-#ifdef DEBUGMSGS
-        qDebug() << "Current program: " << patchNo << sequenceNo;
-#endif
+        LOG_DEBUG(LogCategory::EDITOR) << "Current program: " << patchNo << sequenceNo;
+    } else if ((command == 0x01 || command == 0x02) && argument == 0x00 && library->isVerifying()) {
+        // Read-back of a sent program. Every reply goes to the verification,
+        // one of the wrong type fails it instead of replacing the edit buffer:
+        if (command == 0x01) {
+            library->verifiedPatch(size == 92 ? message : NULL);
+        } else {
+            library->verifiedSequence(size == 32 ? message : NULL);
+        }
+        librarySendContinue();
     } else if (command == 0x01 && argument == 0x00) {
         bool ret = (size == 92);
+        bool fetched = false;
         QString progress;
         if (ret) {
             if (library->isFetchingPatches()) {
+                fetched = true;
                 progress = library->fetchProgress();
                 ret = library->receivedPatch(message);
                 if (ret) {
@@ -422,17 +654,21 @@ void Editor::actionSysexReceived(unsigned int command, unsigned int argument,
             redrawAllPatchParameters();
             emit setStatusbarVersionLabel(patch->getVersionString());
         } else {
+            emit displayStatusbar(progress + "Received invalid patch.");
             if (library->isFetchingPatches()) {
-                library->abortFetching();
+                libraryFetchReturnHandler(library->retryFetching());
+            } else if (fetched) {
+                libraryFetchReturnHandler(false); // requesting the next program failed
             }
-            emit displayStatusbar(progress + "Received invalid patch.");
         }
     } else if (command == 0x02 && argument == 0x00) {
         QString progress;
         if (size == 32) {
             if (library->isFetchingSequences()) {
                 progress = library->fetchProgress();
-                library->receivedSequence(message);
+                if (!library->receivedSequence(message)) {
+                    libraryFetchReturnHandler(false);
+                }
                 emit redrawLibraryItems(Flag::SEQUENCE, library->nextSequence() - 1, library->nextSequence() - 1);
             } else {
                 sequence->unpackData(message);
@@ -441,44 +677,50 @@ void Editor::actionSysexReceived(unsigned int command, unsigned int argument,
             emit displayStatusbar(progress + "Received valid sequence.");
             redrawAllSequenceParameters();
         } else {
+            emit displayStatusbar(progress + "Received invalid sequence.");
             if (library->isFetchingSequences()) {
-                library->abortFetching();
+                libraryFetchReturnHandler(library->retryFetching());
             }
-            emit displayStatusbar(progress + "Received invalid sequence.");
         }
     } else if (command == 0x0b and size == 0) {
         // number of banks
         const int &numberOfPrograms = 16 + argument * 64; // internal + external
-#ifdef DEBUGMSGS
-        std::cout << "Number of banks is " << argument << ". Therefore the number of programs is " << numberOfPrograms << "." << std::endl;
-#endif
+        LOG_DEBUG(LogCategory::EDITOR) << "Number of banks is" << argument << ", therefore the number of programs is" << numberOfPrograms;
         library->setNumberOfHWPrograms(numberOfPrograms);
         emit redrawLibraryItems(Flag::PATCH | Flag::SEQUENCE, 0, library->getNumberOfPrograms() - 1);
     } else {
         emit displayStatusbar("Received unknown sysex.");
-#ifdef DEBUGMSGS
-        qDebug() << "Unknown sysex type...";
-        std::cout << "Unknown sysex with command " << command << ", argument " << argument << " and length " << size << " received." << std::endl;
-#endif
+        LOG_DEBUG(LogCategory::EDITOR) << "Unknown sysex type...";
+        LOG_DEBUG(LogCategory::EDITOR) << "Unknown sysex with command" << command << ", argument" << argument << "and length" << size << "received.";
     }
     if (message) {
         delete message;
     }
+
+    if (transferRunning && transfer.type == TransferQueue::FETCH) {
+        libraryFetchReturnHandler(true);
+    }
 }
 
 
 void Editor::actionSetPatchname(QString name) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionSetPatchname(" << name << ")";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionSetPatchname(" << name << ")";
     patch->setName(name);
     emit displayStatusbar("Patch name set.");
 }
 
 
 void Editor::actionFileIOLoad(QString path, const int &what) {
+    emit fileLoad(path, what);
+}
+
+
+void Editor::actionFileIOLoaded(QString path, const int &what, const bool &status, unsigned int size, unsigned char *message) {
     Message temp;
-    bool status = FileIO::loadFromDisk(path, temp);
+    if (message) {
+        temp.assign(message, message + size);
+        delete[] message;
+    }
     bool statusP = status;
     bool statusS = status;
 
@@ -486,15 +728,11 @@ void Editor::actionFileIOLoad(QString path, const int &what) {
 
     if (status && path.endsWith(".sp", Qt::CaseInsensitive) && (what&Flag::PATCH)) {
         if (readBytes == 92) {
-#ifdef DEBUGMSGS
-            qDebug() << "Detected light patch files.";
-#endif
+            LOG_DEBUG(LogCategory::EDITOR) << "Detected light patch files.";
             unsigned char data[92];
             for (unsigned int i=0; i<readBytes; i++) {
                 data[i] = (char) temp[i];
-#ifdef DEBUGMSGS
-                qDebug() << i << ":" << temp[i];
-#endif
+                LOG_TRACE(LogCategory::FILEIO) << i << ":" << temp[i];
             }
             statusP = patch->unpackData(data);
         } else {
@@ -515,9 +753,7 @@ void Editor::actionFileIOLoad(QString path, const int &what) {
         }
     }
 
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionFileIOLoad(" << path << "):" << status;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionFileIOLoad(" << path << "):" << status;
 
     QString swhat = "unknown";
     QString sWhat = "Unknown";
@@ -576,10 +812,12 @@ void Editor::actionFileIOSave(QString path, const int &what) {
         FileIO::appendToByteArray(temp, ba);
     }
 
-    bool status = FileIO::saveToDisk(path, ba);
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionFileIOSave(" << path << "):" << status;
-#endif
+    emit fileSave(path, ba, what);
+}
+
+
+void Editor::actionFileIOSaved(QString path, const int &what, const bool &status) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionFileIOSave(" << path << "):" << status;
 
     QString swhat = "unknown";
     QString sWhat = "Unknown";
@@ -603,9 +841,7 @@ void Editor::actionFileIOSave(QString path, const int &what) {
 
 
 void Editor::actionResetPatch(unsigned int version) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionResetPatch()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionResetPatch()";
     patch->reset(version);
     redrawAllPatchParameters();
     emit displayStatusbar("Patch reset.");
@@ -614,28 +850,34 @@ void Editor::actionResetPatch(unsigned int version) {
 
 
 void Editor::actionRandomizePatch() {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionRandomizePatch()";
-#endif
-    patch->randomize(shruthiFilterBoard);
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionRandomizePatch()";
+    generator->generate(*patch);
     redrawAllPatchParameters();
     emit displayStatusbar("Patch randomized.");
     emit setStatusbarVersionLabel(patch->getVersionString());
 }
 
 
+void Editor::actionUpgradePatch() {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionUpgradePatch()";
+    if (!patch->upgrade()) {
+        emit displayStatusbar("The patch already has the 1.xx format.");
+        return;
+    }
+    redrawAllPatchParameters();
+    emit displayStatusbar("Patch converted to the 1.xx format.");
+    emit setStatusbarVersionLabel(patch->getVersionString());
+}
+
+
 void Editor::actionSequenceParameterChangeEditor(const unsigned &id, const int &value) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionSequenceParameterChangeEditor()" << id << value;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionSequenceParameterChangeEditor()" << id << value;
     sequence->setValueById(id, value);
 }
 
 
 void Editor::actionResetSequence() {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionResetSequence()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionResetSequence()";
     sequence->reset();
     redrawAllSequenceParameters();
     emit displayStatusbar("Sequence reset.");
@@ -643,85 +885,231 @@ void Editor::actionResetSequence() {
 
 
 void Editor::actionLibraryFetch(const unsigned int &what, const int &start, const int &stop) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionLibraryFetch()";
-#endif
-    if (library->isFetchingPatches() || library->isFetchingSequences()) {
-        // It would be nice to enqueue several fetch commands, but it isn't that easy if you
-        // consider the way fetching works. Therefore we take the easy way out.
-        // If we get the command to start another fetch we either ignore it or abort fetching.
-        if (stop < 0) {
-            library->abortFetching();
-            emit displayStatusbar("Aborted fetching the library.");
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryFetch()";
+    const bool &fetching = (transferRunning && transfer.type == TransferQueue::FETCH) || transfers->count(TransferQueue::FETCH) > 0;
+    if (stop < 0 && fetching) {
+        // Fetching the whole library while fetching aborts all fetch jobs:
+        transfers->clear(TransferQueue::FETCH);
+        if (transferRunning && transfer.type == TransferQueue::FETCH) {
+            abortTransfer();
         }
+        emit displayStatusbar("Aborted fetching the library.");
+        startNextTransfer();
         return;
     }
 
-    bool error = !midiout->currentPatchSequenceRequest();
-
     const int &st = stop >= 0 ? stop : (library->getNumberOfHWPrograms() - 1);
+    queueTransfer(TransferQueue::FETCH, what, start, st);
+}
+
+
+void Editor::libraryFetchReturnHandler(const bool &ret) {
+    if (!ret) {
+        transferWatchdog->stop();
+        emit displayStatusbar("An error occured during fetching of the library.");
+        finishTransfer(false);
+        return;
+    }
+    if (library->isFetchingPatches() || library->isFetchingSequences()) {
+        return;
+    }
 
-    if (!error && library->startFetching(what, start, st)) {
-        emit displayStatusbar("Started to fetch the library.");
+    // Finished, report the programs that were skipped:
+    transferWatchdog->stop();
+    const std::vector<int> &failures = library->fetchFailures();
+    if (failures.empty()) {
+        emit displayStatusbar("Finished fetching the library.");
     } else {
-        emit displayStatusbar("Could not start fetching the library.");
+        QStringList programs;
+        for (unsigned int i = 0; i < failures.size(); i++) {
+            programs << QString::number(failures.at(i) + 1); // displayed numbering
+        }
+        emit displayStatusbar(QString("Finished fetching the library, could not fetch program(s) %1.").arg(programs.join(", ")));
+    }
+    finishTransfer(true);
+}
+
+
+void Editor::libraryTransferWatchdog() {
+    if (transferRunning && transfer.type == TransferQueue::SEND) {
+        if (!library->checkVerifying()) {
+            librarySendContinue();
+        }
+        return;
     }
+    libraryFetchReturnHandler(library->checkFetching());
 }
 
 
 void Editor::actionLibrarySend(const unsigned int &what, const int &start, const int &end) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionLibrarySend()" << what << start << end;
-#endif
-    if (library->isSending()) {
-        // It would be nice to enqueue several send commands, but it isn't that easy if you
-        // consider the way fetching works. Therefore we take the easy way out.
-        // If we get the command to start another send we either ignore it or abort sending.
-        if (end < 0) {
-            std::cout << "abort" << std::endl;
-            library->abortSending();
-            emit displayStatusbar("Aborted sending the library.");
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibrarySend()" << what << start << end;
+    const bool &sending = (transferRunning && transfer.type == TransferQueue::SEND) || transfers->count(TransferQueue::SEND) > 0;
+    if (end < 0 && sending) {
+        // Sending the whole library while sending aborts all send jobs:
+        LOG_INFO(LogCategory::EDITOR) << "abort";
+        transfers->clear(TransferQueue::SEND);
+        if (transferRunning && transfer.type == TransferQueue::SEND) {
+            abortTransfer();
         }
+        emit displayStatusbar("Aborted sending the library.");
+        startNextTransfer();
         return;
     }
 
-    emit displayStatusbar("Started sending the library.");
     const int &st = end >= 0 ? end : (library->getNumberOfHWPrograms() - 1);
-    actionLibrarySendReturnHandler(library->startSending(what, start, st));
+    queueTransfer(TransferQueue::SEND, what, start, st);
 }
 
 
 void Editor::actionLibrarySendReturnHandler(const bool &ret) {
     if (ret && library->isSending()) {
-        QTimer::singleShot(library->sendTimeout(), this, SLOT(librarySendNext()));
+        sendTimer->start(library->sendTimeout());
     }
 
     if (!ret) {
+        library->abortSending();
         emit displayStatusbar("An error occured during sending of the library.");
     }
 
-    if (!library->isSending() && ret) {
-        emit displayStatusbar("Finished sending the library.");
-    }
-
     // Redraw UI (always do this; there could be a partial success):
     const int &index = library->sendRedrawIndex();
     if (index >= 0) {
         const int &flags = library->sendRedrawFlags();
         emit redrawLibraryItems(flags, index, index);
     }
+
+    if (library->isSending()) {
+        return;
+    }
+    if (ret && library->isVerifying()) {
+        // Done when the last read-back arrived, see librarySendContinue():
+        emit displayStatusbar("Verifying the sent programs.");
+        return;
+    }
+
+    transferWatchdog->stop();
+    if (ret) {
+        emit displayStatusbar(QString("Finished sending the library. " + library->verifyReport()).trimmed());
+        if (transfer.flags & Flag::VERIFY) {
+            // Programs that could not be stored are marked as edited again:
+            redrawLibraryItems(Flag::PATCH | Flag::SEQUENCE, 0, library->getNumberOfPrograms() - 1);
+        }
+    }
+    finishTransfer(ret);
+}
+
+
+void Editor::librarySendContinue() {
+    if (!transferRunning || transfer.type != TransferQueue::SEND) {
+        return;
+    }
+    // Mismatches are sent again, the job is done after the last read-back:
+    if (library->isSending()) {
+        if (!sendTimer->isActive()) {
+            sendTimer->start(0);
+        }
+    } else {
+        actionLibrarySendReturnHandler(true);
+    }
 }
 
 
 void Editor::librarySendNext() {
-    actionLibrarySendReturnHandler(library->keepSending());
+    if (transferRunning && transfer.type == TransferQueue::SEND) {
+        actionLibrarySendReturnHandler(library->keepSending());
+    }
+}
+
+
+void Editor::actionLibraryCancelTransfer(const int &start, const int &end) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryCancelTransfer()" << start << end;
+    const int &cancelled = transfers->cancel(-1, start, end);
+    const bool &running = transferRunning && transfer.from <= end && start <= transfer.to;
+    if (running) {
+        // Jobs are cancelled as a whole once they run:
+        abortTransfer();
+    }
+    if (running || cancelled > 0) {
+        emit displayStatusbar(QString("Cancelled the transfer of programs %1-%2.").arg(start + 1).arg(end + 1));
+    }
+    startNextTransfer();
+}
+
+
+void Editor::queueTransfer(const int &type, const int &flags, const int &from, const int &to) {
+    const TransferQueue::Job &job = transfers->add(type, flags, from, to);
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::queueTransfer(): job" << job.id << "type" << job.type << "flags" << job.flags
+                                   << "programs" << job.from << "to" << job.to;
+    if (transferRunning) {
+        emit displayStatusbar(QString("Queued the transfer of programs %1-%2.").arg(from + 1).arg(to + 1));
+        return;
+    }
+    startNextTransfer();
+}
+
+
+void Editor::startNextTransfer() {
+    while (!transferRunning && transfers->takeNext(transfer)) {
+        if (transfer.type == TransferQueue::FETCH) {
+            // The current program is requested once for all queued fetches:
+            if (!recallProgram) {
+                recallProgram = midiout->currentPatchSequenceRequest();
+            }
+            if (recallProgram && library->startFetching(transfer.flags, transfer.from, transfer.to)) {
+                transferRunning = true;
+                transferWatchdog->start();
+                emit displayStatusbar("Started to fetch the library.");
+            } else {
+                emit displayStatusbar("Could not start fetching the library.");
+            }
+        } else {
+            // The read-back switches the Shruthi to the verified programs:
+            if ((transfer.flags & Flag::VERIFY) && !recallProgram) {
+                recallProgram = midiout->currentPatchSequenceRequest();
+            }
+            emit displayStatusbar("Started sending the library.");
+            transferRunning = true;
+            transferWatchdog->start(); // for read-back verification
+            actionLibrarySendReturnHandler(library->startSending(transfer.flags, transfer.from, transfer.to));
+        }
+    }
+
+    if (!transferRunning && recallProgram) {
+        // All jobs are done, return to the program selected before fetching
+        // or verifying:
+        library->recallShruthiProgramm();
+        recallProgram = false;
+    }
+}
+
+
+void Editor::finishTransfer(const bool &ok) {
+    if (!transferRunning) {
+        return;
+    }
+    transferRunning = false;
+    if (!ok) {
+        // The MIDI output failed, the remaining jobs would fail as well:
+        transfers->clear(-1);
+    }
+    startNextTransfer();
+}
+
+
+void Editor::abortTransfer() {
+    if (transfer.type == TransferQueue::FETCH) {
+        library->abortFetching();
+    } else {
+        library->abortSending();
+        sendTimer->stop();
+    }
+    transferWatchdog->stop();
+    transferRunning = false;
 }
 
 
 void Editor::actionLibraryRecall(const unsigned int &what, const unsigned int &id) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionLibraryRecall()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryRecall()";
     Q_UNUSED(what);
 
     if (what&Flag::PATCH) {
@@ -736,9 +1124,7 @@ void Editor::actionLibraryRecall(const unsigned int &what, const unsigned int &i
 
 
 void Editor::actionLibraryStore(const unsigned int &what, const unsigned int &id) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionLibraryStore()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryStore()";
     if (what&Flag::PATCH) {
         library->storePatch(id, *patch);
         redrawLibraryItems(Flag::PATCH, id, id);
@@ -751,9 +1137,7 @@ void Editor::actionLibraryStore(const unsigned int &what, const unsigned int &id
 
 
 void Editor::actionLibraryMove(const unsigned int &what, const unsigned int &start, const unsigned int &target) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionLibraryMove()";
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryMove()";
     if (what&Flag::PATCH) {
         library->movePatch(start, target);
     }
@@ -767,8 +1151,24 @@ void Editor::actionLibraryMove(const unsigned int &what, const unsigned int &sta
 
 
 void Editor::actionLibraryLoad(const QString &path, const int &flags) {
-    // Always load patches and sequences
-    if (library->loadLibrary(path, flags&Flag::APPEND)) {
+    // Always load patches and sequences; the file is parsed into a staging
+    // library on the file thread (see actionLibraryLoaded()).
+    emit libraryLoad(path, flags, firmwareVersion);
+}
+
+
+void Editor::actionLibraryLoaded(const int &flags, const bool &status, const bool &cancelled) {
+    Library *staged = fileWorker->takeLibrary();
+    if (cancelled || !staged) {
+        emit displayStatusbar(cancelled ? "Loading the library was cancelled." : "Could not load library from disk.");
+        delete staged;
+        return;
+    }
+
+    // Like before, partially loaded libraries are kept:
+    library->takePrograms(*staged, flags&Flag::APPEND);
+    delete staged;
+    if (status) {
         emit displayStatusbar("Library loaded from disk.");
     } else {
         emit displayStatusbar("Could not load library from disk.");
@@ -778,43 +1178,277 @@ void Editor::actionLibraryLoad(const QString &path, const int &flags) {
 
 
 void Editor::actionLibrarySave(const QString &path, const int &flags) {
-    Q_UNUSED(flags);
     // Always save patches and sequences
-    if (library->saveLibrary(path)) {
+    QByteArray ba;
+    if (LibraryFile::isLibraryFile(path)) {
+        library->serializeIndexed(ba);
+    } else {
+        library->serialize(ba);
+    }
+    emit librarySave(path, ba, flags);
+}
+
+
+void Editor::actionLibrarySaved(const bool &status, const bool &cancelled) {
+    if (status) {
         emit displayStatusbar("Library saved to disk.");
+    } else if (cancelled) {
+        emit displayStatusbar("Saving the library was cancelled.");
     } else {
         emit displayStatusbar("Could not save library to disk.");
     }
 }
 
 
+void Editor::actionLibraryImported(const int &flags, const bool &cancelled, const QStringList &failed) {
+    Library *staged = fileWorker->takeLibrary();
+    if (cancelled || !staged) {
+        emit displayStatusbar("Importing libraries was cancelled.");
+        delete staged;
+        return;
+    }
+
+    const int &start = library->getNumberOfPrograms();
+    library->takePrograms(*staged, flags&Flag::APPEND);
+    delete staged;
+    if (failed.isEmpty()) {
+        emit displayStatusbar("Libraries imported.");
+    } else {
+        emit displayStatusbar(QString("Libraries imported, %1 files could not be imported completely, first: %2").arg(failed.size()).arg(failed.first()));
+    }
+    redrawLibraryItems(flags, (flags&Flag::APPEND) ? start : 0, library->getNumberOfPrograms() - 1);
+}
+
+
 void Editor::actionLibraryRemove(const unsigned int &start, const unsigned int &end) {
-#ifdef DEBUGMSGS
-    qDebug() << "Editor::actionLibraryDelete()" << start << end;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryDelete()" << start << end;
     library->remove(start, end);
     redrawLibraryItems(Flag::PATCH | Flag::SEQUENCE, start, library->getNumberOfPrograms() - 1);
 }
 
 
 void Editor::actionLibraryInsert(const unsigned int &id) {
-#ifdef DEBUGMSG
-    qDebug() << "Editor::actionLibraryInsert()" << id;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryInsert()" << id;
     library->insert(id);
     redrawLibraryItems(Flag::PATCH | Flag::SEQUENCE, id, library->getNumberOfPrograms() - 1);
 }
 
 
 void Editor::actionLibraryReset(const unsigned int &flags, const unsigned int &start, const unsigned int &end) {
-#ifdef DEBUGMSG
-    qDebug() << "Editor::actionLibraryReset()" << flags << start << end;
-#endif
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryReset()" << flags << start << end;
     library->reset(flags, start, end);
     redrawLibraryItems(Flag::PATCH | Flag::SEQUENCE, start, end);
 }
 
 
+void Editor::actionLibraryUpgrade(const unsigned int &start, const unsigned int &end) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryUpgrade()" << start << end;
+    const int &converted = library->upgradePatches(start, end);
+    redrawLibraryItems(Flag::PATCH, start, end);
+    emit displayStatusbar(QString("Converted %1 patch(es) to the 1.xx format.").arg(converted));
+}
+
+
+void Editor::actionLibraryGenerate(const unsigned int &start, const unsigned int &end) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionLibraryGenerate()" << start << end;
+    // Parameters kept by the profile come from the edited patch. Every run
+    // uses a new seed; the status bar shows it, so a run can be repeated
+    // with --random-seed:
+    const quint64 seed = generator->getSeed();
+    const int &generated = library->generatePatches(*generator, *patch, start, end);
+    generator->advanceSeed();
+    redrawLibraryItems(Flag::PATCH, start, end);
+    emit displayStatusbar(QString("Generated %1 random patch(es) (seed %2).").arg(generated).arg(seed));
+}
+
+
+void Editor::actionMorphStart(const int &from, const int &to) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionMorphStart()" << from << to;
+    const int &num = library->getNumberOfPrograms();
+    if (from < 0 || from >= num || to < 0 || to >= num) {
+        return;
+    }
+    const Patch &a = library->recallPatch(from);
+    const Patch &b = library->recallPatch(to);
+    morph->setFilterBoard(shruthiFilterBoard);
+    morph->start(a, b, *patch);
+    morphTimer->start();
+    emit morphStarted(a.getName(), b.getName());
+    emit displayStatusbar(QString("Morphing between patch %1 and %2.").arg(from + 1).arg(to + 1));
+}
+
+
+void Editor::actionMorphPosition(const int &position) {
+    if (!morph->isActive()) {
+        return;
+    }
+    morph->setPosition(position / 127.0);
+    if (!morphTimer->isActive()) {
+        morphTimer->start();
+    }
+}
+
+
+void Editor::actionMorphRamp(const int &position, const int &duration) {
+    if (!morph->isActive()) {
+        return;
+    }
+    morph->rampTo(position / 127.0, duration);
+    if (!morphTimer->isActive()) {
+        morphTimer->start();
+    }
+}
+
+
+void Editor::actionMorphStop() {
+    if (!morph->isActive()) {
+        return;
+    }
+    morph->stop();
+    morphTimer->stop();
+    emit morphStopped();
+    emit displayStatusbar("Stopped morphing.");
+}
+
+
+void Editor::morphFrame() {
+    const bool &ramping = morph->isRamping();
+    std::vector<int> ids;
+    if (morph->frame(ids)) {
+        // The messages of a frame are spread over the frame on the
+        // scheduled output:
+        const double &start = midiout->time();
+        const double &step = Morph::FRAME_INTERVAL / 1000.0 / ids.size();
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            const int &id = ids.at(i);
+            const int &value = morph->current().getValue(id);
+            patch->setValue(id, value);
+            mirrorPatchParameter(id, value);
+            if (Patch::hasUI(id)) {
+                emit redrawPatchParameter(id, value);
+            }
+            if (!sendPatchParameterAt(id, value, start + i * step)) {
+                emit displayStatusbar("Could not send changes as NRPN.");
+                actionMorphStop();
+                return;
+            }
+        }
+        static MetricsCounter *sent = Metrics::counter("morph.parameters");
+        sent->add(ids.size());
+    }
+
+    if (ramping) {
+        emit morphPositionChanged((int) (morph->position() * 127 + 0.5));
+    }
+    if (morph->isIdle()) {
+        morphTimer->stop();
+    }
+}
+
+
+void Editor::actionRecorderRecord() {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionRecorderRecord()";
+    recorderTimer->stop();
+    recorder->startRecording(Trace::now());
+    emit recorderStateChanged(true, false, "Recording...");
+    emit displayStatusbar("Recording parameter changes.");
+}
+
+
+void Editor::actionRecorderPlay(const bool &loop, const int &quantize, const int &thin) {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionRecorderPlay()" << loop << quantize << thin;
+    if (recorder->isRecording()) {
+        actionRecorderStop();
+    }
+    if (!recorder->startPlayback(loop, quantize, thin)) {
+        emit recorderStateChanged(false, false, "Nothing recorded.");
+        return;
+    }
+    playbackStart = midiout->time();
+    playbackScheduled = midiout->isScheduled();
+    recorderTimer->setInterval(playbackScheduled ? ParameterRecorder::PLAYBACK_INTERVAL : 1);
+    recorderTimer->start();
+    recorderPlayback();
+
+    const QString &status = QString("Playing %1 of %2 changes.").arg(recorder->playbackSize()).arg(recorder->size());
+    emit recorderStateChanged(false, true, status);
+    emit displayStatusbar(status);
+}
+
+
+void Editor::actionRecorderStop() {
+    LOG_DEBUG(LogCategory::EDITOR) << "Editor::actionRecorderStop()";
+    recorderTimer->stop();
+    recorder->stopPlayback();
+    if (recorder->isRecording()) {
+        recorder->stopRecording(Trace::now());
+    }
+    const QString &status = QString("%1 changes in %2 s.").arg(recorder->size()).arg(recorder->length() / 1000000.0, 0, 'f', 1);
+    emit recorderStateChanged(false, false, status);
+}
+
+
+void Editor::recordPatchParameter(const qint64 &time, const unsigned char &source, const int &id) {
+    // The queue item's creation time is when the change was made (or
+    // arrived from the Shruthi), not when it was processed:
+    if (recorder->isRecording() && Patch::enabled(id)) {
+        recorder->record(time, source, id, patch->getValue(id));
+    }
+}
+
+
+void Editor::recorderPlayback() {
+    const qint64 &until = recorder->playbackTime() + (playbackScheduled ? ParameterRecorder::LOOKAHEAD : 0);
+    ParameterRecorder::Event event;
+    qint64 time;
+    int count = 0;
+    while (recorder->next(until, event, time)) {
+        const int &id = event.id;
+        const int &value = event.value;
+        patch->setValue(id, value);
+        mirrorPatchParameter(id, value);
+        if (Patch::hasUI(id)) {
+            emit redrawPatchParameter(id, value);
+        }
+        if (!sendPatchParameterAt(id, value, playbackStart + time / 1000000.0)) {
+            emit displayStatusbar("Could not send changes.");
+            actionRecorderStop();
+            return;
+        }
+        count++;
+    }
+    if (count > 0) {
+        static MetricsCounter *played = Metrics::counter("recorder.played_events");
+        played->add(count);
+    }
+    if (!recorder->isPlaying()) {
+        actionRecorderStop();
+    }
+}
+
+
+bool Editor::sendPatchParameterAt(const int &id, int value, const double &time) {
+    // see actionPatchParameterChangeEditor():
+    if (firmwareVersion >= 1000 && id == 105 && value > 1) {
+        value += 1;
+    }
+    // Same time stamp for all units of a polychain:
+    const std::vector<unsigned char> &channels = voices->isEnabled() ? voices->channels() : std::vector<unsigned char>(1, channel);
+    const PatchParameter &param = Patch::parameter(id, shruthiFilterBoard);
+    const int &val = Patch::convertToCCValue(id, value, shruthiFilterBoard);
+    for (unsigned int i = 0; i < channels.size(); i++) {
+        if (Patch::sendAsNRPN(id)) {
+            if (!midiout->nrpnAt(channels.at(i), id, value, time)) {
+                return false;
+            }
+        } else if (param.cc < 0 || !midiout->controlChangeAt(channels.at(i), param.cc, val, time)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 void Editor::redrawAllPatchParameters() {
     for (int i = 0; i < 110; i++) {
         if (Patch::hasUI(i) || Patch::hasUI2(i)) {
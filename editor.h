@@ -21,12 +21,24 @@
 #define SHRUTHI_EDITOR_H
 
 
+#include <QByteArray>
 #include <QObject>
 #include "queueitem.h"
+#include "transferqueue.h"
+class Broadcast;
+class FileWorker;
 class Library;
+class LibraryJournal;
+class MetricsHistogram;
 class MidiOut;
+class Morph;
+class PatchGenerator;
+class ParameterRecorder;
 class Patch;
+class QThread;
+class QTimer;
 class Sequence;
+class VoiceAllocator;
 
 
 class Editor : public QObject {
@@ -36,6 +48,12 @@ class Editor : public QObject {
         Editor();
         ~Editor();
 
+        MidiOut *getMidiOut();
+        VoiceAllocator *getVoiceAllocator(); // configure before the thread starts
+        Broadcast *getBroadcast(); // configure before the thread starts
+        PatchGenerator *getPatchGenerator(); // configure before the thread starts
+        void openJournal(const QString &directory); // before the thread starts
+
     private:
         Editor(const Editor&); //forbid copying
         Editor &operator=(const Editor&); //forbid assignment
@@ -44,50 +62,116 @@ class Editor : public QObject {
         void actionFetchRequest(const int &what);
         void actionSendData(const int &what);
         void actionShruthiInfoRequest();
-        void actionPatchParameterChangeMidi(int id, int value);
+        void actionPatchParameterChangeMidi(int id, int value, const bool &mirror = true);
         void actionNoteOn(unsigned char note, unsigned char velocity);
         void actionNoteOff(unsigned char note);
         void actionNotePanic();
         void actionSysexReceived(unsigned int command, unsigned int argument, unsigned int size, unsigned char* message);
         void actionSetPatchname(QString name);
         void actionFileIOLoad(QString path, const int &what);
+        void actionFileIOLoaded(QString path, const int &what, const bool &status, unsigned int size, unsigned char *message);
         void actionFileIOSave(QString path, const int &what);
+        void actionFileIOSaved(QString path, const int &what, const bool &status);
         void actionResetPatch(unsigned int version);
         void actionRandomizePatch();
+        void actionUpgradePatch();
         void actionSequenceParameterChangeEditor(const unsigned &id, const int &value);
         void actionResetSequence();
 
         void actionLibraryFetch(const unsigned int &what, const int &start, const int &stop);
+        void libraryFetchReturnHandler(const bool &ret);
         void actionLibrarySend(const unsigned int &what, const int &start, const int &end);
         void actionLibrarySendReturnHandler(const bool &ret);
+        void librarySendContinue();
+        void actionLibraryCancelTransfer(const int &start, const int &end);
+        void queueTransfer(const int &type, const int &flags, const int &from, const int &to);
+        void startNextTransfer();
+        void finishTransfer(const bool &ok);
+        void abortTransfer();
         void actionLibraryRecall(const unsigned int &what, const unsigned int &id);
         void actionLibraryStore(const unsigned int &what, const unsigned int &id);
         void actionLibraryMove(const unsigned int &what, const unsigned int &start, const unsigned int &target);
         void actionLibraryLoad(const QString &path, const int &flags);
+        void actionLibraryLoaded(const int &flags, const bool &status, const bool &cancelled);
         void actionLibrarySave(const QString &path, const int &flags);
+        void actionLibrarySaved(const bool &status, const bool &cancelled);
+        void actionLibraryImported(const int &flags, const bool &cancelled, const QStringList &failed);
         void actionLibraryRemove(const unsigned int &start, const unsigned int &end);
         void actionLibraryInsert(const unsigned int &id);
         void actionLibraryReset(const unsigned int &flags, const unsigned int &start, const unsigned int &end);
+        void actionLibraryUpgrade(const unsigned int &start, const unsigned int &end);
+        void actionLibraryGenerate(const unsigned int &start, const unsigned int &end);
+
+        void actionMorphStart(const int &from, const int &to);
+        void actionMorphPosition(const int &position);
+        void actionMorphRamp(const int &position, const int &duration);
+        void actionMorphStop();
+
+        void actionRecorderRecord();
+        void actionRecorderPlay(const bool &loop, const int &quantize, const int &thin);
+        void actionRecorderStop();
+        void recordPatchParameter(const qint64 &time, const unsigned char &source, const int &id);
+
+        void mirrorPatchParameter(const int &id, const int &value);
+        bool sendPatchParameterAt(const int &id, int value, const double &time);
 
         void redrawAllPatchParameters();
         void redrawAllSequenceParameters();
         void redrawLibraryItems(int what, int start, int stop);
 
         MidiOut *midiout;
+        MidiOut *virtualOut;
+        VoiceAllocator *voices; // polychain, shared with the thru input
+        Broadcast *broadcast; // mirrors edits to more Shruthis
+        PatchGenerator *generator; // random patches
         Patch *patch;
         Sequence *sequence;
         Library *library;
+        LibraryJournal *journal;
         unsigned char channel;
         int shruthiFilterBoard;
         int firmwareVersion;
 
+        // Fetch and send jobs run one after the other:
+        TransferQueue *transfers;
+        TransferQueue::Job transfer; // the running job
+        bool transferRunning;
+        bool recallProgram; // recall the current program when the queue is done
+
+        // Handles fetch and read-back requests without a reply:
+        QTimer *transferWatchdog;
+        QTimer *sendTimer;
+
+        // Morphing between two library patches, one frame per timeout:
+        Morph *morph;
+        QTimer *morphTimer;
+
+        // Parameter automation, played back one slice per timeout:
+        ParameterRecorder *recorder;
+        QTimer *recorderTimer;
+        double playbackStart; // MidiOut::time() at the start of the playback
+        bool playbackScheduled;
+
+        // File and library I/O runs on its own thread:
+        FileWorker *fileWorker;
+        QThread *fileThread;
+
+        // Time spent in process() per QueueAction:
+        MetricsHistogram *processTime[QueueAction::COUNT];
+        MetricsHistogram *itemWait; // creation to processing of queue items
+
     public slots:
         void process(QueueItem item);
+        void setMidiBackend(int backend);
         bool setMidiOutputPort(int out);
+        void setMidiVirtualPorts(bool enabled);
         void setMidiChannel(unsigned char channel);
         void setShruthiFilterBoard(int filter);
         void run();
         void librarySendNext();
+        void libraryTransferWatchdog();
+        void morphFrame();
+        void recorderPlayback();
 
     signals:
         void redrawPatchParameter(int,int);
@@ -101,6 +185,17 @@ class Editor : public QObject {
         void redrawLibraryPatchItem(int,QString,bool,bool,bool);
         void redrawLibrarySequenceItem(int,QString,bool,bool,bool);
         void setNumberOfLibraryPrograms(int);
+        void enqueue(QueueItem); // results of the file worker
+        void fileProgress(int); // percent, -1 when idle
+        void fileLoad(QString,int);
+        void fileSave(QString,QByteArray,int);
+        void libraryLoad(QString,int,int);
+        void librarySave(QString,QByteArray,int);
+        void libraryImport(QStringList,int,int);
+        void morphStarted(QString,QString); // names of both patches
+        void morphPositionChanged(int); // 0-127, while ramping
+        void morphStopped();
+        void recorderStateChanged(bool,bool,QString); // recording, playing, status
 };
 
 
@@ -18,33 +18,29 @@
 
 
 #include "fileio.h"
-#include <QDebug>
 #include <QFile>
+#include "log.h"
 
 
-bool FileIO::loadFromDisk(const QString &location, Message &data) {
-#ifdef DEBUGMSGS
-    qDebug() << "Patch::loadFromDisk(" << location << ")";
-#endif
+bool FileIO::loadFromDisk(const QString &location, Message &data, const int &maxSize) {
+    LOG_DEBUG(LogCategory::FILEIO) << "Patch::loadFromDisk(" << location << ")";
     QFile file(location);
 
     if (!file.exists()) {
-        qDebug() << "The file does not exist.";
+        LOG_DEBUG(LogCategory::FILEIO) << "The file does not exist.";
         return false;
     }
 
     if (!file.open(QIODevice::ReadOnly)) {
-        qDebug() << "Failed to open.";
+        LOG_DEBUG(LogCategory::FILEIO) << "Failed to open.";
         return false;
     }
 
-    QByteArray tmp = file.read(MAX_READ_SIZE);
+    QByteArray tmp = file.read(maxSize);
 
     file.close();
 
-#ifdef DEBUGMSGS
-    qDebug() << "Read" << tmp.length() << "bytes.";
-#endif
+    LOG_DEBUG(LogCategory::FILEIO) << "Read" << tmp.length() << "bytes.";
 
     appendToCharVector(tmp, data);
     return true;
@@ -75,13 +71,11 @@ void FileIO::appendToByteArray(const unsigned char *data, const unsigned int &am
 
 
 bool FileIO::saveToDisk(const QString &location, const QByteArray &data) {
-#ifdef DEBUGMSGS
-    qDebug() << "FileIO::saveToDisk(" << location << ")";
-#endif
+    LOG_DEBUG(LogCategory::FILEIO) << "FileIO::saveToDisk(" << location << ")";
     QFile file(location);
 
     if (!file.open(QIODevice::WriteOnly)) {
-        qDebug() << "Could not open file for saving.";
+        LOG_DEBUG(LogCategory::FILEIO) << "Could not open file for saving.";
         return false;
     }
 
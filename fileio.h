@@ -21,15 +21,26 @@
 #define SHRUTHI_FILEIO_H
 
 
+#include <QtGlobal>
 #include "message.h"
 class QByteArray;
 class QString;
 
 
+// Gets the progress of long running file operations, which are cancelled if
+// progress() returns false.
+class ProgressObserver {
+    public:
+        virtual ~ProgressObserver() {}
+        virtual bool progress(const qint64 &done, const qint64 &total) = 0;
+};
+
+
 class FileIO {
     public:
         static const int MAX_READ_SIZE = 1048576; // 1MB
-        static bool loadFromDisk(const QString &location, Message &data);
+        static const int MAX_LIBRARY_SIZE = 67108864; // 64MB, read in the background
+        static bool loadFromDisk(const QString &location, Message &data, const int &maxSize = MAX_READ_SIZE);
         static void appendToCharVector(const QByteArray &byteArray, Message &data);
         static void appendToByteArray(const Message &data, QByteArray &byteArray);
         static void appendToByteArray(const unsigned char *data, const unsigned int &amount, QByteArray &byteArray);
@@ -0,0 +1,393 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "fileworker.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QList>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtConcurrentMap>
+#include <algorithm> // for sort
+#include <stddef.h> // for NULL
+#include <stdio.h> // for rename
+#include "flag.h"
+#include "library.h"
+#include "libraryfile.h"
+#include "log.h"
+
+
+// Result of parsing one file of an import:
+struct ImportResult {
+    ImportResult():
+        library(NULL),
+        complete(false) {
+    }
+
+    Library *library; // NULL if nothing could be read
+    bool complete; // false if an entry could not be decoded
+};
+
+
+// Counts the parsed files of an import, so the worker can wait for them:
+struct ImportProgress {
+    ImportProgress():
+        done(0) {
+    }
+
+    QMutex mutex;
+    QWaitCondition changed;
+    int done;
+};
+
+
+// Parses one file of an import; called on the global thread pool.
+struct ImportParser {
+    typedef ImportResult result_type;
+
+    ImportParser(const int &firmwareVersion, QAtomicInt *cancelled, ImportProgress *progress, QThread *target):
+        firmwareVersion(firmwareVersion),
+        cancelled(cancelled),
+        progress(progress),
+        target(target) {
+    }
+
+    ImportResult operator()(const QString &path) const {
+        ImportResult result;
+        if (!cancelled->fetchAndAddRelaxed(0)) {
+            result = parse(path);
+        }
+        QMutexLocker locker(&progress->mutex);
+        progress->done++;
+        progress->changed.wakeAll();
+        return result;
+    }
+
+    ImportResult parse(const QString &path) const {
+        ImportResult result;
+        Library *library = new Library(NULL);
+        if (firmwareVersion > 0) {
+            library->setFirmwareVersion(firmwareVersion);
+            library->setFirmwareVersionRequested();
+        }
+        Message data;
+        if (LibraryFile::isLibraryFile(path)) {
+            result.complete = library->openIndexed(path);
+        } else if (FileIO::loadFromDisk(path, data, FileIO::MAX_LIBRARY_SIZE) && !data.empty()) {
+            result.complete = library->parseLibrary(data, false);
+        }
+        // Like loadLibrary(), keep the programs in front of an undecodable
+        // entry:
+        if (!result.complete && library->getNumberOfLoadedPatches() == 0 && library->getNumberOfLoadedSequences() == 0) {
+            delete library;
+            return result;
+        }
+        library->moveToThread(target);
+        result.library = library;
+        return result;
+    }
+
+    int firmwareVersion;
+    QAtomicInt *cancelled;
+    ImportProgress *progress;
+    QThread *target;
+};
+
+
+FileWorker::FileWorker(QObject *owner):
+    owner(owner),
+    cancelled(0),
+    lastPercent(-1),
+    phaseFrom(0),
+    phaseTo(100) {
+}
+
+
+FileWorker::~FileWorker() {
+    QMutexLocker locker(&mutex);
+    while (!staged.empty()) {
+        delete staged.front();
+        staged.pop_front();
+    }
+}
+
+
+void FileWorker::cancel() {
+    cancelled.fetchAndStoreRelaxed(1);
+}
+
+
+void FileWorker::stage(Library *library) {
+    // The owner (editor) takes and deletes the library on its thread:
+    library->moveToThread(owner->thread());
+    QMutexLocker locker(&mutex);
+    staged.push_back(library);
+}
+
+
+Library *FileWorker::takeLibrary() {
+    QMutexLocker locker(&mutex);
+    if (staged.empty()) {
+        return NULL;
+    }
+    Library *library = staged.front();
+    staged.pop_front();
+    return library;
+}
+
+
+void FileWorker::startJob(const QString &status) {
+    // A cancel() before the job started doesn't count.
+    cancelled.fetchAndStoreRelaxed(0);
+    lastPercent = -1;
+    throttle.start();
+    setPhase(0, 100);
+    emit displayStatusbar(status);
+    emit progressChanged(0);
+}
+
+
+void FileWorker::finishJob(QueueItem &item, const bool &status) {
+    item.int1 = status;
+    item.int2 = cancelled.fetchAndAddRelaxed(0) != 0;
+    emit progressChanged(-1);
+    emit enqueue(item);
+}
+
+
+void FileWorker::setPhase(const int &from, const int &to) {
+    phaseFrom = from;
+    phaseTo = to;
+}
+
+
+bool FileWorker::progress(const qint64 &done, const qint64 &total) {
+    if (cancelled.fetchAndAddRelaxed(0)) {
+        return false;
+    }
+    const int &percent = phaseFrom + (total > 0 ? (phaseTo - phaseFrom) * done / total : 0);
+    // At most ten updates per second:
+    if (percent != lastPercent && throttle.elapsed() >= 100) {
+        lastPercent = percent;
+        throttle.restart();
+        emit progressChanged(percent);
+    }
+    return true;
+}
+
+
+bool FileWorker::read(const QString &path, Message &data, const int &maxSize) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        LOG_DEBUG(LogCategory::FILEIO) << "FileWorker::read(): could not open" << path;
+        return false;
+    }
+    const qint64 &size = qMin(file.size(), (qint64) maxSize);
+    data.clear();
+    data.reserve(size);
+
+    static const int CHUNK_SIZE = 262144;
+    while ((qint64) data.size() < size) {
+        const QByteArray &chunk = file.read(qMin((qint64) CHUNK_SIZE, size - (qint64) data.size()));
+        if (chunk.isEmpty()) {
+            break;
+        }
+        FileIO::appendToCharVector(chunk, data);
+        if (!progress(data.size(), size)) {
+            file.close();
+            return false;
+        }
+    }
+    file.close();
+    LOG_DEBUG(LogCategory::FILEIO) << "FileWorker::read(): read" << data.size() << "bytes from" << path;
+    return true;
+}
+
+
+bool FileWorker::write(const QString &path, const QByteArray &data) {
+    // Write to a temporary file first, so a cancelled or failed save doesn't
+    // destroy the old file.
+    const QString &temporary = path + ".part";
+    QFile file(temporary);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_DEBUG(LogCategory::FILEIO) << "FileWorker::write(): could not open" << temporary;
+        return false;
+    }
+
+    static const int CHUNK_SIZE = 262144;
+    bool status = true;
+    for (int pos = 0; status && pos < data.size(); pos += CHUNK_SIZE) {
+        const int &length = qMin(CHUNK_SIZE, data.size() - pos);
+        status = file.write(data.constData() + pos, length) == length && progress(pos + length, data.size());
+    }
+    file.close();
+
+    // rename() replaces the old file atomically on POSIX systems, so there
+    // is no moment without it. Where it can't replace files, the old file is
+    // removed first.
+    if (status && rename(QFile::encodeName(temporary).constData(), QFile::encodeName(path).constData()) != 0) {
+        QFile::remove(path);
+        status = QFile::rename(temporary, path);
+    }
+    if (!status) {
+        QFile::remove(temporary);
+    }
+    return status;
+}
+
+
+void FileWorker::loadFile(QString path, int flags) {
+    startJob("Loading " + path + "...");
+    QueueItem item(QueueAction::FILEIO_LOADED, path, flags);
+    Message data;
+    const bool &status = read(path, data, FileIO::MAX_READ_SIZE);
+    if (status && !data.empty()) {
+        item.message = new unsigned char[data.size()];
+        std::copy(data.begin(), data.end(), item.message);
+        item.size = data.size();
+    }
+    finishJob(item, status);
+}
+
+
+void FileWorker::saveFile(QString path, QByteArray data, int flags) {
+    startJob("Saving " + path + "...");
+    QueueItem item(QueueAction::FILEIO_SAVED, path, flags);
+    finishJob(item, write(path, data));
+}
+
+
+void FileWorker::loadLibrary(QString path, int flags, int firmwareVersion) {
+    startJob("Loading library " + path + "...");
+    QueueItem item(QueueAction::LIBRARY_LOADED, path, flags);
+
+    Library *library = new Library(NULL);
+    if (firmwareVersion > 0) {
+        library->setFirmwareVersion(firmwareVersion);
+        library->setFirmwareVersionRequested();
+    }
+
+    bool status = false;
+    if (LibraryFile::isLibraryFile(path)) {
+        // Native libraries are mapped, the programs are decoded when used:
+        status = library->openIndexed(path);
+    } else {
+        // Reading is fast compared to parsing:
+        Message data;
+        setPhase(0, 20);
+        if (read(path, data, FileIO::MAX_LIBRARY_SIZE)) {
+            setPhase(20, 100);
+            status = library->parseLibrary(data, false, this);
+        }
+    }
+
+    if (cancelled.fetchAndAddRelaxed(0)) {
+        delete library;
+    } else {
+        stage(library);
+    }
+    finishJob(item, status);
+}
+
+
+void FileWorker::saveLibrary(QString path, QByteArray data, int flags) {
+    startJob("Saving library " + path + "...");
+    QueueItem item(QueueAction::LIBRARY_SAVED, path, flags);
+    finishJob(item, write(path, data));
+}
+
+
+void FileWorker::importLibraries(QStringList paths, int flags, int firmwareVersion) {
+    startJob("Importing libraries...");
+
+    // Expand directories; sorting makes the order of the import independent
+    // of the file system and of the selection:
+    QStringList files;
+    for (int i = 0; i < paths.size(); i++) {
+        if (QFileInfo(paths.at(i)).isDir()) {
+            QDirIterator it(paths.at(i), QStringList() << "*.syx" << "*.slb", QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                files << it.next();
+            }
+        } else {
+            files << paths.at(i);
+        }
+    }
+    files.removeDuplicates();
+    std::sort(files.begin(), files.end());
+    LOG_INFO(LogCategory::FILEIO) << "FileWorker::importLibraries():" << files.size() << "files";
+
+    // Parse the files in parallel. The worker waits for the pool, so jobs
+    // still run one after the other.
+    ImportProgress parsed;
+    QFuture<ImportResult> future = QtConcurrent::mapped(files, ImportParser(firmwareVersion, &cancelled, &parsed, thread()));
+    parsed.mutex.lock();
+    while (parsed.done < files.size()) {
+        parsed.changed.wait(&parsed.mutex);
+        const int done = parsed.done;
+        parsed.mutex.unlock();
+        progress(done, files.size());
+        parsed.mutex.lock();
+    }
+    parsed.mutex.unlock();
+    future.waitForFinished(); // the results are stored after the last count
+
+    // Merge in file order; the failures are reported per file, with the
+    // number of programs kept in front of an undecodable entry:
+    const bool &wasCancelled = cancelled.fetchAndAddRelaxed(0) != 0;
+    const QList<ImportResult> &results = future.results();
+    Library *library = new Library(NULL);
+    if (firmwareVersion > 0) {
+        library->setFirmwareVersion(firmwareVersion);
+        library->setFirmwareVersionRequested();
+    }
+    QStringList failed;
+    int imported = 0;
+    for (int i = 0; i < results.size(); i++) {
+        const ImportResult &result = results.at(i);
+        if (!result.library) {
+            failed << files.at(i);
+            continue;
+        }
+        if (!result.complete) {
+            failed << QString("%1 (kept %2 patches, %3 sequences)").arg(files.at(i))
+                      .arg(result.library->getNumberOfLoadedPatches())
+                      .arg(result.library->getNumberOfLoadedSequences());
+        }
+        library->appendLoadedPrograms(*result.library);
+        delete result.library;
+        imported++;
+    }
+
+    if (wasCancelled) {
+        delete library;
+    } else {
+        for (int i = 0; i < failed.size(); i++) {
+            LOG_WARNING(LogCategory::FILEIO) << "Could not import" << failed.at(i);
+        }
+        stage(library);
+    }
+
+    QueueItem item(QueueAction::LIBRARY_IMPORTED, failed, flags);
+    finishJob(item, imported > 0);
+}
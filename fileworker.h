@@ -0,0 +1,98 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_FILEWORKER_H
+#define SHRUTHI_FILEWORKER_H
+
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <deque>
+#include "fileio.h"
+#include "queueitem.h"
+class Library;
+
+
+// Loads and saves files on its own thread, so the editor keeps processing
+// MIDI while a big library is read. Results are returned as queue items
+// (FILEIO_LOADED, FILEIO_SAVED, LIBRARY_LOADED, LIBRARY_SAVED,
+// LIBRARY_IMPORTED), so they are
+// applied in order with everything else:
+//  * FILEIO_LOADED carries the file contents in message/size.
+//  * LIBRARY_LOADED: the library is parsed into a staging Library, which the
+//    editor takes with takeLibrary() and swaps in.
+//  * LIBRARY_IMPORTED: all files of the import are merged into one staging
+//    library; strings lists the files that could not be imported.
+// int0 holds the flags of the request, int1 is 1 on success and int2 is 1 if
+// the operation was cancelled.
+//
+// Jobs run one after the other. cancel() stops the running job.
+class FileWorker : public QObject, private ProgressObserver {
+        Q_OBJECT
+
+    public:
+        FileWorker(QObject *owner); // the object taking the staged libraries
+        ~FileWorker();
+
+        void cancel(); // thread safe
+        Library *takeLibrary(); // the caller owns the library
+
+    private:
+        FileWorker(const FileWorker&); //forbid copying
+        FileWorker &operator=(const FileWorker&); //forbid assignment
+
+        void startJob(const QString &status);
+        void finishJob(QueueItem &item, const bool &status);
+        bool progress(const qint64 &done, const qint64 &total);
+        void setPhase(const int &from, const int &to);
+        void stage(Library *library);
+        bool read(const QString &path, Message &data, const int &maxSize);
+        bool write(const QString &path, const QByteArray &data);
+
+        QObject *owner;
+        QAtomicInt cancelled;
+        QElapsedTimer throttle;
+        int lastPercent;
+        int phaseFrom;
+        int phaseTo;
+
+        QMutex mutex;
+        std::deque<Library*> staged;
+
+    public slots:
+        void loadFile(QString path, int flags);
+        void saveFile(QString path, QByteArray data, int flags);
+        void loadLibrary(QString path, int flags, int firmwareVersion);
+        void saveLibrary(QString path, QByteArray data, int flags);
+        void importLibraries(QStringList paths, int flags, int firmwareVersion);
+
+    signals:
+        void enqueue(QueueItem);
+        void progressChanged(int); // percent, -1 when done
+        void displayStatusbar(QString);
+};
+
+
+#endif // SHRUTHI_FILEWORKER_H
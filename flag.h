@@ -27,6 +27,7 @@ class Flag {
         static const int SEQUENCE = 2;
         static const int CHANGED = 4;
         static const int APPEND = 8;
+        static const int VERIFY = 16; // read back sent programs
 };
 
 
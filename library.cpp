@@ -18,29 +18,48 @@
 
 
 #include "library.h"
+#include <QStringList>
 #include <QTime>
 #include <algorithm> // for max
 #include <iostream>
 #include <stddef.h> // for NULL
+#include <string.h> // for memcmp
 #include <stdint.h> // for uint32_t (needed for hash calculation)
 #include "fileio.h"
 #include "flag.h"
+#include "libraryfile.h"
+#include "libraryjournal.h"
+#include "log.h"
+#include "metrics.h"
 #include "message.h"
 #include "midi.h"
 #include "midiout.h"
+#include "patchgenerator.h"
+
+
+const int Library::FETCH_TIMEOUT;
+const unsigned int Library::FETCH_RETRIES;
 
 
 Library::Library(MidiOut *out):
+    mSource(NULL),
     midiout(out),
+    mJournal(NULL),
     time(new QTime),
     numberOfPrograms(0),
     numberOfHWPrograms(16),
+    mLoadedPatches(0),
+    mLoadedSequences(0),
     firmwareVersion(0),
     firmwareVersionRequested(false) {
     abortFetching();
     fetchNextRequest = 0;
     fetchNextIncomingPatch = 0;
     fetchNextIncomingSequence = 0;
+    fetchRetries = 0;
+    fetchDeadline = 0;
+    mVerify = false;
+    mVerified = 0;
     abortSending();
     mSendIndex = 0;
     mSendRedrawFlags = 0;
@@ -56,6 +75,8 @@ Library::Library(MidiOut *out):
 Library::~Library() {
     delete time;
     time = NULL;
+    delete mSource;
+    mSource = NULL;
 }
 
 
@@ -73,16 +94,26 @@ void Library::setMidiChannel(const unsigned char &channel) {
 }
 
 
+void Library::setJournal(LibraryJournal *journal) {
+    mJournal = journal;
+}
+
+
 const Patch &Library::recallPatch(const int &id) const {
+    decodePatch(id);
     return patches.at(id);
 }
 
 
 void Library::storePatch(const int &id, const Patch &patch) {
+    decodePatch(id);
     if (!patches.at(id).equals(patch)) {
         patches.at(id).set(patch);
         mPatchEdited.at(id) = true;
         mPatchMoved.at(id) = false;
+        if (mJournal) {
+            mJournal->patch(id, patch, true, false);
+        }
     }
 }
 
@@ -92,6 +123,7 @@ void Library::listPatches() const {
 
     const unsigned int &num = patches.size();
     for (unsigned int i = 0; i < num; i++) {
+        decodePatch(i);
         std::cout << "  " << i << ": "
                   << patches.at(i).getName().toUtf8().constData()
                   << ", changed " << mPatchEdited.at(i)
@@ -113,6 +145,10 @@ void Library::movePatch(const int &from, const int &to) {
     mPatchEdited.erase(mPatchEdited.begin() + from);
     mPatchEdited.insert(mPatchEdited.begin() + to, temp2);
 
+    int temp3 = mPatchSlot.at(from);
+    mPatchSlot.erase(mPatchSlot.begin() + from);
+    mPatchSlot.insert(mPatchSlot.begin() + to, temp3);
+
     // Mark as moved:
     int start = from;
     int end = to;
@@ -123,6 +159,10 @@ void Library::movePatch(const int &from, const int &to) {
     for (int i = start; i <= end; i++) {
         mPatchMoved.at(i) = true;
     }
+
+    if (mJournal) {
+        mJournal->movePatch(from, to);
+    }
 }
 
 
@@ -137,21 +177,29 @@ bool Library::patchEdited(const int &id) const {
 
 
 QString Library::getPatchIdentifier(const int &id) const {
+    if (mPatchSlot.at(id) >= 0) {
+        return mSource->patchName(mPatchSlot.at(id)).leftJustified(9, ' ');
+    }
     const Patch &p = patches.at(id);
     return p.getName().leftJustified(9, ' ');// + "(" + p.getVersionString() + ")";
 }
 
 
 const Sequence &Library::recallSequence(const int &id) const {
+    decodeSequence(id);
     return sequences.at(id);
 }
 
 
 void Library::storeSequence(const int &id, const Sequence &sequence) {
+    decodeSequence(id);
     if (!sequences.at(id).equals(sequence)) {
         sequences.at(id).set(sequence);
         mSequenceEdited.at(id) = true;
         mSequenceMoved.at(id) = false;
+        if (mJournal) {
+            mJournal->sequence(id, sequence, true, false);
+        }
     }
 }
 
@@ -182,6 +230,10 @@ void Library::moveSequence(const int &from, const int &to) {
     mSequenceEdited.erase(mSequenceEdited.begin() + from);
     mSequenceEdited.insert(mSequenceEdited.begin() + to, temp2);
 
+    int temp3 = mSequenceSlot.at(from);
+    mSequenceSlot.erase(mSequenceSlot.begin() + from);
+    mSequenceSlot.insert(mSequenceSlot.begin() + to, temp3);
+
     // Mark as moved:
     int start = from;
     int end = to;
@@ -192,6 +244,10 @@ void Library::moveSequence(const int &from, const int &to) {
     for (int i = start; i <= end; i++) {
         mSequenceMoved.at(i) = true;
     }
+
+    if (mJournal) {
+        mJournal->moveSequence(from, to);
+    }
 }
 
 
@@ -206,6 +262,12 @@ bool Library::sequenceEdited(const int &id) const {
 
 
 bool Library::sequenceIsInit(const int &id) const {
+    if (mSequenceSlot.at(id) >= 0) {
+        // Packing is lossless, the packed data can be compared:
+        unsigned char init[32];
+        init_sequence.packData(init);
+        return memcmp(mSource->sequenceData(mSequenceSlot.at(id)), init, 32) == 0;
+    }
     return sequences.at(id).equals(init_sequence);
 }
 
@@ -229,6 +291,12 @@ bool Library::startSending(const int &flags, const int &from, const int &to) {
     mSendSequenceMode = flags&Flag::SEQUENCE;
     mForceSending = !(flags&Flag::CHANGED);
 
+    mVerify = flags&Flag::VERIFY;
+    mVerifyOutstanding.clear();
+    mResend.clear();
+    mVerifyFailures.clear();
+    mVerified = 0;
+
     time->start();
 
     return keepSending();
@@ -236,6 +304,13 @@ bool Library::startSending(const int &flags, const int &from, const int &to) {
 
 
 void Library::abortSending() {
+    stopSending();
+    mVerifyOutstanding.clear();
+    mResend.clear();
+}
+
+
+void Library::stopSending() {
     mSendPatchMode = false;
     mSendSequenceMode = false;
     mSendStart = 0;
@@ -259,12 +334,41 @@ QString Library::sendProgress() const {
 }
 
 
+static const char *programTypes(const bool &patches, const bool &sequences) {
+    if (patches && sequences) {
+        return "patches and sequences";
+    }
+    return patches ? "patches" : "sequences";
+}
+
+
 bool Library::keepSending() {
     const QString progress_str = sendProgress();
     bool ret = true;
 
     mSendRedrawIndex = -1;
 
+    // Programs that failed the verification go first:
+    if (!mResend.empty()) {
+        const VerifyRequest request = mResend.front();
+        mResend.pop_front();
+        if (request.flags & Flag::PATCH) {
+            emit displayStatusbar(QString("Sending patch %1 again.").arg(request.id + 1));
+            ret = writePatch(request.id);
+            mSendTimeout = 250;
+        } else {
+            emit displayStatusbar(QString("Sending sequence %1 again.").arg(request.id + 1));
+            ret = writeSequence(request.id);
+            mSendTimeout = 125;
+        }
+        if (ret) {
+            ret = requestVerification(request.id, request.flags, request.attempts);
+        }
+        mSendRedrawIndex = request.id;
+        mSendRedrawFlags = request.flags;
+        return ret;
+    }
+
     const bool &sendPatch = mSendPatchMode && (mForceSending || patchEdited(mSendIndex) || patchMoved(mSendIndex));
     const bool &sendSequence = mSendSequenceMode && (mForceSending || sequenceEdited(mSendIndex) || sequenceMoved(mSendIndex));
 
@@ -273,19 +377,10 @@ bool Library::keepSending() {
 
     if (first && sendPatch) {
         emit displayStatusbar(progress_str + QString("Sending patch %1.").arg(mSendIndex + 1));
-#ifdef DEBUGMSGS
-        std::cout << sendIndex << " patch " << std::endl;
-#endif
-        Message temp;
-        temp.clear();
-        patches.at(mSendIndex).generateSysex(&temp);
-        ret = midiout->write(temp);
-        if (ret) {
-            ret = midiout->patchWriteRequest(mSendIndex);
-        }
-        if (ret) {
-            mPatchEdited.at(mSendIndex) = false;
-            mPatchMoved.at(mSendIndex) = false;
+        LOG_DEBUG(LogCategory::LIBRARY) << mSendIndex << "patch";
+        ret = writePatch(mSendIndex);
+        if (ret && mVerify) {
+            ret = requestVerification(mSendIndex, Flag::PATCH, 0);
         }
         // Don't flood the Shruthi
         mSendTimeout = 250;
@@ -296,19 +391,10 @@ bool Library::keepSending() {
 
     if (!first && sendSequence) {
         emit displayStatusbar(progress_str + QString("Sending sequence %1.").arg(mSendIndex + 1));
-#ifdef DEBUGMSGS
-        std::cout << sendIndex << " sequence " << std::endl;
-#endif
-        Message temp;
-        temp.clear();
-        sequences.at(mSendIndex).generateSysex(&temp);
-        ret = midiout->write(temp);
-        if (ret) {
-            ret = midiout->sequenceWriteRequest(mSendIndex);
-        }
-        if (ret) {
-            mSequenceEdited.at(mSendIndex) = false;
-            mSequenceMoved.at(mSendIndex) = false;
+        LOG_DEBUG(LogCategory::LIBRARY) << mSendIndex << "sequence";
+        ret = writeSequence(mSendIndex);
+        if (ret && mVerify) {
+            ret = requestVerification(mSendIndex, Flag::SEQUENCE, 0);
         }
         // Don't flood the Shruthi
         mSendTimeout = 125;
@@ -332,20 +418,13 @@ bool Library::keepSending() {
 
         if (mSendIndex > mSendEnd) {
             // Finished sending. Display statistics:
-            std::cout << "Finished sending ";
+            LOG_INFO(LogCategory::LIBRARY) << "Finished sending" << programTypes(mSendPatchMode, mSendSequenceMode)
+                                           << ". It took" << time->elapsed() << "ms to send" << mSendEnd - mSendStart + 1 << "program(s).";
+            static MetricsHistogram *sendTime = Metrics::histogram("library.send.program_time");
+            sendTime->record(1000LL * time->elapsed() / (mSendEnd - mSendStart + 1));
 
-            if (mSendPatchMode) {
-                std::cout << "patches";
-                if (mSendSequenceMode) {
-                    std::cout << " and ";
-                }
-            }
-            if (mSendSequenceMode) {
-                std::cout << "sequences";
-            }
-            std::cout << ". It took " << time->elapsed() << " ms to send " << mSendEnd - mSendStart + 1 << " program(s)." << std::endl;
-
-            abortSending();
+            // Keeps the verification running:
+            stopSending();
             return true;
         }
     }
@@ -359,7 +438,207 @@ bool Library::keepSending() {
 
 
 bool Library::isSending() {
-    return (mSendPatchMode || mSendSequenceMode) && mSendIndex <= mSendEnd;
+    return ((mSendPatchMode || mSendSequenceMode) && mSendIndex <= mSendEnd) || !mResend.empty();
+}
+
+
+bool Library::writePatch(const int &id) {
+    Message temp;
+    decodePatch(id);
+    patches.at(id).generateSysex(&temp);
+    bool ret = midiout->write(temp);
+    if (ret) {
+        ret = midiout->patchWriteRequest(id);
+    }
+    if (ret) {
+        mPatchEdited.at(id) = false;
+        mPatchMoved.at(id) = false;
+        if (mJournal) {
+            mJournal->patchFlags(id, false, false);
+        }
+        static MetricsCounter *sentPatches = Metrics::counter("library.send.patches");
+        sentPatches->add();
+    }
+    return ret;
+}
+
+
+bool Library::writeSequence(const int &id) {
+    Message temp;
+    decodeSequence(id);
+    sequences.at(id).generateSysex(&temp);
+    bool ret = midiout->write(temp);
+    if (ret) {
+        ret = midiout->sequenceWriteRequest(id);
+    }
+    if (ret) {
+        mSequenceEdited.at(id) = false;
+        mSequenceMoved.at(id) = false;
+        if (mJournal) {
+            mJournal->sequenceFlags(id, false, false);
+        }
+        static MetricsCounter *sentSequences = Metrics::counter("library.send.sequences");
+        sentSequences->add();
+    }
+    return ret;
+}
+
+
+bool Library::requestVerification(const int &id, const int &flags, const unsigned int &attempts) {
+    // The request is queued behind the write request, so the Shruthi
+    // answers after it stored the program. Sending continues meanwhile.
+    bool ret = true;
+    const bool &oldShruthi = firmwareVersionRequested && firmwareVersion < 1000;
+    if ((flags & Flag::PATCH) || !oldShruthi) {
+        ret = midiout->programChange(mMidiChannel, id);
+    } else {
+        ret = midiout->programChangeSequence(mMidiChannel, id);
+    }
+    if (ret) {
+        ret = (flags & Flag::PATCH) ? midiout->patchTransferRequest() : midiout->sequenceTransferRequest();
+    }
+    if (ret) {
+        VerifyRequest request;
+        request.id = id;
+        request.flags = flags;
+        request.deadline = time->elapsed() + FETCH_TIMEOUT;
+        request.attempts = attempts;
+        mVerifyOutstanding.push_back(request);
+    }
+    return ret;
+}
+
+
+bool Library::isVerifying() const {
+    return !mVerifyOutstanding.empty();
+}
+
+
+bool Library::verifiedPatch(const unsigned char *sysex) {
+    if (!isVerifying()) {
+        return false;
+    }
+    const VerifyRequest request = mVerifyOutstanding.front();
+    mVerifyOutstanding.pop_front();
+
+    // A sequence was expected if a reply got lost or came out of order:
+    if (!(request.flags & Flag::PATCH)) {
+        LOG_WARNING(LogCategory::LIBRARY) << "Library::verifiedPatch(): expected sequence" << request.id << ", got a patch.";
+        return verifyResult(request, false);
+    }
+
+    // Compare both in the packed format, the one the Shruthi stores:
+    Patch received;
+    bool match = sysex && received.unpackData(sysex);
+    if (match && request.id < numberOfPrograms) {
+        unsigned char expected[92];
+        unsigned char actual[92];
+        decodePatch(request.id);
+        patches.at(request.id).packData(expected);
+        received.packData(actual);
+        match = memcmp(expected, actual, 92) == 0;
+    }
+    return verifyResult(request, match);
+}
+
+
+bool Library::verifiedSequence(const unsigned char *seq) {
+    if (!isVerifying()) {
+        return false;
+    }
+    const VerifyRequest request = mVerifyOutstanding.front();
+    mVerifyOutstanding.pop_front();
+
+    if (!(request.flags & Flag::SEQUENCE)) {
+        LOG_WARNING(LogCategory::LIBRARY) << "Library::verifiedSequence(): expected patch" << request.id << ", got a sequence.";
+        return verifyResult(request, false);
+    }
+
+    Sequence received;
+    bool match = seq != NULL;
+    if (match && request.id < numberOfPrograms) {
+        received.unpackData(seq);
+        unsigned char expected[32];
+        unsigned char actual[32];
+        decodeSequence(request.id);
+        sequences.at(request.id).packData(expected);
+        received.packData(actual);
+        match = memcmp(expected, actual, 32) == 0;
+    }
+    return verifyResult(request, match);
+}
+
+
+bool Library::checkVerifying() {
+    if (mVerifyOutstanding.empty() || time->elapsed() < mVerifyOutstanding.front().deadline) {
+        return true;
+    }
+    // Lost reply, the next one belongs to the next request:
+    const VerifyRequest request = mVerifyOutstanding.front();
+    mVerifyOutstanding.pop_front();
+    LOG_WARNING(LogCategory::LIBRARY) << "Library::checkVerifying(): no reply for program" << request.id
+                                      << "within" << FETCH_TIMEOUT << "ms.";
+    return verifyResult(request, false);
+}
+
+
+bool Library::verifyResult(const VerifyRequest &request, const bool &match) {
+    if (match) {
+        mVerified++;
+        static MetricsCounter *verified = Metrics::counter("library.send.verified");
+        verified->add();
+        if (mVerifyOutstanding.empty() && !isSending()) {
+            static MetricsHistogram *verifyTime = Metrics::histogram("library.send.verified_program_time");
+            verifyTime->record(1000LL * time->elapsed() / mVerified);
+        }
+        return true;
+    }
+
+    static MetricsCounter *mismatches = Metrics::counter("library.send.verify_mismatches");
+    mismatches->add();
+    if (request.attempts < FETCH_RETRIES) {
+        LOG_INFO(LogCategory::LIBRARY) << "Program" << request.id << "was not stored correctly, sending it again.";
+        VerifyRequest resend = request;
+        resend.attempts++;
+        mResend.push_back(resend);
+        return false;
+    }
+
+    // Give up, but keep it marked for "Send Changed":
+    LOG_WARNING(LogCategory::LIBRARY) << "Could not store program" << request.id << "after" << FETCH_RETRIES << "retries.";
+    mVerifyFailures.push_back(request.id);
+    if (request.id < numberOfPrograms) {
+        if (request.flags & Flag::PATCH) {
+            mPatchEdited.at(request.id) = true;
+            if (mJournal) {
+                mJournal->patchFlags(request.id, true, mPatchMoved.at(request.id));
+            }
+        } else {
+            mSequenceEdited.at(request.id) = true;
+            if (mJournal) {
+                mJournal->sequenceFlags(request.id, true, mSequenceMoved.at(request.id));
+            }
+        }
+    }
+    return false;
+}
+
+
+QString Library::verifyReport() const {
+    if (!mVerify) {
+        return QString("");
+    }
+    const int &elapsed = std::max(time->elapsed(), 1);
+    QString report = QString("Verified %1 program(s), %2 per second.").arg(mVerified).arg(1000.0 * mVerified / elapsed, 0, 'f', 1);
+    if (!mVerifyFailures.empty()) {
+        QStringList programs;
+        for (unsigned int i = 0; i < mVerifyFailures.size(); i++) {
+            programs << QString::number(mVerifyFailures.at(i) + 1); // displayed numbering
+        }
+        programs.removeDuplicates();
+        report += QString(" Could not store program(s) %1.").arg(programs.join(", "));
+    }
+    return report;
 }
 
 
@@ -396,6 +675,8 @@ bool Library::startFetching(const int &flags, const int &from, const int &to) {
         fetchSequenceMode = true;
         fetchNextIncomingSequence = from;
     }
+    fetchRetries = 0;
+    mFetchFailures.clear();
     time->start();
 
     return keepFetching();
@@ -405,6 +686,8 @@ bool Library::startFetching(const int &flags, const int &from, const int &to) {
 void Library::abortFetching() {
     fetchPatchMode = false;
     fetchSequenceMode = false;
+    fetchTimedOut = false;
+    fetchDraining = false;
     fetchStart = 0;
     fetchEnd = 0;
 }
@@ -423,15 +706,85 @@ QString Library::fetchProgress() const {
 }
 
 
+bool Library::checkFetching() {
+    if (!isFetchingPatches() && !isFetchingSequences()) {
+        return true;
+    }
+    if (time->elapsed() < fetchDeadline) {
+        return true;
+    }
+    if (fetchDraining) {
+        // No more late replies, continue with the next program:
+        fetchDraining = false;
+        return keepFetching();
+    }
+
+    LOG_WARNING(LogCategory::LIBRARY) << "Library::checkFetching(): no reply for program" << fetchNextRequest - 1
+                                      << "within" << FETCH_TIMEOUT << "ms.";
+    static MetricsCounter *timeouts = Metrics::counter("library.fetch.timeouts");
+    timeouts->add();
+    fetchTimedOut = true; // the reply may still arrive after the retry
+    return retryFetching();
+}
+
+
+bool Library::retryFetching() {
+    if (!isFetchingPatches() && !isFetchingSequences()) {
+        return false;
+    }
+    if (fetchDraining) {
+        return true; // an invalid late reply, see keepFetching()
+    }
+
+    // Only the parts of the outstanding program that did not arrive yet are
+    // requested again:
+    const unsigned int &id = fetchNextRequest - 1;
+    const bool &patch = fetchPatchMode && fetchNextIncomingPatch <= id;
+    const bool &sequence = fetchSequenceMode && fetchNextIncomingSequence <= id;
+    if (!patch && !sequence) {
+        return keepFetching();
+    }
+
+    if (fetchRetries < FETCH_RETRIES) {
+        fetchRetries++;
+        LOG_INFO(LogCategory::LIBRARY) << "Retrying to fetch program" << id << "(" << fetchRetries << "of" << FETCH_RETRIES << ").";
+        static MetricsCounter *retries = Metrics::counter("library.fetch.retries");
+        retries->add();
+        return requestProgram(id, patch, sequence);
+    }
+
+    // Give up on this program and continue with the next one:
+    LOG_WARNING(LogCategory::LIBRARY) << "Could not fetch program" << id << "after" << FETCH_RETRIES << "retries.";
+    static MetricsCounter *failures = Metrics::counter("library.fetch.failures");
+    failures->add();
+    mFetchFailures.push_back(id);
+    if (patch) {
+        fetchNextIncomingPatch = id + 1;
+    }
+    if (sequence) {
+        fetchNextIncomingSequence = id + 1;
+    }
+    return keepFetching();
+}
+
+
+const std::vector<int> &Library::fetchFailures() const {
+    return mFetchFailures;
+}
+
+
 bool Library::receivedPatch(const unsigned char *sysex) {
     if (!fetchPatchMode || fetchNextIncomingPatch > fetchEnd) {
         abortFetching();
         return false;
     }
 
-#ifdef DEBUGMSGS
-    std::cout << "Library::receivedPatch() " << fetchNextIncomingPatch << std::endl;
-#endif
+    if (fetchDraining) {
+        discardedReply();
+        return true;
+    }
+
+    LOG_DEBUG(LogCategory::LIBRARY) << "Library::receivedPatch()" << fetchNextIncomingPatch;
 
     // allocate space in vectors
     growVectorsTo(fetchNextIncomingPatch + 1);
@@ -441,22 +794,25 @@ bool Library::receivedPatch(const unsigned char *sysex) {
 
     if (ret) {
         patches.at(fetchNextIncomingPatch).set(tempp);
+        mPatchSlot.at(fetchNextIncomingPatch) = -1;
         mPatchEdited.at(fetchNextIncomingPatch) = false;
         mPatchMoved.at(fetchNextIncomingPatch) = false;
+        if (mJournal) {
+            mJournal->patch(fetchNextIncomingPatch, tempp, false, false);
+        }
         fetchNextIncomingPatch++;
+        static MetricsCounter *fetchedPatches = Metrics::counter("library.fetch.patches");
+        fetchedPatches->add();
 
         ret = keepFetching();
-    } else {
-        abortFetching();
     }
+    // Note: the caller retries the program if the patch was invalid.
     return ret;
 }
 
 
 bool Library::isFetchingPatches() const {
-#ifdef DEBUGMSGS
-    std::cout << "Library::isFetchingPatches() " << fetchPatchMode << " " << fetchNextIncomingPatch << " " << fetchEnd << std::endl;
-#endif
+    LOG_TRACE(LogCategory::LIBRARY) << "Library::isFetchingPatches()" << fetchPatchMode << fetchNextIncomingPatch << fetchEnd;
     return (fetchPatchMode && fetchNextIncomingPatch <= fetchEnd);
 }
 
@@ -467,40 +823,54 @@ bool Library::receivedSequence(const unsigned char *seq) {
         return false;
     }
 
-#ifdef DEBUGMSGS
-    std::cout << "Library::receivedSequence() " << fetchNextIncomingSequence << std::endl;
-#endif
+    if (fetchDraining) {
+        discardedReply();
+        return true;
+    }
+
+    LOG_DEBUG(LogCategory::LIBRARY) << "Library::receivedSequence()" << fetchNextIncomingSequence;
 
     // allocate space in vectors
     growVectorsTo(fetchNextIncomingSequence + 1);
 
     sequences.at(fetchNextIncomingSequence).unpackData(seq);
+    mSequenceSlot.at(fetchNextIncomingSequence) = -1;
     mSequenceEdited.at(fetchNextIncomingSequence) = false;
     mSequenceMoved.at(fetchNextIncomingSequence) = false;
+    if (mJournal) {
+        mJournal->sequence(fetchNextIncomingSequence, sequences.at(fetchNextIncomingSequence), false, false);
+    }
     fetchNextIncomingSequence++;
+    static MetricsCounter *fetchedSequences = Metrics::counter("library.fetch.sequences");
+    fetchedSequences->add();
 
     return keepFetching();
 }
 
 
+void Library::discardedReply() {
+    LOG_INFO(LogCategory::LIBRARY) << "Discarded a late reply for program" << fetchNextRequest - 1;
+    static MetricsCounter *discarded = Metrics::counter("library.fetch.discarded");
+    discarded->add();
+}
+
+
 bool Library::isFetchingSequences() const {
-#ifdef DEBUGMSGS
-    std::cout << "Library::isFetchingSequences() " << fetchSequenceMode << " " << fetchNextIncomingSequence << " " << fetchEnd << std::endl;
-#endif
+    LOG_TRACE(LogCategory::LIBRARY) << "Library::isFetchingSequences()" << fetchSequenceMode << fetchNextIncomingSequence << fetchEnd;
     return (fetchSequenceMode && fetchNextIncomingSequence <= fetchEnd);
 }
 
 
 void Library::remove(const int &from, const int &to) {
-#ifdef DEBUGMSGS
-    std::cout << "Library::deletePrograms(" << from << ", " << to << ");" << std::endl;
-#endif
+    LOG_DEBUG(LogCategory::LIBRARY) << "Library::deletePrograms(" << from << "," << to << ")";
     patches.erase(patches.begin() + from, patches.begin() + to + 1);
     mPatchMoved.erase(mPatchMoved.begin() + from, mPatchMoved.begin() + to + 1);
     mPatchEdited.erase(mPatchEdited.begin() + from, mPatchEdited.begin() + to + 1);
+    mPatchSlot.erase(mPatchSlot.begin() + from, mPatchSlot.begin() + to + 1);
     sequences.erase(sequences.begin() + from, sequences.begin() + to + 1);
     mSequenceMoved.erase(mSequenceMoved.begin() + from, mSequenceMoved.begin() + to + 1);
     mSequenceEdited.erase(mSequenceEdited.begin() + from, mSequenceEdited.begin() + to + 1);
+    mSequenceSlot.erase(mSequenceSlot.begin() + from, mSequenceSlot.begin() + to + 1);
 
     numberOfPrograms -= to - from + 1;
 
@@ -512,13 +882,15 @@ void Library::remove(const int &from, const int &to) {
         mPatchMoved.at(i) = true;
         mSequenceMoved.at(i) = true;
     }
+
+    if (mJournal) {
+        mJournal->remove(from, to);
+    }
 }
 
 
 void Library::insert(const int &id) {
-#ifdef DEBUGMSGS
-    std::cout << "Library::insertProgram(" << id << ");" << std::endl;
-#endif
+    LOG_DEBUG(LogCategory::LIBRARY) << "Library::insertProgram(" << id << ")";
     if (firmwareVersionRequested) {
         patches.insert(patches.begin() + id, Patch(firmwareVersion));
     } else {
@@ -526,9 +898,11 @@ void Library::insert(const int &id) {
     }
     mPatchMoved.insert(mPatchMoved.begin() + id, false);
     mPatchEdited.insert(mPatchEdited.begin() + id, true);
+    mPatchSlot.insert(mPatchSlot.begin() + id, -1);
     sequences.insert(sequences.begin() + id, Sequence());
     mSequenceMoved.insert(mSequenceMoved.begin() + id, false);
     mSequenceEdited.insert(mSequenceEdited.begin() + id, true);
+    mSequenceSlot.insert(mSequenceSlot.begin() + id, -1);
     numberOfPrograms += 1;
 
     // Mark as moved:
@@ -536,13 +910,15 @@ void Library::insert(const int &id) {
         mPatchMoved.at(i) = true;
         mSequenceMoved.at(i) = true;
     }
+
+    if (mJournal) {
+        mJournal->insert(id);
+    }
 }
 
 
 void Library::reset(const int &flags, const int &from, const int &to) {
-#ifdef DEBUGMSGS
-    std::cout << "Library::resetPrograms(" << flags << ", " << from << ", " << to << ");" << std::endl;
-#endif
+    LOG_DEBUG(LogCategory::LIBRARY) << "Library::resetPrograms(" << flags << "," << from << "," << to << ")";
     if (flags&Flag::PATCH) {
         for (int i = from; i <= to; i++) {
             if (firmwareVersionRequested) {
@@ -550,6 +926,7 @@ void Library::reset(const int &flags, const int &from, const int &to) {
             } else {
                 patches.at(i).reset();
             }
+            mPatchSlot.at(i) = -1;
             mPatchMoved.at(i) = false;
             mPatchEdited.at(i) = true;
         }
@@ -557,16 +934,62 @@ void Library::reset(const int &flags, const int &from, const int &to) {
     if (flags&Flag::SEQUENCE) {
         for (int i = from; i <= to; i++) {
             sequences.at(i).reset();
+            mSequenceSlot.at(i) = -1;
             mSequenceMoved.at(i) = false;
             mSequenceEdited.at(i) = true;
         }
     }
+
+    if (mJournal) {
+        mJournal->reset(flags, from, to);
+    }
+}
+
+
+int Library::upgradePatches(const int &from, const int &to) {
+    int converted = 0;
+    for (int i = from; i <= to && i < numberOfPrograms; i++) {
+        decodePatch(i);
+        if (patches.at(i).upgrade()) {
+            mPatchEdited.at(i) = true;
+            if (mJournal) {
+                mJournal->patch(i, patches.at(i), true, mPatchMoved.at(i));
+            }
+            converted++;
+        }
+    }
+    static MetricsCounter *upgraded = Metrics::counter("library.upgraded_patches");
+    upgraded->add(converted);
+    return converted;
+}
+
+
+int Library::generatePatches(PatchGenerator &generator, const Patch &base, const int &from, const int &to) {
+    int generated = 0;
+    Patch patch;
+    for (int i = from; i <= to && i < numberOfPrograms; i++) {
+        patch.set(base);
+        generator.generate(patch, i);
+        storePatch(i, patch); // marks as edited and journals it
+        generated++;
+    }
+    static MetricsCounter *counter = Metrics::counter("library.generated_patches");
+    counter->add(generated);
+    return generated;
 }
 
 
 bool Library::saveLibrary(const QString &path) {
     QByteArray ba;
+    serialize(ba);
 
+    bool status = FileIO::saveToDisk(path, ba);
+    // Note: This replaces the file.
+    return status;
+}
+
+
+void Library::serialize(QByteArray &ba) const {
     Message temp;
 
     const int &psize = patches.size();
@@ -577,20 +1000,18 @@ bool Library::saveLibrary(const QString &path) {
         // Patch
         if (i < psize) {
             temp.clear();
+            decodePatch(i);
             patches.at(i).generateSysex(&temp);
             FileIO::appendToByteArray(temp, ba);
         }
         // Sequence
         if (i < ssize) {
             temp.clear();
+            decodeSequence(i);
             sequences.at(i).generateSysex(&temp);
             FileIO::appendToByteArray(temp, ba);
         }
     }
-
-    bool status = FileIO::saveToDisk(path, ba);
-    // Note: This replaces the file.
-    return status;
 }
 
 
@@ -601,6 +1022,11 @@ bool Library::loadLibrary(const QString &path, bool append) {
         return false;
     }
 
+    return parseLibrary(temp, append);
+}
+
+
+bool Library::parseLibrary(const Message &temp, const bool &append, ProgressObserver *observer) {
     bool statusp = true;
     bool statuss = true;
     int patch = 0;
@@ -610,6 +1036,8 @@ bool Library::loadLibrary(const QString &path, bool append) {
         patch = patches.size();
         sequence = sequences.size();
     }
+    const int firstPatch = patch;
+    const int firstSequence = sequence;
 
     // Patch:
     int lastPosition = 0;
@@ -618,6 +1046,9 @@ bool Library::loadLibrary(const QString &path, bool append) {
     Message ptc;
     Patch tempPatch;
     while(keepGoing) {
+        if (observer && !observer->progress(lastPosition, 2 * temp.size())) {
+            return false; // cancelled
+        }
         //std::cout << "patch " << patch << " " << lastPosition << std::endl;
         const int &retp = Midi::getPatch(&temp, &ptc, lastPosition);
         statusp &= tempPatch.parseSysex(&ptc);
@@ -627,6 +1058,7 @@ bool Library::loadLibrary(const QString &path, bool append) {
             lastPosition = retp + 195;
             growVectorsTo(patch + 1);
             patches.at(patch).set(tempPatch);
+            mPatchSlot.at(patch) = -1;
             mPatchEdited.at(patch) = false;
             mPatchMoved.at(patch) = false;
             patch++;
@@ -642,6 +1074,9 @@ bool Library::loadLibrary(const QString &path, bool append) {
     Sequence tempSequence;
 
     while(keepGoing) {
+        if (observer && !observer->progress(temp.size() + lastPosition, 2 * temp.size())) {
+            return false; // cancelled
+        }
         //std::cout << "seq" << sequence << std::endl;
         const int &rets = Midi::getSequence(&temp, &seq, lastPosition);
         statuss &= tempSequence.parseSysex(&seq);
@@ -652,6 +1087,7 @@ bool Library::loadLibrary(const QString &path, bool append) {
             lastPosition = rets + 95;
             growVectorsTo(sequence + 1);
             sequences.at(sequence).set(tempSequence);
+            mSequenceSlot.at(sequence) = -1;
             mSequenceEdited.at(sequence) = false;
             mSequenceMoved.at(sequence) = false;
             sequence++;
@@ -666,21 +1102,214 @@ bool Library::loadLibrary(const QString &path, bool append) {
     // Use approach number two!
     numberOfPrograms = std::max(numberOfPrograms, std::max(patch, sequence));
 
+    mLoadedPatches = patch - firstPatch;
+    mLoadedSequences = sequence - firstSequence;
+    if (mJournal) {
+        mJournal->replaced();
+    }
+
     return statusp && statuss;
 }
 
 
+void Library::takePrograms(Library &staged, const bool &append) {
+    const int &loadedPatches = staged.mLoadedPatches;
+    const int &loadedSequences = staged.mLoadedSequences;
+    if (mJournal) {
+        mJournal->replaced();
+    }
+
+    if (!append && loadedPatches == loadedSequences && loadedPatches >= numberOfPrograms) {
+        // The staged programs replace all programs, just swap the vectors:
+        patches.swap(staged.patches);
+        mPatchEdited.swap(staged.mPatchEdited);
+        mPatchMoved.swap(staged.mPatchMoved);
+        sequences.swap(staged.sequences);
+        mSequenceEdited.swap(staged.mSequenceEdited);
+        mSequenceMoved.swap(staged.mSequenceMoved);
+        // Programs that are not decoded yet come with their file:
+        mPatchSlot.swap(staged.mPatchSlot);
+        mSequenceSlot.swap(staged.mSequenceSlot);
+        std::swap(mSource, staged.mSource);
+        numberOfPrograms = patches.size();
+        return;
+    }
+
+    // Same as parseLibrary() on this library:
+    const int &patchOffset = append ? patches.size() : 0;
+    const int &sequenceOffset = append ? sequences.size() : 0;
+    growVectorsTo(std::max(patchOffset + loadedPatches, sequenceOffset + loadedSequences));
+    for (int i = 0; i < loadedPatches; i++) {
+        staged.decodePatch(i);
+        patches.at(patchOffset + i).set(staged.patches.at(i));
+        mPatchSlot.at(patchOffset + i) = -1;
+        mPatchEdited.at(patchOffset + i) = false;
+        mPatchMoved.at(patchOffset + i) = false;
+    }
+    for (int i = 0; i < loadedSequences; i++) {
+        staged.decodeSequence(i);
+        sequences.at(sequenceOffset + i).set(staged.sequences.at(i));
+        mSequenceSlot.at(sequenceOffset + i) = -1;
+        mSequenceEdited.at(sequenceOffset + i) = false;
+        mSequenceMoved.at(sequenceOffset + i) = false;
+    }
+}
+
+
+void Library::appendLoadedPrograms(const Library &other) {
+    // Merges staging libraries, like appending the files one after the other:
+    const int &offset = std::max(mLoadedPatches, mLoadedSequences);
+    growVectorsTo(offset + std::max(other.mLoadedPatches, other.mLoadedSequences));
+    for (int i = 0; i < other.mLoadedPatches; i++) {
+        other.decodePatch(i);
+        patches.at(offset + i).set(other.patches.at(i));
+        mPatchSlot.at(offset + i) = -1;
+    }
+    for (int i = 0; i < other.mLoadedSequences; i++) {
+        other.decodeSequence(i);
+        sequences.at(offset + i).set(other.sequences.at(i));
+        mSequenceSlot.at(offset + i) = -1;
+    }
+    mLoadedPatches = offset + other.mLoadedPatches;
+    mLoadedSequences = offset + other.mLoadedSequences;
+}
+
+
+bool Library::openIndexed(const QString &path) {
+    // Replaces the programs like parseLibrary() without append, but only
+    // reads the header; the programs are decoded by decodePatch() and
+    // decodeSequence().
+    LibraryFile *file = new LibraryFile;
+    if (!file->open(path)) {
+        delete file;
+        return false;
+    }
+
+    // Programs of the previous file must not refer to it anymore:
+    for (int i = 0; i < numberOfPrograms; i++) {
+        decodePatch(i);
+        decodeSequence(i);
+    }
+    delete mSource;
+    mSource = file;
+
+    const int &count = mSource->count();
+    growVectorsTo(count);
+    for (int i = 0; i < count; i++) {
+        const unsigned char &flags = mSource->flags(i);
+        mPatchSlot.at(i) = i;
+        mPatchEdited.at(i) = flags & LibraryFile::PATCH_EDITED;
+        mPatchMoved.at(i) = flags & LibraryFile::PATCH_MOVED;
+        mSequenceSlot.at(i) = i;
+        mSequenceEdited.at(i) = flags & LibraryFile::SEQUENCE_EDITED;
+        mSequenceMoved.at(i) = flags & LibraryFile::SEQUENCE_MOVED;
+    }
+    mLoadedPatches = count;
+    mLoadedSequences = count;
+    if (mJournal) {
+        mJournal->replaced();
+    }
+    return count > 0;
+}
+
+
+void Library::serializeIndexed(QByteArray &ba, const quint32 &journalSequence) const {
+    ba.reserve(LibraryFile::HEADER_SIZE + numberOfPrograms * LibraryFile::SLOT_SIZE);
+    LibraryFile::appendHeader(ba, numberOfPrograms, journalSequence, numberOfHWPrograms);
+
+    unsigned char patch[92];
+    unsigned char sequence[32];
+    for (int i = 0; i < numberOfPrograms; i++) {
+        const unsigned char &flags = (mPatchEdited.at(i) ? LibraryFile::PATCH_EDITED : 0) |
+                (mPatchMoved.at(i) ? LibraryFile::PATCH_MOVED : 0) |
+                (mSequenceEdited.at(i) ? LibraryFile::SEQUENCE_EDITED : 0) |
+                (mSequenceMoved.at(i) ? LibraryFile::SEQUENCE_MOVED : 0);
+        // Programs that were not decoded are copied as they are:
+        const unsigned char *p = patch;
+        if (mPatchSlot.at(i) >= 0) {
+            p = mSource->patchData(mPatchSlot.at(i));
+        } else {
+            patches.at(i).packData(patch);
+        }
+        const unsigned char *s = sequence;
+        if (mSequenceSlot.at(i) >= 0) {
+            s = mSource->sequenceData(mSequenceSlot.at(i));
+        } else {
+            sequences.at(i).packData(sequence);
+        }
+        LibraryFile::appendSlot(ba, flags, p, s);
+    }
+}
+
+
+void Library::restorePatch(const int &id, const Patch *patch, const bool &edited, const bool &moved) {
+    growVectorsTo(id + 1);
+    if (patch) {
+        patches.at(id).set(*patch);
+        mPatchSlot.at(id) = -1;
+    }
+    mPatchEdited.at(id) = edited;
+    mPatchMoved.at(id) = moved;
+}
+
+
+void Library::restoreSequence(const int &id, const Sequence *sequence, const bool &edited, const bool &moved) {
+    growVectorsTo(id + 1);
+    if (sequence) {
+        sequences.at(id).set(*sequence);
+        mSequenceSlot.at(id) = -1;
+    }
+    mSequenceEdited.at(id) = edited;
+    mSequenceMoved.at(id) = moved;
+}
+
+
+void Library::decodePatch(const int &id) const {
+    int &slot = mPatchSlot.at(id);
+    if (slot < 0) {
+        return;
+    }
+    if (!patches.at(id).unpackData(mSource->patchData(slot))) {
+        LOG_WARNING(LogCategory::LIBRARY) << "Library::decodePatch(): invalid patch" << id;
+    }
+    slot = -1;
+}
+
+
+void Library::decodeSequence(const int &id) const {
+    int &slot = mSequenceSlot.at(id);
+    if (slot < 0) {
+        return;
+    }
+    sequences.at(id).unpackData(mSource->sequenceData(slot));
+    slot = -1;
+}
+
+
 const int &Library::getNumberOfPrograms() const {
     return numberOfPrograms;
 }
 
 
+const int &Library::getNumberOfLoadedPatches() const {
+    return mLoadedPatches;
+}
+
+
+const int &Library::getNumberOfLoadedSequences() const {
+    return mLoadedSequences;
+}
+
+
 const int &Library::getNumberOfHWPrograms() const {
     return numberOfHWPrograms;
 }
 
 
 void Library::setNumberOfHWPrograms(const int &num) {
+    if (mJournal && num != numberOfHWPrograms) {
+        mJournal->hardwarePrograms(num);
+    }
     numberOfHWPrograms = num;
     growVectorsTo(num);
 }
@@ -720,30 +1349,23 @@ bool Library::recallShruthiProgramm() {
 
 
 bool Library::keepFetching() {
-#ifdef DEBUGMSGS
-    std::cout << "Library::keepFetching(): Patches " << fetchPatchMode << " " << fetchNextRequest << " " << fetchEnd << std::endl;
-    std::cout << "Library::keepFetching(): Sequences " << fetchSequenceMode << " " << fetchNextRequest << " " << fetchEnd << std::endl;
-#endif
+    LOG_TRACE(LogCategory::LIBRARY) << "Library::keepFetching(): Patches" << fetchPatchMode << fetchNextRequest << fetchEnd
+                                    << ", Sequences" << fetchSequenceMode << fetchNextRequest << fetchEnd;
     const bool ptc_enabled = fetchPatchMode && fetchNextIncomingPatch <= fetchEnd;
     const bool seq_enabled = fetchSequenceMode && fetchNextIncomingSequence <= fetchEnd;
 
     if (!ptc_enabled && !seq_enabled) {
         // Finished fetching. Display statistics:
-        std::cout << "Finished fetching ";
-
-        if (fetchPatchMode) {
-            std::cout << "patches";
-            if (fetchSequenceMode) {
-                std::cout << " and ";
-            }
+        LOG_INFO(LogCategory::LIBRARY) << "Finished fetching" << programTypes(fetchPatchMode, fetchSequenceMode)
+                                       << ". It took" << time->elapsed() << "ms to fetch" << fetchEnd - fetchStart + 1 << "program(s).";
+        if (!mFetchFailures.empty()) {
+            LOG_WARNING(LogCategory::LIBRARY) << mFetchFailures.size() << "program(s) could not be fetched.";
         }
-        if (fetchSequenceMode) {
-            std::cout << "sequences";
-        }
-        std::cout << ". It took " << time->elapsed() << " ms to fetch " << fetchEnd - fetchStart + 1 << " program(s)." << std::endl;
+        static MetricsHistogram *fetchTime = Metrics::histogram("library.fetch.program_time");
+        fetchTime->record(1000LL * time->elapsed() / (fetchEnd - fetchStart + 1));
 
         abortFetching();
-        return recallShruthiProgramm();
+        return true; // the editor recalls the program after the last queued fetch
     }
 
     // If fetching patches and sequences only request next program after receiving a sequence:
@@ -751,28 +1373,51 @@ bool Library::keepFetching() {
         return true;
     }
 
+    if (fetchTimedOut) {
+        // Replies carry no program number: a late reply of the request that
+        // timed out would be taken for the next program and shift all
+        // following ones. Discard replies until the watchdog
+        // (checkFetching()) saw none for FETCH_TIMEOUT:
+        fetchTimedOut = false;
+        fetchDraining = true;
+        fetchDeadline = time->elapsed() + FETCH_TIMEOUT;
+        return true;
+    }
+
+    fetchRetries = 0;
+    const bool &ret = requestProgram(fetchNextRequest, fetchPatchMode, fetchSequenceMode);
+    if (ret) {
+        fetchNextRequest++;
+    }
+    return ret;
+}
+
+
+bool Library::requestProgram(const unsigned int &id, const bool &patch, const bool &sequence) {
     bool ret = true;
     const bool &oldShruthi = firmwareVersionRequested && firmwareVersion < 1000;
 
-    if (fetchPatchMode || (fetchSequenceMode && !oldShruthi)) {
-        ret = midiout->programChange(mMidiChannel, fetchNextRequest);
+    if (patch || (sequence && !oldShruthi)) {
+        ret = midiout->programChange(mMidiChannel, id);
     }
 
     // change sequence manually for pre 1.00 firmware:
-    if (ret && fetchSequenceMode && oldShruthi) {
-        ret = midiout->programChangeSequence(mMidiChannel, fetchNextRequest);
+    if (ret && sequence && oldShruthi) {
+        ret = midiout->programChangeSequence(mMidiChannel, id);
     }
 
-    if (ret && fetchPatchMode) {
+    if (ret && patch) {
         ret = midiout->patchTransferRequest();
     }
 
-    if (ret && fetchSequenceMode) {
+    if (ret && sequence) {
         ret =  midiout->sequenceTransferRequest();
     }
 
     if (ret) {
-        fetchNextRequest++;
+        // The deadline is well above the transfer time of a reply, so a
+        // reply arriving after it was most likely lost:
+        fetchDeadline = time->elapsed() + FETCH_TIMEOUT;
     } else {
         abortFetching();
     }
@@ -785,31 +1430,28 @@ void Library::growVectorsTo(const int &num) {
     const int &amount = num - numberOfPrograms;
     if (amount > 0) {
         numberOfPrograms = num;
-        patches.reserve(num);
-        mPatchEdited.reserve(num);
-        mPatchMoved.reserve(num);
-        sequences.reserve(num);
-        mSequenceEdited.reserve(num);
-        mSequenceMoved.reserve(num);
-
-
-        for (int i = 0; i < amount; i++) {
-            if (firmwareVersionRequested) {
-                patches.push_back(Patch(firmwareVersion));
-            } else {
-                patches.push_back(Patch());
-            }
-            mPatchEdited.push_back(false);
-            mPatchMoved.push_back(false);
-            sequences.push_back(Sequence());
-            mSequenceMoved.push_back(false);
-            mSequenceEdited.push_back(false);
+        // Copy one initialized program, large libraries grow by thousands:
+        const Patch &patch = firmwareVersionRequested ? Patch(firmwareVersion) : Patch();
+        patches.resize(num, patch);
+        mPatchEdited.resize(num, false);
+        mPatchMoved.resize(num, false);
+        mPatchSlot.resize(num, -1);
+        sequences.resize(num, Sequence());
+        mSequenceMoved.resize(num, false);
+        mSequenceEdited.resize(num, false);
+        mSequenceSlot.resize(num, -1);
+
+        if (mJournal) {
+            mJournal->grow(num);
         }
     }
 }
 
 
 QString Library::calculateSequenceHash(const unsigned int &id) const {
+    if (mSequenceSlot.at(id) >= 0) {
+        return calculateHash(mSource->sequenceData(mSequenceSlot.at(id)), 32);
+    }
     unsigned char key[32];
     sequences.at(id).packData(key);
     return calculateHash(key, 32);
@@ -22,9 +22,17 @@
 
 
 #include <QObject>
+#include <deque>
+#include <stddef.h> // for NULL
+#include "message.h"
 #include "patch.h"
 #include "sequence.h"
+class LibraryFile;
+class LibraryJournal;
 class MidiOut;
+class PatchGenerator;
+class ProgressObserver;
+class QByteArray;
 class QString;
 class QTime;
 
@@ -39,6 +47,7 @@ class Library : public QObject {
         void setFirmwareVersion(const int &version);
         void setFirmwareVersionRequested();
         void setMidiChannel(const unsigned char &channel);
+        void setJournal(LibraryJournal *journal); // records all edits
 
         const Patch &recallPatch(const int &id) const;
         void storePatch(const int &id, const Patch &patch);
@@ -62,6 +71,12 @@ class Library : public QObject {
         bool startFetching(const int &flags, const int &from, const int &to);
         void abortFetching();
         QString fetchProgress() const;
+        bool checkFetching(); // called periodically, retries requests past their deadline
+        bool retryFetching(); // the outstanding reply was invalid
+        const std::vector<int> &fetchFailures() const; // programs skipped by the last fetch
+
+        static const int FETCH_TIMEOUT = 1000; // ms until a request is retried
+        static const unsigned int FETCH_RETRIES = 3; // per program
 
         bool receivedPatch(const unsigned char *sysex);
         bool isFetchingPatches() const;
@@ -78,16 +93,41 @@ class Library : public QObject {
         const int &sendRedrawIndex();
         const int &sendRedrawFlags();
 
+        // Read-back verification of sent programs (Flag::VERIFY):
+        bool isVerifying() const; // read-back replies outstanding, all replies are for the verification
+        bool verifiedPatch(const unsigned char *sysex); // NULL for an invalid reply
+        bool verifiedSequence(const unsigned char *seq);
+        bool checkVerifying(); // called periodically, handles lost replies
+        QString verifyReport() const;
+
         void remove(const int &from, const int &to);
         void insert(const int &id);
         void reset(const int &flags, const int &from, const int &to);
+        int upgradePatches(const int &from, const int &to); // returns the number of converted patches
+        // Replaces the patches with random variations of base (slot i gets
+        // patch number i of the generator's seed); returns the number of
+        // generated patches:
+        int generatePatches(PatchGenerator &generator, const Patch &base, const int &from, const int &to);
 
         bool saveLibrary(const QString &path);
         bool loadLibrary(const QString &path, bool append = false);
+        void serialize(QByteArray &data) const;
+        void serializeIndexed(QByteArray &data, const quint32 &journalSequence = 0) const;
+        bool parseLibrary(const Message &data, const bool &append, ProgressObserver *observer = NULL);
+        void takePrograms(Library &staged, const bool &append);
+        void appendLoadedPrograms(const Library &other);
+        bool openIndexed(const QString &path);
+
+        // Used by LibraryJournal::replay(); a NULL program only sets the flags:
+        void restorePatch(const int &id, const Patch *patch, const bool &edited, const bool &moved);
+        void restoreSequence(const int &id, const Sequence *sequence, const bool &edited, const bool &moved);
 
         const int &getNumberOfPrograms() const;
+        const int &getNumberOfLoadedPatches() const; // found by the last parseLibrary() or openIndexed()
+        const int &getNumberOfLoadedSequences() const;
         const int &getNumberOfHWPrograms() const;
         void setNumberOfHWPrograms(const int &num);
+        void growVectorsTo(const int &num); // appends initialized programs
 
         const unsigned int &nextPatch() const;
         const unsigned int &nextSequence() const;
@@ -95,28 +135,51 @@ class Library : public QObject {
         void rememberShruthiProgram(const int &patch, const int &sequence);
         bool recallShruthiProgramm();
 
+        static QString calculateHash(const unsigned char *key, const unsigned int &len);
+
     private:
         Library(const Library&); //forbid copying
         Library &operator=(const Library&); //forbid assignment
 
         bool keepFetching();
-
-        std::vector<Patch> patches;
+        void stopSending();
+
+        struct VerifyRequest {
+            int id;
+            int flags; // Flag::PATCH or Flag::SEQUENCE
+            int deadline; // ms on time
+            unsigned int attempts;
+        };
+        bool writePatch(const int &id);
+        bool writeSequence(const int &id);
+        bool requestVerification(const int &id, const int &flags, const unsigned int &attempts);
+        bool verifyResult(const VerifyRequest &request, const bool &match);
+        bool requestProgram(const unsigned int &id, const bool &patch, const bool &sequence);
+        void discardedReply();
+
+        // Programs opened with openIndexed() are decoded on first use:
+        void decodePatch(const int &id) const;
+        void decodeSequence(const int &id) const;
+
+        mutable std::vector<Patch> patches;
         std::vector<bool> mPatchMoved;
         std::vector<bool> mPatchEdited;
 
-        std::vector<Sequence> sequences;
+        mutable std::vector<Sequence> sequences;
         std::vector<bool> mSequenceMoved;
         std::vector<bool> mSequenceEdited;
 
-        const Sequence init_sequence;
+        // Slot in mSource of programs that are not decoded yet, -1 otherwise:
+        LibraryFile *mSource;
+        mutable std::vector<int> mPatchSlot;
+        mutable std::vector<int> mSequenceSlot;
 
-        void growVectorsTo(const int &num);
+        const Sequence init_sequence;
 
         QString calculateSequenceHash(const unsigned int &id) const;
-        static QString calculateHash(const unsigned char *key, const unsigned int &len);
 
         MidiOut *midiout;
+        LibraryJournal *mJournal;
 
         bool fetchPatchMode;
         bool fetchSequenceMode;
@@ -126,6 +189,11 @@ class Library : public QObject {
         unsigned int fetchNextRequest;
         unsigned int fetchNextIncomingPatch;
         unsigned int fetchNextIncomingSequence;
+        unsigned int fetchRetries; // of the outstanding request
+        bool fetchTimedOut; // a request of the outstanding program timed out
+        bool fetchDraining; // discarding late replies before the next request
+        int fetchDeadline; // ms on time
+        std::vector<int> mFetchFailures;
 
         bool mSendPatchMode;
         bool mSendSequenceMode;
@@ -138,11 +206,21 @@ class Library : public QObject {
         int mSendRedrawIndex;
         int mSendRedrawFlags;
 
+        bool mVerify;
+        std::deque<VerifyRequest> mVerifyOutstanding; // in the order of the replies
+        std::deque<VerifyRequest> mResend; // mismatches, sent again by keepSending()
+        std::vector<int> mVerifyFailures;
+        int mVerified;
+
         QTime *time;
 
         int numberOfPrograms;
         int numberOfHWPrograms;
 
+        // Programs found by the last parseLibrary():
+        int mLoadedPatches;
+        int mLoadedSequences;
+
         int firmwareVersion;
         bool firmwareVersionRequested;
 
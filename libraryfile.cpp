@@ -0,0 +1,177 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "libraryfile.h"
+#include <stddef.h> // for NULL
+#include <string.h> // for memcmp
+#include "log.h"
+
+
+static const char MAGIC[8] = {'S', 'H', 'R', 'U', 'L', 'I', 'B', '\0'};
+static const int PATCH_OFFSET = 4;
+static const int SEQUENCE_OFFSET = 96;
+
+
+static quint32 readUInt32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((quint32) p[3] << 24);
+}
+
+
+static void appendUInt32(QByteArray &data, const quint32 &value) {
+    data.append((char) (value & 0xff));
+    data.append((char) ((value >> 8) & 0xff));
+    data.append((char) ((value >> 16) & 0xff));
+    data.append((char) ((value >> 24) & 0xff));
+}
+
+
+LibraryFile::LibraryFile():
+    data(NULL),
+    mCount(0),
+    slotSize(SLOT_SIZE),
+    firstSlot(HEADER_SIZE),
+    mJournalSequence(0),
+    mHardwarePrograms(0) {
+}
+
+
+LibraryFile::~LibraryFile() {
+    close();
+}
+
+
+bool LibraryFile::open(const QString &path) {
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        LOG_DEBUG(LogCategory::FILEIO) << "LibraryFile::open(): could not open" << path;
+        return false;
+    }
+
+    const qint64 &size = file.size();
+    if (size >= HEADER_SIZE) {
+        data = file.map(0, size);
+    }
+    if (!data || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_DEBUG(LogCategory::FILEIO) << "LibraryFile::open(): not a library file:" << path;
+        close();
+        return false;
+    }
+
+    const quint32 &version = readUInt32(data + 8);
+    const quint32 &programs = readUInt32(data + 12);
+    const quint32 &slotBytes = readUInt32(data + 16);
+    const quint32 &offset = readUInt32(data + 20);
+    // Newer versions may add data at the end of a slot, but must keep the
+    // layout of version 1:
+    if (version < 1 || slotBytes < (quint32) SLOT_SIZE || offset < (quint32) HEADER_SIZE ||
+            (qint64) offset + (qint64) programs * slotBytes > size) {
+        LOG_WARNING(LogCategory::FILEIO) << "LibraryFile::open(): invalid header in" << path;
+        close();
+        return false;
+    }
+
+    mCount = programs;
+    slotSize = slotBytes;
+    firstSlot = offset;
+    mJournalSequence = readUInt32(data + 24);
+    mHardwarePrograms = readUInt32(data + 28);
+    LOG_DEBUG(LogCategory::FILEIO) << "LibraryFile::open():" << path << "with" << mCount << "programs";
+    return true;
+}
+
+
+void LibraryFile::close() {
+    if (data) {
+        file.unmap((uchar*) data);
+        data = NULL;
+    }
+    if (file.isOpen()) {
+        file.close();
+    }
+    mCount = 0;
+    mJournalSequence = 0;
+    mHardwarePrograms = 0;
+}
+
+
+const int &LibraryFile::count() const {
+    return mCount;
+}
+
+
+const quint32 &LibraryFile::journalSequence() const {
+    return mJournalSequence;
+}
+
+
+const int &LibraryFile::hardwarePrograms() const {
+    return mHardwarePrograms;
+}
+
+
+const unsigned char *LibraryFile::slot(const int &id) const {
+    return data + firstSlot + (qint64) id * slotSize;
+}
+
+
+const unsigned char &LibraryFile::flags(const int &id) const {
+    return *slot(id);
+}
+
+
+const unsigned char *LibraryFile::patchData(const int &id) const {
+    return slot(id) + PATCH_OFFSET;
+}
+
+
+const unsigned char *LibraryFile::sequenceData(const int &id) const {
+    return slot(id) + SEQUENCE_OFFSET;
+}
+
+
+QString LibraryFile::patchName(const int &id) const {
+    // Same as Patch::unpackData(), without decoding the patch:
+    return QString::fromLatin1((const char*) patchData(id) + 68, 8).trimmed();
+}
+
+
+void LibraryFile::appendHeader(QByteArray &data, const int &count, const quint32 &journalSequence, const int &hardwarePrograms) {
+    data.append(MAGIC, sizeof(MAGIC));
+    appendUInt32(data, VERSION);
+    appendUInt32(data, count);
+    appendUInt32(data, SLOT_SIZE);
+    appendUInt32(data, HEADER_SIZE);
+    appendUInt32(data, journalSequence);
+    appendUInt32(data, hardwarePrograms);
+}
+
+
+void LibraryFile::appendSlot(QByteArray &data, const unsigned char &flags, const unsigned char *patch, const unsigned char *sequence) {
+    data.append((char) flags);
+    data.append(QByteArray(PATCH_OFFSET - 1, '\0'));
+    data.append((const char*) patch, SEQUENCE_OFFSET - PATCH_OFFSET);
+    data.append((const char*) sequence, SLOT_SIZE - SEQUENCE_OFFSET);
+}
+
+
+bool LibraryFile::isLibraryFile(const QString &path) {
+    return path.endsWith(".slb", Qt::CaseInsensitive);
+}
@@ -0,0 +1,94 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_LIBRARYFILE_H
+#define SHRUTHI_LIBRARYFILE_H
+
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+
+// Native library format (*.slb).
+//
+// Unlike a .syx library, every program has a fixed-size slot, so a program is
+// found without scanning the file. All numbers are little endian.
+//
+//   header (32 bytes):
+//     "SHRULIB\0", u32 format version, u32 number of slots, u32 slot size,
+//     u32 offset of the first slot, u32 journal sequence number (see
+//     LibraryJournal, 0 for other files), u32 number of programs on the
+//     Shruthi the library was used with (0 if unknown)
+//   slots (slot size bytes each, 128 in version 1):
+//     u8 flags (see below), 3 reserved bytes, the packed patch (92 bytes,
+//     includes the name), the packed sequence (32 bytes)
+//
+// Files are mapped into memory, opening is O(1) for any size. Library decodes
+// the programs when they are used.
+class LibraryFile {
+    public:
+        static const int HEADER_SIZE = 32;
+        static const int SLOT_SIZE = 128;
+        static const int VERSION = 1;
+
+        // Slot flags:
+        static const unsigned char PATCH_EDITED = 0x01;
+        static const unsigned char PATCH_MOVED = 0x02;
+        static const unsigned char SEQUENCE_EDITED = 0x04;
+        static const unsigned char SEQUENCE_MOVED = 0x08;
+
+        LibraryFile();
+        ~LibraryFile();
+
+        bool open(const QString &path);
+        void close();
+        const int &count() const;
+        const quint32 &journalSequence() const;
+        const int &hardwarePrograms() const;
+
+        const unsigned char &flags(const int &slot) const;
+        const unsigned char *patchData(const int &slot) const; // 92 bytes
+        const unsigned char *sequenceData(const int &slot) const; // 32 bytes
+        QString patchName(const int &slot) const;
+
+        // Writing:
+        static void appendHeader(QByteArray &data, const int &count, const quint32 &journalSequence = 0, const int &hardwarePrograms = 0);
+        static void appendSlot(QByteArray &data, const unsigned char &flags, const unsigned char *patch, const unsigned char *sequence);
+
+        static bool isLibraryFile(const QString &path);
+
+    private:
+        LibraryFile(const LibraryFile&); //forbid copying
+        LibraryFile &operator=(const LibraryFile&); //forbid assignment
+
+        const unsigned char *slot(const int &id) const;
+
+        QFile file;
+        const unsigned char *data;
+        int mCount;
+        int slotSize;
+        int firstSlot;
+        quint32 mJournalSequence;
+        int mHardwarePrograms;
+};
+
+
+#endif // SHRUTHI_LIBRARYFILE_H
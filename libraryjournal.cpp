@@ -0,0 +1,506 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "libraryjournal.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <algorithm> // for max, min
+#include <stdio.h> // for rename
+#include <string.h> // for memcmp
+#ifdef Q_OS_WIN
+#include <io.h> // for _commit
+#else
+#include <fcntl.h> // for open
+#include <unistd.h> // for fsync, close
+#endif
+#include "library.h"
+#include "libraryfile.h"
+#include "log.h"
+#include "metrics.h"
+#include "patch.h"
+#include "sequence.h"
+#include "trace.h"
+
+
+static const char MAGIC[8] = {'S', 'H', 'R', 'J', 'R', 'N', 'L', '\0'};
+static const quint32 VERSION = 1;
+static const int HEADER_SIZE = 12;
+static const int RECORD_HEADER_SIZE = 7; // sequence number, operation, size
+static const int RECORD_HASH_SIZE = 4;
+
+const int LibraryJournal::MAX_RETRY_SHIFT;
+
+
+// Waits until the data of the file is on the disk, not only in the cache of
+// the OS, so it survives a power loss:
+static bool syncFile(QFile &file) {
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+
+// Same for the directory entries, so a rename() is durable (POSIX only):
+static bool syncDirectory(const QString &path) {
+#ifdef Q_OS_WIN
+    Q_UNUSED(path);
+    return true;
+#else
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool status = fsync(fd) == 0;
+    ::close(fd);
+    return status;
+#endif
+}
+
+
+static quint32 readUInt32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((quint32) p[3] << 24);
+}
+
+
+static void appendUInt32(QByteArray &data, const quint32 &value) {
+    data.append((char) (value & 0xff));
+    data.append((char) ((value >> 8) & 0xff));
+    data.append((char) ((value >> 16) & 0xff));
+    data.append((char) ((value >> 24) & 0xff));
+}
+
+
+static quint32 hash(const unsigned char *data, const int &len) {
+    // Bob Jenkins' One-at-a-Time Hash, like Library::calculateHash()
+    quint32 h = 0;
+    for (int i = 0; i < len; i++) {
+        h += data[i];
+        h += (h << 10);
+        h ^= (h >> 6);
+    }
+    h += (h << 3);
+    h ^= (h >> 11);
+    h += (h << 15);
+    return h;
+}
+
+
+static unsigned char packPatchFlags(const bool &edited, const bool &moved) {
+    return (edited ? LibraryFile::PATCH_EDITED : 0) | (moved ? LibraryFile::PATCH_MOVED : 0);
+}
+
+
+static unsigned char packSequenceFlags(const bool &edited, const bool &moved) {
+    return (edited ? LibraryFile::SEQUENCE_EDITED : 0) | (moved ? LibraryFile::SEQUENCE_MOVED : 0);
+}
+
+
+LibraryJournal::LibraryJournal(const QString &directory):
+    directory(directory),
+    journalPath(QDir(directory).filePath("library.journal")),
+    snapshotPath(QDir(directory).filePath("library.slb")),
+    lastSequence(0),
+    mReplaced(false),
+    mFailures(0),
+    mRetryAt(0) {
+}
+
+
+LibraryJournal::~LibraryJournal() {
+    file.close();
+}
+
+
+QString LibraryJournal::defaultDirectory() {
+    // Next to the settings:
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "shruthi-editor", "Shruthi-Editor");
+    return QFileInfo(settings.fileName()).absolutePath();
+}
+
+
+bool LibraryJournal::replay(Library &library) {
+    QDir().mkpath(directory);
+
+    // The snapshot:
+    const qint64 &start = Trace::now();
+    quint32 snapshotSequence = 0;
+    if (QFile::exists(snapshotPath)) {
+        LibraryFile snapshot;
+        int hardwarePrograms = 0;
+        if (snapshot.open(snapshotPath)) {
+            snapshotSequence = snapshot.journalSequence();
+            hardwarePrograms = snapshot.hardwarePrograms();
+        }
+        snapshot.close();
+        if (hardwarePrograms > 0) {
+            library.setNumberOfHWPrograms(hardwarePrograms);
+        }
+        if (!library.openIndexed(snapshotPath)) {
+            LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::replay(): could not open" << snapshotPath;
+        }
+    }
+    lastSequence = snapshotSequence;
+
+    // The edits since:
+    int applied = 0;
+    int valid = 0; // end of the last intact record
+    QFile journal(journalPath);
+    if (journal.open(QIODevice::ReadOnly)) {
+        const QByteArray &data = journal.readAll();
+        journal.close();
+        const unsigned char *p = (const unsigned char*) data.constData();
+        if (data.size() >= HEADER_SIZE && memcmp(p, MAGIC, sizeof(MAGIC)) == 0) {
+            valid = HEADER_SIZE;
+            while (valid + RECORD_HEADER_SIZE <= data.size()) {
+                const unsigned char *record = p + valid;
+                const int &size = record[5] | (record[6] << 8);
+                const int &length = RECORD_HEADER_SIZE + size + RECORD_HASH_SIZE;
+                if (valid + length > data.size() || readUInt32(record + RECORD_HEADER_SIZE + size) != hash(record, RECORD_HEADER_SIZE + size)) {
+                    LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::replay(): dropped a torn record at" << valid;
+                    break;
+                }
+                const quint32 &sequence = readUInt32(record);
+                if (record[4] == REPLACED && sequence > snapshotSequence) {
+                    // The replacing library never made it into a snapshot;
+                    // continue with the old one:
+                    LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::replay(): the library was replaced after record" << lastSequence
+                                                      << ", the new one was not saved.";
+                    break;
+                }
+                if (sequence > snapshotSequence) {
+                    if (!apply(library, record[4], record + RECORD_HEADER_SIZE, size)) {
+                        LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::replay(): invalid record" << sequence;
+                        break;
+                    }
+                    applied++;
+                }
+                lastSequence = std::max(lastSequence, sequence);
+                valid += length;
+            }
+        }
+    }
+    static MetricsHistogram *replayTime = Metrics::histogram("journal.replay");
+    replayTime->record(Trace::now() - start);
+    LOG_INFO(LogCategory::LIBRARY) << "LibraryJournal::replay(): applied" << applied << "edits to the snapshot";
+
+    // Continue after the last intact record:
+    if (!file.isOpen() && valid > 0) {
+        file.setFileName(journalPath);
+        if (file.open(QIODevice::ReadWrite) && file.resize(valid) && file.seek(valid)) {
+            return true;
+        }
+        file.close();
+    }
+    return open();
+}
+
+
+bool LibraryJournal::open() {
+    // Starts an empty journal:
+    file.close();
+    file.setFileName(journalPath);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::open(): could not open" << journalPath;
+        return false;
+    }
+    QByteArray header(MAGIC, sizeof(MAGIC));
+    appendUInt32(header, VERSION);
+    if (file.write(header) != header.size() || !file.flush()) {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+
+bool LibraryJournal::apply(Library &library, const unsigned char &operation, const unsigned char *payload, const int &size) {
+    const int &programs = library.getNumberOfPrograms();
+    const int &first = size >= 4 ? (int) readUInt32(payload) : -1;
+    const int &second = size >= 8 ? (int) readUInt32(payload + 4) : -1;
+    switch (operation) {
+        case PATCH: {
+            Patch patch;
+            if (size < 5 + 92 || first < 0 || !patch.unpackData(payload + 5)) {
+                return false;
+            }
+            library.restorePatch(first, &patch, payload[4] & LibraryFile::PATCH_EDITED, payload[4] & LibraryFile::PATCH_MOVED);
+            return true;
+        }
+        case SEQUENCE: {
+            Sequence sequence;
+            if (size < 5 + 32 || first < 0) {
+                return false;
+            }
+            sequence.unpackData(payload + 5);
+            library.restoreSequence(first, &sequence, payload[4] & LibraryFile::SEQUENCE_EDITED, payload[4] & LibraryFile::SEQUENCE_MOVED);
+            return true;
+        }
+        case PATCH_FLAGS:
+            if (size < 5 || first < 0 || first >= programs) {
+                return false;
+            }
+            library.restorePatch(first, NULL, payload[4] & LibraryFile::PATCH_EDITED, payload[4] & LibraryFile::PATCH_MOVED);
+            return true;
+        case SEQUENCE_FLAGS:
+            if (size < 5 || first < 0 || first >= programs) {
+                return false;
+            }
+            library.restoreSequence(first, NULL, payload[4] & LibraryFile::SEQUENCE_EDITED, payload[4] & LibraryFile::SEQUENCE_MOVED);
+            return true;
+        case MOVE_PATCH:
+        case MOVE_SEQUENCE:
+            if (first < 0 || first >= programs || second < 0 || second >= programs) {
+                return false;
+            }
+            if (operation == MOVE_PATCH) {
+                library.movePatch(first, second);
+            } else {
+                library.moveSequence(first, second);
+            }
+            return true;
+        case REMOVE:
+            if (first < 0 || second < first || second >= programs) {
+                return false;
+            }
+            library.remove(first, second);
+            return true;
+        case INSERT:
+            if (first < 0 || first > programs) {
+                return false;
+            }
+            library.insert(first);
+            return true;
+        case RESET: {
+            const int &third = size >= 12 ? (int) readUInt32(payload + 8) : -1;
+            if (second < 0 || third < second || third >= programs) {
+                return false;
+            }
+            library.reset(first, second, third);
+            return true;
+        }
+        case GROW:
+            if (first < 0) {
+                return false;
+            }
+            library.growVectorsTo(first);
+            return true;
+        case HARDWARE_PROGRAMS:
+            if (first <= 0) {
+                return false;
+            }
+            library.setNumberOfHWPrograms(first);
+            return true;
+    }
+    return false;
+}
+
+
+void LibraryJournal::append(const unsigned char &operation, const QByteArray &payload) {
+    if (!file.isOpen() || mReplaced) {
+        return;
+    }
+    QByteArray record;
+    record.reserve(RECORD_HEADER_SIZE + payload.size() + RECORD_HASH_SIZE);
+    appendUInt32(record, ++lastSequence);
+    record.append((char) operation);
+    record.append((char) (payload.size() & 0xff));
+    record.append((char) ((payload.size() >> 8) & 0xff));
+    record.append(payload);
+    appendUInt32(record, hash((const unsigned char*) record.constData(), record.size()));
+
+    // Flushed to the OS, so it survives a crash of the editor:
+    if (file.write(record) != record.size() || !file.flush()) {
+        LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::append(): could not write" << journalPath;
+    }
+    static MetricsCounter *records = Metrics::counter("journal.records");
+    records->add();
+}
+
+
+bool LibraryJournal::needsCompaction() const {
+    if (mFailures > 0 && Trace::now() < mRetryAt) {
+        return false; // backing off after a failed compact()
+    }
+    return file.isOpen() && (mReplaced || file.size() > MAX_JOURNAL_SIZE);
+}
+
+
+const int &LibraryJournal::compactionFailures() const {
+    return mFailures;
+}
+
+
+bool LibraryJournal::isRecording() const {
+    return file.isOpen() && !mReplaced;
+}
+
+
+bool LibraryJournal::isClean() const {
+    return !mReplaced && (!file.isOpen() || file.size() <= HEADER_SIZE);
+}
+
+
+bool LibraryJournal::compact(const Library &library) {
+    const qint64 &start = Trace::now();
+    QByteArray data;
+    library.serializeIndexed(data, lastSequence);
+
+    const QString &temporary = snapshotPath + ".part";
+    QFile snapshot(temporary);
+    bool status = snapshot.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+            snapshot.write(data) == data.size() && snapshot.flush() && syncFile(snapshot);
+    snapshot.close();
+
+    // rename() replaces the old snapshot atomically on POSIX systems. Where
+    // it can't replace files, the old snapshot is removed first.
+    if (status && rename(QFile::encodeName(temporary).constData(), QFile::encodeName(snapshotPath).constData()) != 0) {
+        QFile::remove(snapshotPath);
+        status = QFile::rename(temporary, snapshotPath);
+    }
+    // The new snapshot must be on the disk before the journal is emptied:
+    status = status && syncDirectory(directory);
+    if (!status) {
+        // Only the first failure is reported; retries back off, so a full
+        // disk doesn't rewrite the library after every edit.
+        if (mFailures == 0) {
+            LOG_WARNING(LogCategory::LIBRARY) << "LibraryJournal::compact(): could not write" << snapshotPath;
+        }
+        mFailures++;
+        mRetryAt = Trace::now() + (qint64) RETRY_INTERVAL * (1 << std::min(mFailures - 1, MAX_RETRY_SHIFT));
+        QFile::remove(temporary);
+        return false;
+    }
+
+    // All records are in the snapshot now:
+    mReplaced = false;
+    mFailures = 0;
+    open();
+
+    static MetricsHistogram *compaction = Metrics::histogram("journal.compaction");
+    compaction->record(Trace::now() - start);
+    LOG_DEBUG(LogCategory::LIBRARY) << "LibraryJournal::compact():" << library.getNumberOfPrograms() << "programs";
+    return true;
+}
+
+
+void LibraryJournal::patch(const int &id, const Patch &patch, const bool &edited, const bool &moved) {
+    unsigned char data[92];
+    patch.packData(data);
+    QByteArray payload;
+    appendUInt32(payload, id);
+    payload.append((char) packPatchFlags(edited, moved));
+    payload.append((const char*) data, 92);
+    append(PATCH, payload);
+}
+
+
+void LibraryJournal::sequence(const int &id, const Sequence &sequence, const bool &edited, const bool &moved) {
+    unsigned char data[32];
+    sequence.packData(data);
+    QByteArray payload;
+    appendUInt32(payload, id);
+    payload.append((char) packSequenceFlags(edited, moved));
+    payload.append((const char*) data, 32);
+    append(SEQUENCE, payload);
+}
+
+
+void LibraryJournal::patchFlags(const int &id, const bool &edited, const bool &moved) {
+    QByteArray payload;
+    appendUInt32(payload, id);
+    payload.append((char) packPatchFlags(edited, moved));
+    append(PATCH_FLAGS, payload);
+}
+
+
+void LibraryJournal::sequenceFlags(const int &id, const bool &edited, const bool &moved) {
+    QByteArray payload;
+    appendUInt32(payload, id);
+    payload.append((char) packSequenceFlags(edited, moved));
+    append(SEQUENCE_FLAGS, payload);
+}
+
+
+void LibraryJournal::movePatch(const int &from, const int &to) {
+    QByteArray payload;
+    appendUInt32(payload, from);
+    appendUInt32(payload, to);
+    append(MOVE_PATCH, payload);
+}
+
+
+void LibraryJournal::moveSequence(const int &from, const int &to) {
+    QByteArray payload;
+    appendUInt32(payload, from);
+    appendUInt32(payload, to);
+    append(MOVE_SEQUENCE, payload);
+}
+
+
+void LibraryJournal::remove(const int &from, const int &to) {
+    QByteArray payload;
+    appendUInt32(payload, from);
+    appendUInt32(payload, to);
+    append(REMOVE, payload);
+}
+
+
+void LibraryJournal::insert(const int &id) {
+    QByteArray payload;
+    appendUInt32(payload, id);
+    append(INSERT, payload);
+}
+
+
+void LibraryJournal::reset(const int &flags, const int &from, const int &to) {
+    QByteArray payload;
+    appendUInt32(payload, flags);
+    appendUInt32(payload, from);
+    appendUInt32(payload, to);
+    append(RESET, payload);
+}
+
+
+void LibraryJournal::grow(const int &num) {
+    QByteArray payload;
+    appendUInt32(payload, num);
+    append(GROW, payload);
+}
+
+
+void LibraryJournal::hardwarePrograms(const int &num) {
+    QByteArray payload;
+    appendUInt32(payload, num);
+    append(HARDWARE_PROGRAMS, payload);
+}
+
+
+void LibraryJournal::replaced() {
+    // Cheaper to write a new snapshot than to journal every program. The
+    // marker keeps replay from applying later records to the old snapshot
+    // if the new one can't be written:
+    if (!mReplaced) {
+        append(REPLACED, QByteArray());
+        mReplaced = true;
+    }
+}
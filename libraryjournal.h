@@ -0,0 +1,122 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_LIBRARYJOURNAL_H
+#define SHRUTHI_LIBRARYJOURNAL_H
+
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+class Library;
+class Patch;
+class Sequence;
+
+
+// Append-only journal of library edits, so a crash doesn't lose them.
+//
+// The journal directory holds a snapshot of the library (library.slb, see
+// LibraryFile) and the edits made since (library.journal). Every edit appends
+// one small record; when the journal gets big, or after the whole library was
+// replaced, compact() writes a new snapshot and empties the journal. The
+// editor also compacts on exit, so a normal startup only opens the snapshot.
+//
+// On startup, replay() maps the snapshot (the programs are decoded when they
+// are used, the library window is filled from the names and hashes in the
+// file) and applies the journal. The snapshot also restores the number of
+// programs on the Shruthi; the flags of each program tell whether it differs
+// from the one on the Shruthi.
+//
+// Journal layout (little endian): "SHRJRNL\0", u32 format version, then the
+// records: u32 sequence number, u8 operation, u16 payload size, payload, u32
+// hash of the preceding bytes of the record. A torn record at the end (the
+// editor crashed while writing it) is dropped. The snapshot stores the
+// sequence number of the last record it contains, so records that made it
+// into the snapshot are skipped if the editor crashed during compact().
+//
+// Replacing the library writes a REPLACED record, and nothing is recorded
+// until the snapshot of the new library was written: the records would
+// belong to a library that isn't on the disk. Replay stops at the marker.
+class LibraryJournal {
+    public:
+        // Operations:
+        static const unsigned char PATCH = 1; // u32 id, u8 flags, 92 bytes
+        static const unsigned char SEQUENCE = 2; // u32 id, u8 flags, 32 bytes
+        static const unsigned char PATCH_FLAGS = 3; // u32 id, u8 flags
+        static const unsigned char SEQUENCE_FLAGS = 4; // u32 id, u8 flags
+        static const unsigned char MOVE_PATCH = 5; // u32 from, u32 to
+        static const unsigned char MOVE_SEQUENCE = 6; // u32 from, u32 to
+        static const unsigned char REMOVE = 7; // u32 from, u32 to
+        static const unsigned char INSERT = 8; // u32 id
+        static const unsigned char RESET = 9; // u32 flags, u32 from, u32 to
+        static const unsigned char GROW = 10; // u32 number of programs
+        static const unsigned char HARDWARE_PROGRAMS = 11; // u32 number of programs
+        static const unsigned char REPLACED = 12; // no payload, replay stops here
+
+        static const qint64 MAX_JOURNAL_SIZE = 1048576; // compact above
+        static const int RETRY_INTERVAL = 10000000; // us, after a failed compact(), doubled per failure
+        static const int MAX_RETRY_SHIFT = 5; // up to 320 s
+
+        LibraryJournal(const QString &directory);
+        ~LibraryJournal();
+
+        static QString defaultDirectory();
+
+        bool replay(Library &library);
+        bool needsCompaction() const;
+        bool isClean() const; // nothing happened since the last snapshot
+        bool compact(const Library &library);
+        const int &compactionFailures() const; // in a row
+        bool isRecording() const; // false while a replaced library waits for its snapshot
+
+        // Recording (called by Library):
+        void patch(const int &id, const Patch &patch, const bool &edited, const bool &moved);
+        void sequence(const int &id, const Sequence &sequence, const bool &edited, const bool &moved);
+        void patchFlags(const int &id, const bool &edited, const bool &moved);
+        void sequenceFlags(const int &id, const bool &edited, const bool &moved);
+        void movePatch(const int &from, const int &to);
+        void moveSequence(const int &from, const int &to);
+        void remove(const int &from, const int &to);
+        void insert(const int &id);
+        void reset(const int &flags, const int &from, const int &to);
+        void grow(const int &num);
+        void hardwarePrograms(const int &num);
+        void replaced(); // the whole library changed
+
+    private:
+        LibraryJournal(const LibraryJournal&); //forbid copying
+        LibraryJournal &operator=(const LibraryJournal&); //forbid assignment
+
+        bool open();
+        void append(const unsigned char &operation, const QByteArray &payload);
+        bool apply(Library &library, const unsigned char &operation, const unsigned char *payload, const int &size);
+
+        QString directory;
+        QString journalPath;
+        QString snapshotPath;
+        QFile file;
+        quint32 lastSequence;
+        bool mReplaced;
+        int mFailures;
+        qint64 mRetryAt;
+};
+
+
+#endif // SHRUTHI_LIBRARYJOURNAL_H
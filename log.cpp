@@ -0,0 +1,399 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "log.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtGlobal>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+
+#ifdef DEBUGMSGS
+#define DEFAULT_LEVEL LogLevel::DEBUG
+#else
+#define DEFAULT_LEVEL LogLevel::INFO
+#endif
+
+
+// one entry per LogCategory:
+int Log::thresholds[LogCategory::COUNT] = {
+    DEFAULT_LEVEL, DEFAULT_LEVEL, DEFAULT_LEVEL, DEFAULT_LEVEL, DEFAULT_LEVEL, DEFAULT_LEVEL
+};
+
+
+static const char *categoryNames[LogCategory::COUNT] = {
+    "general", "midi", "library", "patch", "editor", "fileio"
+};
+
+
+static const char *levelNames[LogLevel::OFF + 1] = {
+    "trace", "debug", "info", "warning", "critical", "off"
+};
+
+
+//
+// Ring buffer
+//
+
+
+// Bounded multi-producer queue. Each slot carries a sequence number: a
+// producer claims slot n by moving tail from n to n+1 once the slot's sequence
+// is n, fills it and publishes it by setting the sequence to n+1. The drain
+// thread (the only consumer) frees it again by setting it to n+BUFFER_SIZE.
+static const int BUFFER_SIZE = 1024; // has to be a power of two
+static const int TEXT_SIZE = 240;
+
+
+struct LogSlot {
+    QAtomicInt sequence;
+    int category;
+    int level;
+    qint64 time;
+    char text[TEXT_SIZE];
+};
+
+
+class LogBuffer {
+    public:
+        LogBuffer(): tail(0), head(0) {
+            for (int i = 0; i < BUFFER_SIZE; i++) {
+                entries[i].sequence.fetchAndStoreRelaxed(i);
+            }
+            timer.start();
+        }
+
+        bool push(const int &category, const int &level, const std::string &text) {
+            int pos = tail.fetchAndAddRelaxed(0);
+            LogSlot *slot;
+            for (;;) {
+                slot = &entries[pos & (BUFFER_SIZE - 1)];
+                const int &diff = (int) ((unsigned int) slot->sequence.fetchAndAddAcquire(0) - (unsigned int) pos);
+                if (diff == 0) {
+                    if (tail.testAndSetRelaxed(pos, next(pos))) {
+                        break;
+                    }
+                    pos = tail.fetchAndAddRelaxed(0);
+                } else if (diff < 0) {
+                    // full
+                    dropped.fetchAndAddRelaxed(1);
+                    return false;
+                } else {
+                    pos = tail.fetchAndAddRelaxed(0);
+                }
+            }
+
+            slot->category = category;
+            slot->level = level;
+            slot->time = timer.elapsed();
+            strncpy(slot->text, text.c_str(), TEXT_SIZE - 1);
+            slot->text[TEXT_SIZE - 1] = 0;
+            slot->sequence.fetchAndStoreRelease(next(pos));
+            return true;
+        }
+
+        // Only called by the consumer.
+        bool pop(LogSlot *out) {
+            LogSlot *slot = &entries[head & (BUFFER_SIZE - 1)];
+            if (slot->sequence.fetchAndAddAcquire(0) != next(head)) {
+                return false; // empty
+            }
+            out->category = slot->category;
+            out->level = slot->level;
+            out->time = slot->time;
+            memcpy(out->text, slot->text, TEXT_SIZE);
+            slot->sequence.fetchAndStoreRelease((int) ((unsigned int) head + BUFFER_SIZE));
+            head = next(head);
+            return true;
+        }
+
+        static int next(const int &pos) {
+            return (int) ((unsigned int) pos + 1);
+        }
+
+        LogSlot entries[BUFFER_SIZE];
+        QAtomicInt tail;
+        int head;
+        QAtomicInt dropped;
+        QElapsedTimer timer;
+};
+
+
+static LogBuffer logBuffer;
+static QAtomicInt logRunning(0);
+
+
+static void print(const int &category, const int &level, const qint64 &time, const char *text) {
+    FILE *out = level >= LogLevel::WARNING ? stderr : stdout;
+    fprintf(out, "%6lld.%03lld %s %s: %s\n", (long long) time / 1000, (long long) time % 1000,
+            levelNames[level], categoryNames[category], text);
+}
+
+
+static bool drain() {
+    LogSlot slot;
+    bool any = false;
+    while (logBuffer.pop(&slot)) {
+        print(slot.category, slot.level, slot.time, slot.text);
+        any = true;
+    }
+    if (any) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return any;
+}
+
+
+class LogWriter : public QThread {
+    protected:
+        void run() {
+            while (logRunning.fetchAndAddRelaxed(0)) {
+                if (!drain()) {
+                    msleep(10);
+                }
+            }
+            drain();
+        }
+};
+
+
+static LogWriter *logWriter = NULL;
+
+
+//
+// Qt messages
+//
+
+
+static void handleQtMessage(const QtMsgType &type, const char *msg) {
+    int level = LogLevel::INFO;
+    switch (type) {
+        case QtDebugMsg:
+            level = LogLevel::DEBUG;
+            break;
+        case QtWarningMsg:
+            level = LogLevel::WARNING;
+            break;
+        case QtCriticalMsg:
+            level = LogLevel::CRITICAL;
+            break;
+        case QtFatalMsg:
+            fprintf(stderr, "%s\n", msg);
+            abort();
+        default:
+            break;
+    }
+    if (Log::enabled(LogCategory::GENERAL, level)) {
+        Log::write(LogCategory::GENERAL, level, msg);
+    }
+}
+
+
+#if QT_VERSION >= 0x050000
+static void qtMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
+    Q_UNUSED(context);
+    handleQtMessage(type, msg.toLocal8Bit().constData());
+}
+#else
+static void qtMessageHandler(QtMsgType type, const char *msg) {
+    handleQtMessage(type, msg);
+}
+#endif
+
+
+//
+// Log
+//
+
+
+void Log::start() {
+    const char *spec = getenv("SHRUTHI_LOG");
+    if (spec) {
+        configure(spec);
+    }
+
+    if (logWriter) {
+        return;
+    }
+    logRunning.fetchAndStoreOrdered(1);
+    logWriter = new LogWriter();
+    logWriter->start();
+
+#if QT_VERSION >= 0x050000
+    qInstallMessageHandler(qtMessageHandler);
+#else
+    qInstallMsgHandler(qtMessageHandler);
+#endif
+}
+
+
+void Log::stop() {
+    if (!logWriter) {
+        return;
+    }
+#if QT_VERSION >= 0x050000
+    qInstallMessageHandler(0);
+#else
+    qInstallMsgHandler(0);
+#endif
+
+    logRunning.fetchAndStoreOrdered(0);
+    logWriter->wait();
+    delete logWriter;
+    logWriter = NULL;
+
+    const unsigned int &lost = dropped();
+    if (lost > 0) {
+        fprintf(stderr, "%u log messages were dropped.\n", lost);
+    }
+}
+
+
+void Log::setLevel(const int &category, const int &level) {
+    if (category >= 0 && category < LogCategory::COUNT) {
+        thresholds[category] = level;
+    }
+}
+
+
+static int parseLevel(const std::string &name) {
+    for (int i = 0; i <= LogLevel::OFF; i++) {
+        if (name == levelNames[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+void Log::configure(const std::string &spec) {
+    // e.g. "info,library=trace,midi=debug"
+    std::string lower;
+    for (unsigned int i = 0; i < spec.size(); i++) {
+        lower += tolower(spec[i]);
+    }
+
+    size_t start = 0;
+    while (start <= lower.size()) {
+        size_t end = lower.find(',', start);
+        if (end == std::string::npos) {
+            end = lower.size();
+        }
+        const std::string &item = lower.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+
+        const size_t &eq = item.find('=');
+        if (eq == std::string::npos) {
+            const int &level = parseLevel(item);
+            if (level < 0) {
+                fprintf(stderr, "SHRUTHI_LOG: unknown level \"%s\".\n", item.c_str());
+                continue;
+            }
+            for (int i = 0; i < LogCategory::COUNT; i++) {
+                thresholds[i] = level;
+            }
+            continue;
+        }
+
+        const std::string &name = item.substr(0, eq);
+        const int &level = parseLevel(item.substr(eq + 1));
+        bool found = false;
+        for (int i = 0; i < LogCategory::COUNT; i++) {
+            if (name == categoryNames[i]) {
+                found = true;
+                if (level >= 0) {
+                    thresholds[i] = level;
+                }
+            }
+        }
+        if (!found || level < 0) {
+            fprintf(stderr, "SHRUTHI_LOG: can't parse \"%s\".\n", item.c_str());
+        }
+    }
+}
+
+
+void Log::write(const int &category, const int &level, const std::string &text) {
+    if (!logRunning.fetchAndAddRelaxed(0)) {
+        // Not started (yet), write synchronously.
+        print(category, level, logBuffer.timer.elapsed(), text.c_str());
+        return;
+    }
+    logBuffer.push(category, level, text);
+}
+
+
+unsigned int Log::dropped() {
+    return logBuffer.dropped.fetchAndAddRelaxed(0);
+}
+
+
+//
+// LogLine
+//
+
+
+LogLine::LogLine(const int &category, const int &level):
+    category(category),
+    level(level),
+    first(true) {
+}
+
+
+LogLine::~LogLine() {
+    Log::write(category, level, stream.str());
+}
+
+
+void LogLine::space() {
+    if (!first) {
+        stream << ' ';
+    }
+    first = false;
+}
+
+
+LogLine &LogLine::operator<<(const QString &value) {
+    space();
+    stream << value.toUtf8().constData();
+    return *this;
+}
+
+
+LogLine &LogLine::operator<<(const bool &value) {
+    space();
+    stream << (value ? "true" : "false");
+    return *this;
+}
+
+
+LogLine &LogLine::operator<<(const unsigned char &value) {
+    space();
+    stream << (int) value;
+    return *this;
+}
@@ -0,0 +1,112 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_LOG_H
+#define SHRUTHI_LOG_H
+
+
+#include <QString>
+#include <sstream>
+#include <string>
+
+
+namespace LogLevel {
+enum LogLevel {
+    TRACE, DEBUG, INFO, WARNING, CRITICAL, OFF
+};
+}
+
+
+namespace LogCategory {
+enum LogCategory {
+    GENERAL, MIDI, LIBRARY, PATCH, EDITOR, FILEIO, COUNT
+};
+}
+
+
+// Leveled, category filtered logging. Messages are put into a lock-free ring
+// buffer and written to stdout (warnings to stderr) by a background thread,
+// so logging never blocks on the terminal. If the buffer is full, messages are
+// dropped and counted.
+//
+// The levels are configured with the environment variable SHRUTHI_LOG, e.g.
+// SHRUTHI_LOG=debug or SHRUTHI_LOG=info,library=trace,midi=debug
+// The default level is info (debug if built with DEBUGMSGS).
+//
+// Use the LOG_* macros: the arguments aren't evaluated for disabled levels.
+class Log {
+    public:
+        static void start();
+        static void stop();
+
+        static inline bool enabled(const int &category, const int &level) {
+            return level >= thresholds[category];
+        }
+        static void setLevel(const int &category, const int &level);
+        static void configure(const std::string &spec);
+        static void write(const int &category, const int &level, const std::string &text);
+        static unsigned int dropped();
+
+    private:
+        Log(); // static only
+
+        static int thresholds[LogCategory::COUNT];
+};
+
+
+class LogLine {
+    public:
+        LogLine(const int &category, const int &level);
+        ~LogLine();
+
+        // Items are separated by spaces, like QDebug.
+        template <class T> LogLine &operator<<(const T &value) {
+            space();
+            stream << value;
+            return *this;
+        }
+        LogLine &operator<<(const QString &value);
+        LogLine &operator<<(const bool &value);
+        LogLine &operator<<(const unsigned char &value);
+
+    private:
+        LogLine(const LogLine&); //forbid copying
+        LogLine &operator=(const LogLine&); //forbid assignment
+
+        void space();
+
+        std::ostringstream stream;
+        int category;
+        int level;
+        bool first;
+};
+
+
+#define SHRUTHI_LOG(category, level) \
+    if (!Log::enabled(category, level)) {} else LogLine(category, level)
+
+#define LOG_TRACE(category) SHRUTHI_LOG(category, LogLevel::TRACE)
+#define LOG_DEBUG(category) SHRUTHI_LOG(category, LogLevel::DEBUG)
+#define LOG_INFO(category) SHRUTHI_LOG(category, LogLevel::INFO)
+#define LOG_WARNING(category) SHRUTHI_LOG(category, LogLevel::WARNING)
+#define LOG_CRITICAL(category) SHRUTHI_LOG(category, LogLevel::CRITICAL)
+
+
+#endif // SHRUTHI_LOG_H
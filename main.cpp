@@ -32,18 +32,36 @@
 #endif
 #include <QThread>
 #include <QMetaType>
+#include "broadcast.h"
 #include "config.h"
 #include "editor.h"
+#include "libraryjournal.h"
+#include "log.h"
+#include "metrics.h"
 #include "midiin.h"
+#include "midithru.h"
+#include "midiout.h"
+#include "patchgenerator.h"
 #include "queueitem.h"
+#include "rack.h"
+#include "session.h"
 #include "signalrouter.h"
+#include "trace.h"
+#include "virtualshruthi.h"
+#include "voiceallocator.h"
 #include "ui/keyboard_dialog.h"
 #include "ui/library_dialog.h"
 #include "ui/main_window.h"
+#include "ui/metrics_dialog.h"
+#include "ui/morph_dialog.h"
+#include "ui/recorder_dialog.h"
 #include "ui/sequence_editor.h"
 
 
 int main(int argc, char *argv[]) {
+    // Levels are read from SHRUTHI_LOG:
+    Log::start();
+
     qRegisterMetaType<QueueItem>("QueueItem");
     qRegisterMetaType<Config>("Config");
 
@@ -73,34 +91,119 @@ int main(int argc, char *argv[]) {
         app.setStyle(QStyleFactory::create("Fusion"));
 #endif
 
+        // --trace <path> records the latency of queue items and writes them
+        // as Chrome trace events on exit:
+        const int &traceArg = app.arguments().indexOf("--trace");
+        if (traceArg >= 0 && traceArg + 1 < app.arguments().size()) {
+            Trace::start();
+        }
+        QThread::currentThread()->setObjectName("GUI"); // names the trace threads
+
+        // --record-session <path> records the MIDI traffic with the Shruthi:
+        const int &recordArg = app.arguments().indexOf("--record-session");
+        if (recordArg >= 0 && recordArg + 1 < app.arguments().size()) {
+            MidiSession::startRecording(app.arguments().at(recordArg + 1));
+        }
+
+        // --virtual-shruthi publishes a simulated Shruthi as "Virtual Shruthi
+        // In/Out" ports, select them in the settings to use it:
+        VirtualShruthi virtualShruthi(1002, 2);
+        if (app.arguments().contains("--virtual-shruthi") && virtualShruthi.openVirtualPorts("Virtual Shruthi")) {
+            virtualShruthi.start();
+        }
+
         // Setup signalrouter
         SignalRouter sr;
         QThread srThread;
+        srThread.setObjectName("SignalRouter");
         sr.connect(&srThread, SIGNAL(started()), SLOT(run()));
         sr.moveToThread(&srThread);
 
         // Setup editor
         Editor editor;
         QThread editorThread;
+        editorThread.setObjectName("Editor");
         editor.connect(&editorThread, SIGNAL(started()), SLOT(run()));
         editor.moveToThread(&editorThread);
 
+        // Library edits are journaled and the library of the last session is
+        // restored; --no-journal starts with an empty library instead:
+        if (!app.arguments().contains("--no-journal")) {
+            editor.openJournal(LibraryJournal::defaultDirectory());
+        }
+
         // editor: incoming signals
         editor.connect(&sr, SIGNAL(editorProcess(QueueItem)), SLOT(process(QueueItem)));
+        editor.connect(&sr, SIGNAL(setMidiBackend(int)), SLOT(setMidiBackend(int)));
         editor.connect(&sr, SIGNAL(setMidiOutputPort(int)), SLOT(setMidiOutputPort(int)));
+        editor.connect(&sr, SIGNAL(setMidiVirtualPorts(bool)), SLOT(setMidiVirtualPorts(bool)));
         editor.connect(&sr, SIGNAL(setMidiChannel(unsigned char)), SLOT(setMidiChannel(unsigned char)));
         editor.connect(&sr, SIGNAL(setShruthiFilterBoard(int)), SLOT(setShruthiFilterBoard(int)));
 
+        // --polychain <channels> plays the Shruthis on these channels (e.g.
+        // "1,2,3,4") as one polyphonic instrument, --polychain-mode
+        // round-robin|oldest|lowest selects the voice allocation:
+        const int &polychainArg = app.arguments().indexOf("--polychain");
+        if (polychainArg >= 0 && polychainArg + 1 < app.arguments().size()) {
+            editor.getVoiceAllocator()->setChannels(app.arguments().at(polychainArg + 1));
+            const int &modeArg = app.arguments().indexOf("--polychain-mode");
+            if (modeArg >= 0 && modeArg + 1 < app.arguments().size()) {
+                editor.getVoiceAllocator()->setMode(app.arguments().at(modeArg + 1));
+            }
+        }
+
+        // --broadcast <port>[:<channel>],... mirrors the edits and sent
+        // patches to the Shruthis on these output ports:
+        const int &broadcastArg = app.arguments().indexOf("--broadcast");
+        if (broadcastArg >= 0 && broadcastArg + 1 < app.arguments().size()) {
+            editor.getBroadcast()->addOutputs(app.arguments().at(broadcastArg + 1));
+        }
+
+        // --random-seed <n> makes the random patches reproducible,
+        // --random-profile <profile>[,keep-filter][,keep-mod-matrix][,keep-sequencer]
+        // constrains them (profiles: random, bass, pad):
+        const int &seedArg = app.arguments().indexOf("--random-seed");
+        if (seedArg >= 0 && seedArg + 1 < app.arguments().size()) {
+            editor.getPatchGenerator()->seed(app.arguments().at(seedArg + 1).toULongLong());
+        }
+        const int &profileArg = app.arguments().indexOf("--random-profile");
+        if (profileArg >= 0 && profileArg + 1 < app.arguments().size()) {
+            editor.getPatchGenerator()->setProfile(app.arguments().at(profileArg + 1));
+        }
+
+        // Compare scheduled and actual delivery times of scheduled output:
+        if (app.arguments().contains("--measure-jitter")) {
+            editor.getMidiOut()->setJitterMeasurement(true);
+        }
+
 
         // Setup midiin
         MidiIn midiin;
         QThread midiinThread;
+        midiinThread.setObjectName("MIDI input");
         midiin.moveToThread(&midiinThread);
         midiinThread.start();
         // midiin: incoming signals
+        midiin.connect(&sr, SIGNAL(setMidiBackend(int)), SLOT(setMidiBackend(int)));
         midiin.connect(&sr, SIGNAL(setMidiInputPort(int)), SLOT(setMidiInputPort(int)));
         midiin.connect(&sr, SIGNAL(setShruthiFilterBoard(int)), SLOT(setShruthiFilterBoard(int)));
 
+        // Setup midithru (forwards directly to the editor's MidiOut)
+        MidiThru midithru(editor.getMidiOut(), false, editor.getVoiceAllocator());
+        midithru.moveToThread(&midiinThread);
+        // midithru: incoming signals
+        midithru.connect(&sr, SIGNAL(setMidiThruPort(int)), SLOT(setMidiThruPort(int)));
+        midithru.connect(&sr, SIGNAL(setMidiChannel(unsigned char)), SLOT(setMidiChannel(unsigned char)));
+        midithru.connect(&sr, SIGNAL(setShruthiFilterBoard(int)), SLOT(setShruthiFilterBoard(int)));
+
+        // Setup automation input (virtual port, translates CCs to NRPNs)
+        MidiThru automation(editor.getMidiOut(), true, editor.getVoiceAllocator());
+        automation.moveToThread(&midiinThread);
+        // automation: incoming signals
+        automation.connect(&sr, SIGNAL(setMidiVirtualPorts(bool)), SLOT(setVirtualPorts(bool)));
+        automation.connect(&sr, SIGNAL(setMidiChannel(unsigned char)), SLOT(setMidiChannel(unsigned char)));
+        automation.connect(&sr, SIGNAL(setShruthiFilterBoard(int)), SLOT(setShruthiFilterBoard(int)));
+
         // Setup main_window
         ShruthiEditorMainWindow *main_window = new ShruthiEditorMainWindow();
         main_window->setWindowIcon(QIcon(":/shruthi_editor.png"));
@@ -111,7 +214,10 @@ int main(int argc, char *argv[]) {
         main_window->connect(&editor, SIGNAL(redrawPatchParameter(int,int)), SLOT(redrawPatchParameter(int,int)));
         main_window->connect(&editor, SIGNAL(redrawPatchName(QString)), SLOT(redrawPatchName(QString)));
         main_window->connect(&sr, SIGNAL(setMidiInputPort(int)), SLOT(setMidiInputPort(int)));
+        main_window->connect(&sr, SIGNAL(setMidiBackend(int)), SLOT(setMidiBackend(int)));
         main_window->connect(&sr, SIGNAL(setMidiOutputPort(int)), SLOT(setMidiOutputPort(int)));
+        main_window->connect(&sr, SIGNAL(setMidiThruPort(int)), SLOT(setMidiThruPort(int)));
+        main_window->connect(&sr, SIGNAL(setMidiVirtualPorts(bool)), SLOT(setMidiVirtualPorts(bool)));
         main_window->connect(&sr, SIGNAL(setMidiChannel(unsigned char)), SLOT(setMidiChannel(unsigned char)));
         main_window->connect(&sr, SIGNAL(setShruthiFilterBoard(int)), SLOT(setShruthiFilterBoard(int)));
         main_window->connect(&editor, SIGNAL(midiOutputStatusChanged(bool)), SLOT(midiOutputStatusChanged(bool)));
@@ -119,6 +225,19 @@ int main(int argc, char *argv[]) {
         main_window->connect(&editor, SIGNAL(setStatusbarVersionLabel(QString)), SLOT(setStatusbarVersionLabel(QString)));
         main_window->connect(&midiin, SIGNAL(midiInputStatusChanged(bool)), SLOT(midiInputStatusChanged(bool)));
 
+        // Setup the rack: --device <input>:<output>:<channel>[:<filter board>]
+        // adds a Shruthi besides the editor's one, backups and restores run on
+        // all of them in parallel:
+        Rack rack;
+        for (int i = app.arguments().indexOf("--device"); i >= 0 && i + 1 < app.arguments().size();
+             i = app.arguments().indexOf("--device", i + 2)) {
+            rack.addDevice(app.arguments().at(i + 1));
+        }
+        rack.connect(&sr, SIGNAL(setMidiBackend(int)), SLOT(setMidiBackend(int)));
+        rack.connect(main_window, SIGNAL(rackBackup(QString)), SLOT(backup(QString)));
+        rack.connect(main_window, SIGNAL(rackRestore(QString)), SLOT(restore(QString)));
+        main_window->connect(&rack, SIGNAL(displayStatusbar(QString)), SLOT(displayStatusbar(QString)));
+
         // Setup keyboard
         KeyboardDialog keys;
         keys.connect(main_window, SIGNAL(showKeyboard()), SLOT(show()));
@@ -138,6 +257,33 @@ int main(int argc, char *argv[]) {
         lib.connect(&editor, SIGNAL(redrawLibraryPatchItem(int,QString,bool,bool,bool)), SLOT(redrawLibraryPatchItem(int,QString,bool,bool,bool)));
         lib.connect(&editor, SIGNAL(redrawLibrarySequenceItem(int,QString,bool,bool,bool)), SLOT(redrawLibrarySequenceItem(int,QString,bool,bool,bool)));
         lib.connect(&editor, SIGNAL(setNumberOfLibraryPrograms(int)), SLOT(setNumberOfLibraryPrograms(int)));
+        lib.connect(&editor, SIGNAL(fileProgress(int)), SLOT(setFileProgress(int)));
+
+        // Setup MetricsDialog
+        MetricsDialog metrics;
+        metrics.setWindowIcon(QIcon(":/shruthi_editor.png"));
+        metrics.connect(main_window, SIGNAL(showMetrics()), SLOT(show()));
+
+        // Setup MorphDialog (shown when a morph starts)
+        MorphDialog morph;
+        morph.setWindowIcon(QIcon(":/shruthi_editor.png"));
+        morph.connect(&editor, SIGNAL(morphStarted(QString,QString)), SLOT(morphStarted(QString,QString)));
+        morph.connect(&editor, SIGNAL(morphPositionChanged(int)), SLOT(morphPositionChanged(int)));
+        morph.connect(&editor, SIGNAL(morphStopped()), SLOT(morphStopped()));
+
+        // Setup RecorderDialog
+        RecorderDialog recorder;
+        recorder.setWindowIcon(QIcon(":/shruthi_editor.png"));
+        recorder.connect(main_window, SIGNAL(showRecorder()), SLOT(show()));
+        recorder.connect(&editor, SIGNAL(recorderStateChanged(bool,bool,QString)), SLOT(recorderStateChanged(bool,bool,QString)));
+
+        // --morph-cc <controller> drives the morph with a CC of the MIDI
+        // thru or automation input:
+        const int &morphArg = app.arguments().indexOf("--morph-cc");
+        if (morphArg >= 0 && morphArg + 1 < app.arguments().size()) {
+            midithru.setMorphController(app.arguments().at(morphArg + 1).toInt());
+            automation.setMorphController(app.arguments().at(morphArg + 1).toInt());
+        }
 
         // Start editor
         editorThread.start();
@@ -147,15 +293,36 @@ int main(int argc, char *argv[]) {
         sr.connect(main_window, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
         sr.connect(&sequence_editor, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
         sr.connect(&midiin, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
+        sr.connect(&midithru, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
+        sr.connect(&automation, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
         sr.connect(&keys, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
         sr.connect(&lib, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
+        sr.connect(&morph, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
+        sr.connect(&recorder, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
+        sr.connect(&editor, SIGNAL(enqueue(QueueItem)), SLOT(enqueue(QueueItem)));
         sr.connect(main_window, SIGNAL(settingsChanged(Config)), SLOT(settingsChanged(Config)));
 
         // start signal router
         srThread.start();
 
+        // --replay-session <path> feeds the input of a recorded session to the
+        // editor, --replay-speed <factor> changes the speed (0: no delays):
+        MidiReplay *replay = NULL;
+        const int &replayArg = app.arguments().indexOf("--replay-session");
+        if (replayArg >= 0 && replayArg + 1 < app.arguments().size()) {
+            const int &speedArg = app.arguments().indexOf("--replay-speed");
+            const double &speed = (speedArg >= 0 && speedArg + 1 < app.arguments().size()) ? app.arguments().at(speedArg + 1).toDouble() : 1;
+            replay = new MidiReplay(&midiin, app.arguments().at(replayArg + 1), speed);
+            replay->start();
+        }
+
         main_window->show();
         retVal= app.exec();
+        if (replay) {
+            replay->stop();
+            delete replay;
+        }
+        MidiSession::stopRecording();
 #ifdef DEBUGMSGS
         qDebug() << "main: shutting down...";
 
@@ -174,10 +341,21 @@ int main(int argc, char *argv[]) {
 #endif
         midiinThread.quit();
         midiinThread.wait(1000);
+
+        // --metrics-json <path> writes the metrics on exit:
+        const int &metricsArg = app.arguments().indexOf("--metrics-json");
+        if (metricsArg >= 0 && metricsArg + 1 < app.arguments().size()) {
+            Metrics::dump(app.arguments().at(metricsArg + 1).toStdString());
+        }
+        if (Trace::enabled()) {
+            Trace::stop();
+            Trace::dump(app.arguments().at(traceArg + 1).toStdString());
+        }
     }
 
 #ifdef DEBUGMSGS
     qDebug() << "return"<< retVal;
 #endif
+    Log::stop();
     return retVal;
 }
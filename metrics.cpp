@@ -0,0 +1,330 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "metrics.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutexLocker>
+#include <sstream>
+#include <string>
+
+
+//
+// MetricsCounter
+//
+
+
+MetricsCounter::MetricsCounter():
+    value(0) {
+}
+
+
+int MetricsCounter::get() {
+    return value.fetchAndAddRelaxed(0);
+}
+
+
+void MetricsCounter::reset() {
+    value.fetchAndStoreRelaxed(0);
+}
+
+
+//
+// MetricsGauge
+//
+
+
+MetricsGauge::MetricsGauge():
+    value(0),
+    maximum(0) {
+}
+
+
+void MetricsGauge::set(const int &v) {
+    value.fetchAndStoreRelaxed(v);
+    updateMax(v);
+}
+
+
+void MetricsGauge::add(const int &n) {
+    updateMax(value.fetchAndAddRelaxed(n) + n);
+}
+
+
+int MetricsGauge::get() {
+    return value.fetchAndAddRelaxed(0);
+}
+
+
+int MetricsGauge::max() {
+    return maximum.fetchAndAddRelaxed(0);
+}
+
+
+void MetricsGauge::reset() {
+    maximum.fetchAndStoreRelaxed(get());
+}
+
+
+void MetricsGauge::updateMax(const int &v) {
+    int current = maximum.fetchAndAddRelaxed(0);
+    while (v > current && !maximum.testAndSetRelaxed(current, v)) {
+        current = maximum.fetchAndAddRelaxed(0);
+    }
+}
+
+
+//
+// MetricsHistogram
+//
+
+
+MetricsHistogram::MetricsHistogram() {
+    reset();
+}
+
+
+void MetricsHistogram::record(const qint64 &us) {
+    int bucket = 0;
+    for (qint64 v = us; v > 1 && bucket < BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+
+    QMutexLocker locker(&mutex);
+    mCount++;
+    mSum += us;
+    if (us > mMax) {
+        mMax = us;
+    }
+    mBuckets[bucket]++;
+}
+
+
+void MetricsHistogram::reset() {
+    QMutexLocker locker(&mutex);
+    mCount = 0;
+    mSum = 0;
+    mMax = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        mBuckets[i] = 0;
+    }
+}
+
+
+qint64 MetricsHistogram::count() {
+    QMutexLocker locker(&mutex);
+    return mCount;
+}
+
+
+double MetricsHistogram::mean() {
+    QMutexLocker locker(&mutex);
+    return mCount > 0 ? (double) mSum / mCount : 0;
+}
+
+
+qint64 MetricsHistogram::max() {
+    QMutexLocker locker(&mutex);
+    return mMax;
+}
+
+
+qint64 MetricsHistogram::percentile(const double &p) {
+    QMutexLocker locker(&mutex);
+    if (mCount == 0) {
+        return 0;
+    }
+    // Upper bound of the bucket containing the p-th value:
+    const qint64 &rank = (qint64) (p * mCount + 0.5);
+    qint64 seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank && seen > 0) {
+            const qint64 &upper = ((qint64) 1 << (i + 1)) - 1;
+            return upper < mMax ? upper : mMax;
+        }
+    }
+    return mMax;
+}
+
+
+void MetricsHistogram::buckets(qint64 out[BUCKETS]) {
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < BUCKETS; i++) {
+        out[i] = mBuckets[i];
+    }
+}
+
+
+//
+// Metrics
+//
+
+
+struct MetricsRegistry {
+    MetricsRegistry() {
+        timer.start();
+    }
+
+    QMutex mutex;
+    std::map<std::string, MetricsCounter*> counters;
+    std::map<std::string, MetricsGauge*> gauges;
+    std::map<std::string, MetricsHistogram*> histograms;
+    QElapsedTimer timer;
+};
+
+
+static MetricsRegistry &registry() {
+    static MetricsRegistry r;
+    return r;
+}
+
+
+template <class T> static T *lookup(std::map<std::string, T*> &map, const std::string &name) {
+    QMutexLocker locker(&registry().mutex);
+    typename std::map<std::string, T*>::iterator it = map.find(name);
+    if (it != map.end()) {
+        return it->second;
+    }
+    T *metric = new T();
+    map[name] = metric;
+    return metric;
+}
+
+
+MetricsCounter *Metrics::counter(const std::string &name) {
+    return lookup(registry().counters, name);
+}
+
+
+MetricsGauge *Metrics::gauge(const std::string &name) {
+    return lookup(registry().gauges, name);
+}
+
+
+MetricsHistogram *Metrics::histogram(const std::string &name) {
+    return lookup(registry().histograms, name);
+}
+
+
+std::map<std::string, MetricsCounter*> Metrics::counters() {
+    QMutexLocker locker(&registry().mutex);
+    return registry().counters;
+}
+
+
+std::map<std::string, MetricsGauge*> Metrics::gauges() {
+    QMutexLocker locker(&registry().mutex);
+    return registry().gauges;
+}
+
+
+std::map<std::string, MetricsHistogram*> Metrics::histograms() {
+    QMutexLocker locker(&registry().mutex);
+    return registry().histograms;
+}
+
+
+void Metrics::reset() {
+    const std::map<std::string, MetricsCounter*> &c = counters();
+    for (std::map<std::string, MetricsCounter*>::const_iterator it = c.begin(); it != c.end(); ++it) {
+        it->second->reset();
+    }
+    const std::map<std::string, MetricsGauge*> &g = gauges();
+    for (std::map<std::string, MetricsGauge*>::const_iterator it = g.begin(); it != g.end(); ++it) {
+        it->second->reset();
+    }
+    const std::map<std::string, MetricsHistogram*> &h = histograms();
+    for (std::map<std::string, MetricsHistogram*>::const_iterator it = h.begin(); it != h.end(); ++it) {
+        it->second->reset();
+    }
+}
+
+
+qint64 Metrics::uptime() {
+    return registry().timer.elapsed();
+}
+
+
+static std::string quote(const std::string &s) {
+    std::string out = "\"";
+    for (unsigned int i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') {
+            out += '\\';
+        }
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+
+std::string Metrics::toJson() {
+    std::ostringstream os;
+    os << "{\n  \"uptime_ms\": " << uptime() << ",\n";
+
+    os << "  \"counters\": {";
+    const std::map<std::string, MetricsCounter*> &c = counters();
+    for (std::map<std::string, MetricsCounter*>::const_iterator it = c.begin(); it != c.end(); ++it) {
+        os << (it == c.begin() ? "\n" : ",\n") << "    " << quote(it->first) << ": " << it->second->get();
+    }
+    os << "\n  },\n";
+
+    os << "  \"gauges\": {";
+    const std::map<std::string, MetricsGauge*> &g = gauges();
+    for (std::map<std::string, MetricsGauge*>::const_iterator it = g.begin(); it != g.end(); ++it) {
+        os << (it == g.begin() ? "\n" : ",\n") << "    " << quote(it->first)
+           << ": {\"value\": " << it->second->get() << ", \"max\": " << it->second->max() << "}";
+    }
+    os << "\n  },\n";
+
+    os << "  \"histograms\": {";
+    const std::map<std::string, MetricsHistogram*> &h = histograms();
+    for (std::map<std::string, MetricsHistogram*>::const_iterator it = h.begin(); it != h.end(); ++it) {
+        MetricsHistogram *hist = it->second;
+        qint64 buckets[MetricsHistogram::BUCKETS];
+        hist->buckets(buckets);
+        os << (it == h.begin() ? "\n" : ",\n") << "    " << quote(it->first)
+           << ": {\"count\": " << hist->count()
+           << ", \"mean_us\": " << (qint64) hist->mean()
+           << ", \"p50_us\": " << hist->percentile(0.5)
+           << ", \"p90_us\": " << hist->percentile(0.9)
+           << ", \"p99_us\": " << hist->percentile(0.99)
+           << ", \"max_us\": " << hist->max()
+           << ", \"buckets\": [";
+        for (int i = 0; i < MetricsHistogram::BUCKETS; i++) {
+            os << (i ? ", " : "") << buckets[i];
+        }
+        os << "]}";
+    }
+    os << "\n  }\n}\n";
+    return os.str();
+}
+
+
+bool Metrics::dump(const std::string &path) {
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const std::string &json = toJson();
+    const qint64 &written = file.write(json.c_str(), json.size());
+    file.close();
+    return written == (qint64) json.size();
+}
@@ -0,0 +1,123 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_METRICS_H
+#define SHRUTHI_METRICS_H
+
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QtGlobal>
+#include <map>
+#include <string>
+
+
+class MetricsCounter {
+    public:
+        MetricsCounter();
+        inline void add(const int &n = 1) {
+            value.fetchAndAddRelaxed(n);
+        }
+        int get();
+        void reset();
+
+    private:
+        MetricsCounter(const MetricsCounter&); //forbid copying
+        MetricsCounter &operator=(const MetricsCounter&); //forbid assignment
+
+        QAtomicInt value;
+};
+
+
+// Current value and the maximum seen since the last reset.
+class MetricsGauge {
+    public:
+        MetricsGauge();
+        void set(const int &value);
+        void add(const int &n);
+        int get();
+        int max();
+        void reset();
+
+    private:
+        MetricsGauge(const MetricsGauge&); //forbid copying
+        MetricsGauge &operator=(const MetricsGauge&); //forbid assignment
+
+        void updateMax(const int &value);
+
+        QAtomicInt value;
+        QAtomicInt maximum;
+};
+
+
+// Durations in microseconds, in power of two buckets: bucket i holds values
+// in [2^i, 2^(i+1)), so percentiles are estimates.
+class MetricsHistogram {
+    public:
+        static const int BUCKETS = 26; // up to ~1 minute
+
+        MetricsHistogram();
+        void record(const qint64 &us);
+        void reset();
+
+        qint64 count();
+        double mean();
+        qint64 max();
+        qint64 percentile(const double &p);
+        void buckets(qint64 out[BUCKETS]);
+
+    private:
+        MetricsHistogram(const MetricsHistogram&); //forbid copying
+        MetricsHistogram &operator=(const MetricsHistogram&); //forbid assignment
+
+        QMutex mutex;
+        qint64 mCount;
+        qint64 mSum;
+        qint64 mMax;
+        qint64 mBuckets[BUCKETS];
+};
+
+
+// Process wide registry. Metrics are created on first use and live until the
+// program exits, so callers can keep the returned pointers, e.g.
+//   static MetricsCounter *bytes = Metrics::counter("midi.out.bytes");
+//   bytes->add(size);
+class Metrics {
+    public:
+        static MetricsCounter *counter(const std::string &name);
+        static MetricsGauge *gauge(const std::string &name);
+        static MetricsHistogram *histogram(const std::string &name);
+
+        static void reset();
+        static qint64 uptime();
+        static std::string toJson();
+        static bool dump(const std::string &path);
+
+        // For the metrics window:
+        static std::map<std::string, MetricsCounter*> counters();
+        static std::map<std::string, MetricsGauge*> gauges();
+        static std::map<std::string, MetricsHistogram*> histograms();
+
+    private:
+        Metrics(); // static only
+};
+
+
+#endif // SHRUTHI_METRICS_H
@@ -18,9 +18,7 @@
 
 
 #include "midi.h"
-#ifdef DEBUGMSGS
-#include <QDebug>
-#endif
+#include "log.h"
 
 
 #ifdef PRE094SYSEXHEADER
@@ -80,9 +78,7 @@ bool Midi::checkSysexHeadFoot(const Message *message) {
 bool Midi::checkSysexHeadFoot(const Message *message, const unsigned int start, const unsigned int end) {
     const unsigned int size = message->size();
 
-#ifdef DEBUGMSGS
-    qDebug() << "Midi::checkSysexHeadFoot()" << start << end << size;
-#endif
+    LOG_TRACE(LogCategory::MIDI) << "Midi::checkSysexHeadFoot()" << start << end << size;
 
     // Check if bounds are valid
     if (start >= end || end >= size) {
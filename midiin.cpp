@@ -18,13 +18,15 @@
 
 
 #include "midiin.h"
-#include <QDebug>
 #include <stddef.h> // for NULL
-#include <iostream>
 #include <string>
 #include "RtMidi.h"
+#include "log.h"
+#include "metrics.h"
 #include "midi.h"
 #include "patch.h"
+#include "rawmidi.h"
+#include "session.h"
 
 
 //
@@ -81,9 +83,7 @@ bool NRPN::parse(int b0, int b1, int b2) {
                 break;
         }
     }
-#ifdef DEBUGMSGS
-    qDebug() << "NRPN_Parser: Received unknown message:" << b0 << "," << b1 << "," << b2;
-#endif
+    LOG_TRACE(LogCategory::MIDI) << "NRPN_Parser: Received unknown message:" << b0 << "," << b1 << "," << b2;
     return false;
 }
 
@@ -96,10 +96,18 @@ bool NRPN::parse(int b0, int b1, int b2) {
 void MidiIn::process(const Message *message) {
     int size = message->size();
 
+    static MetricsCounter *bytes = Metrics::counter("midi.in.bytes");
+    static MetricsCounter *messages = Metrics::counter("midi.in.messages");
+    bytes->add(size);
+    messages->add();
+    MidiSession::record(MidiSession::IN, *message);
+
     if (size >= 4) {
         Message payload;
         if (!Midi::parseSysex(message, &payload)) {
             // We have a problem! Do something. Warn the user or make a cup of tea.
+            static MetricsCounter *errors = Metrics::counter("midi.in.sysex_errors");
+            errors->add();
             QueueItem signal(QueueAction::SYSEX_RECEIVED);
             signal.int0 = Midi::getCommand(message);
             signal.int1 = Midi::getArgument(message);
@@ -112,9 +120,7 @@ void MidiIn::process(const Message *message) {
         // version info has a SysEx size of 15/2 bytes payload
         if (payload.size() == 2 && Midi::getCommand(message) == 0x0c && Midi::getArgument(message) == 0x00) {
             firmwareVersion = payload.at(0) * 1000 + payload.at(1);
-#ifdef DEBUGMSGS
-            std::cout << "Firmware version: " << firmwareVersion << std::endl;
-#endif
+            LOG_DEBUG(LogCategory::MIDI) << "Firmware version:" << firmwareVersion;
         }
 
         unsigned char *msg = new unsigned char[payload.size()];
@@ -140,8 +146,7 @@ void MidiIn::process(const Message *message) {
             int value = Patch::convertCCValue(message->at(2), id, shruthiFilterBoard);
             if (!warnedCC) {
                 if (id == 25  || id == 29) {
-                    std::cout << "Received LFO Rate per CC. That's a bad idea...\nFurther warnings will be suppressed."
-                              << std::endl;
+                    LOG_WARNING(LogCategory::MIDI) << "Received LFO Rate per CC. That's a bad idea... Further warnings will be suppressed.";
                     warnedCC = true;
                 }
             }
@@ -160,9 +165,7 @@ void mycallback(double deltatime, Message *message, void *userData) {
 
 
 MidiIn::MidiIn() {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiIn::MidiIn()";
-#endif
+    LOG_DEBUG(LogCategory::MIDI) << "MidiIn::MidiIn()";
     opened = false;
     input = -1;
     firmwareVersion = 0;
@@ -172,6 +175,10 @@ MidiIn::MidiIn() {
 
     shruthiFilterBoard = 0;
 
+    backend = MidiBackend::SEQUENCER;
+    rawin = new RawMidiIn();
+    rawin->setCallback(&mycallback, this);
+
     try {
         midiin = new RtMidiIn(RtMidi::UNSPECIFIED, "shruthi-editor");
         midiin->setCallback(&mycallback,this);
@@ -179,60 +186,69 @@ MidiIn::MidiIn() {
     }
     catch (RtMidiError &error) {
         error.printMessage();
-        qWarning() << "MidiIn::MidiIn(): could not initilize midi port for reading.";
+        LOG_WARNING(LogCategory::MIDI) << "MidiIn::MidiIn(): could not initilize midi port for reading.";
     }
 }
 
 
 MidiIn::~MidiIn() {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiIn::~MidiIn()";
-#endif
+    LOG_DEBUG(LogCategory::MIDI) << "MidiIn::~MidiIn()";
     if (initialized) {
         initialized = false;
         delete midiin;
     }
+    delete rawin;
+}
+
+
+void MidiIn::setMidiBackend(int b) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiIn::setMidiBackend:" << b;
+    if (backend != b) {
+        close();
+        backend = b;
+        emit midiInputStatusChanged(opened);
+    }
 }
 
 
 void MidiIn::setMidiInputPort(int in) {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiIn::setMidiPorts";
-#endif
+    LOG_DEBUG(LogCategory::MIDI) << "MidiIn::setMidiPorts";
     open(in);
     emit midiInputStatusChanged(opened);
 }
 
 
 void MidiIn::setShruthiFilterBoard(int filter) {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiIn::setShruthiFilterBoard:" << filter;
-#endif
+    LOG_DEBUG(LogCategory::MIDI) << "MidiIn::setShruthiFilterBoard:" << filter;
     MidiIn::shruthiFilterBoard = filter;
 }
 
 
 bool MidiIn::open(const unsigned int &port) {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiIn::open(" << port << ")";
-#endif
-    if (!initialized) {
-        qDebug() << "MidiIn::open(): Can't open Midi port, RtMidi was not initialized.";
-        return false;
-    }
-
+    LOG_DEBUG(LogCategory::MIDI) << "MidiIn::open(" << port << ")";
     if (input == port && opened) {
         return true;
     }
 
-    if (opened) {
-        midiin->closePort();
-    }
+    close();
 
     firmwareVersion = 0;
 
+    if (backend == MidiBackend::RAWMIDI) {
+        opened = rawin->open(RawMidi::getInputDevice(port));
+        if (opened) {
+            input = port;
+        }
+        return opened;
+    }
+
+    if (!initialized) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiIn::open(): Can't open Midi port, RtMidi was not initialized.";
+        return false;
+    }
+
     if (port >= midiin->getPortCount()) {
-        qWarning() << "MidiIn::open(): trying to open midi port for reading which doesn't exist.";
+        LOG_WARNING(LogCategory::MIDI) << "MidiIn::open(): trying to open midi port for reading which doesn't exist.";
         opened = false;
         return false;
     }
@@ -242,15 +258,26 @@ bool MidiIn::open(const unsigned int &port) {
         opened = true;
     }
     catch (RtMidiError) {
-#ifdef DEBUGMSGS
-        qDebug() << "MidiIn::open(" << port << "): RtMidiError on openPort().";
-#endif
+        LOG_DEBUG(LogCategory::MIDI) << "MidiIn::open(" << port << "): RtMidiError on openPort().";
         opened = false;
     }
     if (opened) {
         input = port;
     } else {
-        qWarning() << "MidiIn::open(): could not open midi port for reading.";
+        LOG_WARNING(LogCategory::MIDI) << "MidiIn::open(): could not open midi port for reading.";
     }
     return opened;
 }
+
+
+void MidiIn::close() {
+    if (opened) {
+        if (rawin->isOpen()) {
+            rawin->close();
+        } else {
+            midiin->closePort();
+        }
+        opened = false;
+        input = -1;
+    }
+}
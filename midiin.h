@@ -24,6 +24,7 @@
 #include <QObject>
 #include "message.h"
 #include "queueitem.h"
+class RawMidiIn;
 class RtMidiIn;
 
 
@@ -55,11 +56,14 @@ class MidiIn : public QObject {
         MidiIn &operator=(const MidiIn&); //forbid assignment
 
         bool open(const unsigned int &port);
+        void close();
         bool isNRPN(const unsigned char &n0, const unsigned char &n1);
 
         NRPN nrpn;
 
         RtMidiIn* midiin;
+        RawMidiIn* rawin;
+        int backend;
         bool opened;
         unsigned int input;
         bool initialized;
@@ -78,6 +82,7 @@ class MidiIn : public QObject {
         int shruthiFilterBoard;
 
     public slots:
+        void setMidiBackend(int backend);
         void setMidiInputPort(int in);
         void setShruthiFilterBoard(int filter);
 
@@ -18,61 +18,105 @@
 
 
 #include "midiout.h"
-#include <QDebug>
+#include <QMutexLocker>
 #include <string>
 #include "RtMidi.h"
+#include "log.h"
+#include "metrics.h"
 #include "midi.h"
-
-
-MidiOut::MidiOut() {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiOut::MidiOut()";
-#endif
+#include "midischeduler.h"
+#include "rawmidi.h"
+#include "session.h"
+#include "trace.h"
+
+
+// Holds the output mutex; sends the queued thru messages before it is
+// released (see thru()).
+class OutputLocker {
+    public:
+        OutputLocker(MidiOut *out): out(out) {
+            out->mutex.lock();
+        }
+        ~OutputLocker() {
+            out->unlock();
+        }
+
+    private:
+        MidiOut *out;
+};
+
+
+MidiOut::MidiOut():
+    thruPending(0),
+    thruOpened(0) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiOut::MidiOut()";
     opened=false;
+    virtualPort = false;
     output=-1;
     initialized = false;
+    backend = MidiBackend::SEQUENCER;
+    rawout = new RawMidiOut();
+    scheduler = new MidiScheduler();
+    measureJitter = false;
+    schedulerFailed = false;
     try {
         midiout = new RtMidiOut(RtMidi::UNSPECIFIED, "shruthi-editor");
         initialized = true;
     }
     catch (RtMidiError &error) {
         error.printMessage();
-        qWarning() << "MidiOut::MidiOut(): could not initilize midi port for writing.";
+        LOG_WARNING(LogCategory::MIDI) << "MidiOut::MidiOut(): could not initilize midi port for writing.";
     }
 }
 
 
 MidiOut::~MidiOut() {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiOut::~MidiOut()";
-#endif
+    LOG_DEBUG(LogCategory::MIDI) << "MidiOut::~MidiOut()";
     if (initialized) {
         initialized = false;
         delete midiout;
     }
+    delete scheduler;
+    delete rawout;
 }
 
 
-bool MidiOut::open(const unsigned int &port) {
-#ifdef DEBUGMSGS
-    qDebug() << "MidiOut::open(" << port << ")";
-#endif
-    if (!initialized) {
-        qDebug() << "MidiOut::open(): Can't open Midi port, RtMidi was not initialized.";
-        return false;
+void MidiOut::setBackend(const int &b) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiOut::setBackend(" << b << ")";
+    OutputLocker locker(this);
+
+    if (backend != b) {
+        closePort();
+        backend = b;
     }
+}
 
 
-    if (output==port && opened) {
+bool MidiOut::open(const unsigned int &port) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiOut::open(" << port << ")";
+    OutputLocker locker(this);
+
+    if (output==port && opened && !virtualPort) {
         return true;
     }
 
-    if (opened) {
-        midiout->closePort();
+    closePort();
+
+    if (backend == MidiBackend::RAWMIDI) {
+        opened = rawout->open(RawMidi::getOutputDevice(port));
+        if (opened) {
+            output = port;
+        }
+        return opened;
+    }
+
+    if (!initialized) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::open(): Can't open Midi port, RtMidi was not initialized.";
+        return false;
     }
 
     if (port >= midiout->getPortCount()) {
-        qWarning() << "MidiOut::open(): trying to open midi port for writing which doesn't exist.";
+        LOG_WARNING(LogCategory::MIDI) << "MidiOut::open(): trying to open midi port for writing which doesn't exist.";
         opened = false;
         return false;
     }
@@ -81,35 +125,182 @@ bool MidiOut::open(const unsigned int &port) {
         opened = true;
     }
     catch (RtMidiError) {
-#ifdef DEBUGMSGS
-        qDebug() << "MidiOut::open(" << port << "): RtMidiError on openPort().";
-#endif
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::open(" << port << "): RtMidiError on openPort().";
         opened = false;
     }
     if (opened) {
         output = port;
+        if (measureJitter && openScheduler()) {
+            scheduler->probe(1000, 0.002);
+        }
     } else {
-        qWarning() << "MidiOut::open(): could not open midi port for writing.";
+        LOG_WARNING(LogCategory::MIDI) << "MidiOut::open(): could not open midi port for writing.";
     }
     return opened;
 }
 
 
-bool MidiOut::write(Message &sysex) {
-    if (!opened) {
-        qDebug() << "MidiOut::write(Message&): could not send. Port not opened.";
+bool MidiOut::openVirtual(const std::string &name) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiOut::openVirtual(" << name.c_str() << ")";
+    OutputLocker locker(this);
+
+    if (!initialized) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::openVirtual(): Can't open Midi port, RtMidi was not initialized.";
         return false;
     }
 
+    if (opened && virtualPort) {
+        return true;
+    }
+
+    closePort();
+
     try {
-        midiout->sendMessage(&sysex);
+        // Not supported by all apis (e.g. windows mm):
+        midiout->openVirtualPort(name);
+        opened = true;
+        virtualPort = true;
+    }
+    catch (RtMidiError &error) {
+        error.printMessage();
+        opened = false;
+        virtualPort = false;
+    }
+    if (!opened) {
+        LOG_WARNING(LogCategory::MIDI) << "MidiOut::openVirtual(): could not open virtual midi port for writing.";
+    }
+    return opened;
+}
+
+
+void MidiOut::close() {
+    OutputLocker locker(this);
+    closePort();
+}
+
+
+void MidiOut::closePort() {
+    // Note: the caller has to hold the mutex.
+    scheduler->close();
+    schedulerFailed = false;
+    if (opened) {
+        if (rawout->isOpen()) {
+            rawout->close();
+        } else {
+            midiout->closePort();
+        }
+        opened = false;
+        virtualPort = false;
+        output = -1;
+    }
+}
+
+
+bool MidiOut::isOpen() {
+    OutputLocker locker(this);
+    return opened;
+}
+
+
+bool MidiOut::write(Message &sysex) {
+    OutputLocker locker(this);
+    return send(sysex);
+}
+
+
+double MidiOut::time() {
+    OutputLocker locker(this);
+    return openScheduler() ? scheduler->time() : 0;
+}
+
+
+bool MidiOut::isScheduled() {
+    OutputLocker locker(this);
+    return openScheduler();
+}
+
+
+bool MidiOut::writeAt(Message &message, const double &time) {
+    OutputLocker locker(this);
+    return schedule(message, time);
+}
+
+
+bool MidiOut::schedule(Message &message, const double &time) {
+    if (openScheduler() && scheduler->schedule(message, time)) {
+        MidiSession::record(MidiSession::OUT, message); // recorded when scheduled
         return true;
     }
+    return send(message);
+}
+
+
+void MidiOut::setJitterMeasurement(const bool &enabled) {
+    OutputLocker locker(this);
+    measureJitter = enabled;
+    scheduler->setJitterMeasurement(enabled);
+}
+
+
+bool MidiOut::openScheduler() {
+    // Note: the caller has to hold the mutex.
+    if (!MidiScheduler::available() || schedulerFailed || !opened || virtualPort || rawout->isOpen()) {
+        return false;
+    }
+
+    std::string name;
+    try {
+        name = midiout->getPortName(output);
+    }
     catch (RtMidiError &error) {
-        qDebug() << "MidiOut::write(Message&): could not send. Error on sending.";
         error.printMessage();
+        return false;
+    }
+    if (scheduler->isOpen() && scheduler->getPortName() == name) {
+        return true;
     }
-    return false;
+    schedulerFailed = !scheduler->open(name);
+    return !schedulerFailed;
+}
+
+
+bool MidiOut::send(Message &message) {
+    // Note: the caller has to hold the mutex.
+    if (!opened) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::write(Message&): could not send. Port not opened.";
+        return false;
+    }
+
+    if (!virtualPort) {
+        static MetricsCounter *bytes = Metrics::counter("midi.out.bytes");
+        static MetricsCounter *messages = Metrics::counter("midi.out.messages");
+        bytes->add(message.size());
+        messages->add();
+        MidiSession::record(MidiSession::OUT, message);
+    }
+
+    const qint64 &start = Trace::enabled() ? Trace::now() : 0;
+    bool sent = false;
+    if (scheduler->isOpen()) {
+        // Everything for the port goes through one sequencer queue once
+        // scheduled output is used, so nothing gets between the messages
+        // of a scheduled NRPN:
+        sent = scheduler->send(message);
+    } else if (rawout->isOpen()) {
+        // Sends channel messages using running status.
+        sent = rawout->send(message);
+    } else {
+        try {
+            midiout->sendMessage(&message);
+            sent = true;
+        }
+        catch (RtMidiError &error) {
+            LOG_DEBUG(LogCategory::MIDI) << "MidiOut::write(Message&): could not send. Error on sending.";
+            error.printMessage();
+        }
+    }
+    Trace::complete(virtualPort ? "MidiOut::send (virtual)" : "MidiOut::send", Trace::current(), start, message.size());
+    return sent;
 }
 
 
@@ -151,12 +342,7 @@ bool MidiOut::request(const unsigned char &which) {
 }
 
 
-bool MidiOut::nrpn(const unsigned char &channel, const int &nrpn, const int &value) {
-    if (!opened) {
-        qDebug() << "MidiOut::nrpn(): could not send. Port not opened.";
-        return false;
-    }
-
+static void nrpnMessages(unsigned char messages[4][3], const unsigned char &channel, const int &nrpn, const int &value) {
     int nrpn_msb = nrpn >> 7;
     int nrpn_lsb = nrpn % 128;
     int value_msb = 0;
@@ -168,13 +354,187 @@ bool MidiOut::nrpn(const unsigned char &channel, const int &nrpn, const int &val
         value_msb = value >> 7;
         value_lsb = value % 128;
     }
-    return (write(176 | channel, 99, nrpn_msb) &&
-            write(176 | channel, 98, nrpn_lsb) &&
-            write(176 | channel, 6, value_msb) &&
-            write(176 | channel, 38, value_lsb));
+
+    const unsigned char controllers[4] = {99, 98, 6, 38};
+    const int values[4] = {nrpn_msb, nrpn_lsb, value_msb, value_lsb};
+    for (int i = 0; i < 4; i++) {
+        messages[i][0] = 176 | channel;
+        messages[i][1] = controllers[i];
+        messages[i][2] = values[i];
+    }
+}
+
+
+bool MidiOut::nrpn(const unsigned char &channel, const int &nrpn, const int &value) {
+    if (!opened) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::nrpn(): could not send. Port not opened.";
+        return false;
+    }
+
+    unsigned char messages[4][3];
+    nrpnMessages(messages, channel, nrpn, value);
+
+    // Keep the four controller messages together:
+    Message message(3);
+    OutputLocker locker(this);
+    for (int i = 0; i < 4; i++) {
+        message.assign(messages[i], messages[i] + 3);
+        if (!send(message)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool MidiOut::nrpnAt(const unsigned char &channel, const int &nrpn, const int &value, const double &time) {
+    if (!opened) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::nrpnAt(): could not send. Port not opened.";
+        return false;
+    }
+
+    unsigned char messages[4][3];
+    nrpnMessages(messages, channel, nrpn, value);
+
+    // Same time stamp, the queue keeps them in order:
+    Message message(3);
+    OutputLocker locker(this);
+    for (int i = 0; i < 4; i++) {
+        message.assign(messages[i], messages[i] + 3);
+        if (!schedule(message, time)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool MidiOut::controlChangeAt(const unsigned char &channel, const unsigned char &controller, const unsigned char &value, const double &time) {
+    if (!opened) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::controlChangeAt(): could not send. Port not opened.";
+        return false;
+    }
+    Message message(3);
+    message[0] = 176 | channel;
+    message[1] = controller;
+    message[2] = value;
+    return writeAt(message, time);
+}
+
+
+bool MidiOut::writeBroadcast(const std::vector<unsigned char> &channels, Message &message) {
+    if (message.empty()) {
+        return false;
+    }
+    OutputLocker locker(this);
+    const unsigned char status = message.at(0) & 0xf0;
+    for (unsigned int i = 0; i < channels.size(); i++) {
+        message[0] = status | channels.at(i);
+        if (!send(message)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool MidiOut::nrpnBroadcast(const std::vector<unsigned char> &channels, const int &nrpn, const int &value) {
+    if (!opened) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::nrpnBroadcast(): could not send. Port not opened.";
+        return false;
+    }
+
+    unsigned char messages[4][3];
+    Message message(3);
+    OutputLocker locker(this);
+    for (unsigned int c = 0; c < channels.size(); c++) {
+        nrpnMessages(messages, channels.at(c), nrpn, value);
+        for (int i = 0; i < 4; i++) {
+            message.assign(messages[i], messages[i] + 3);
+            if (!send(message)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+bool MidiOut::writeBatch(std::vector<Message> &messages) {
+    OutputLocker locker(this);
+    for (unsigned int i = 0; i < messages.size(); i++) {
+        if (!send(messages.at(i))) {
+            return false;
+        }
+    }
+    return true;
 }
 
 
+bool MidiOut::thru(Message &message) {
+    std::vector<Message> messages(1, message);
+    return thru(messages);
+}
+
+
+bool MidiOut::thru(std::vector<Message> &messages) {
+    if (!thruOpened.fetchAndAddOrdered(0)) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::thru(): could not send. Port not opened.";
+        return false;
+    }
+    {
+        QMutexLocker locker(&thruMutex);
+        thruQueue.insert(thruQueue.end(), messages.begin(), messages.end());
+        thruPending.fetchAndStoreOrdered(1);
+    }
+    if (mutex.tryLock()) {
+        unlock(); // sends the queue
+    } else {
+        // Sent by the current holder of the mutex when it is done:
+        static MetricsCounter *deferred = Metrics::counter("midi.thru.deferred");
+        deferred->add(messages.size());
+    }
+    return true;
+}
+
+
+void MidiOut::sendThru() {
+    // Note: the caller has to hold the mutex.
+    std::deque<Message> pending;
+    {
+        QMutexLocker locker(&thruMutex);
+        pending.swap(thruQueue);
+        thruPending.fetchAndStoreOrdered(0);
+    }
+    for (unsigned int i = 0; i < pending.size(); i++) {
+        send(pending[i]);
+    }
+}
+
+
+void MidiOut::unlock() {
+    sendThru();
+    // open() and close() change opened under the mutex, thru() reads it
+    // without:
+    thruOpened.fetchAndStoreOrdered(opened ? 1 : 0);
+    mutex.unlock();
+    // Messages queued between sendThru() and unlock() found the mutex taken;
+    // whoever gets it next sends them:
+    while (thruPending.fetchAndAddOrdered(0) && mutex.tryLock()) {
+        sendThru();
+        mutex.unlock();
+    }
+}
+
+
+void MidiOut::encodeNrpn(std::vector<Message> &messages, const unsigned char &channel, const int &nrpn, const int &value) {
+    unsigned char encoded[4][3];
+    nrpnMessages(encoded, channel, nrpn, value);
+    for (int i = 0; i < 4; i++) {
+        messages.push_back(Message(encoded[i], encoded[i] + 3));
+    }
+}
+
 
 bool MidiOut::noteOn(const unsigned char &channel, const unsigned char &note, const unsigned char &velocity) {
     return write((144 | channel), note, velocity);
@@ -209,7 +569,7 @@ bool MidiOut::programChangeSequence(const unsigned char &channel, const int &seq
 
 bool MidiOut::controlChange(const unsigned char &channel, const unsigned char &controller, const unsigned char &value) {
     if (!opened) {
-        qDebug() << "MidiOut::controlChange(): could not send. Port not opened.";
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::controlChange(): could not send. Port not opened.";
         return false;
     }
     return write((176|channel),controller,value);
@@ -258,7 +618,7 @@ bool MidiOut::sequenceWriteRequest(const int &slot) {
 
 bool MidiOut::writeRequest(const int &slot, const unsigned char &which) {
     if (slot < 0) {
-        qDebug() << "MidiOut::writeRequest(): Slot" << slot << "is invalid.";
+        LOG_DEBUG(LogCategory::MIDI) << "MidiOut::writeRequest(): Slot" << slot << "is invalid.";
         return false;
     }
     Message payload;
@@ -21,7 +21,14 @@
 #define SHRUTHI_MIDIOUT_H
 
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <deque>
+#include <string>
 #include "message.h"
+class MidiScheduler;
+class OutputLocker;
+class RawMidiOut;
 class RtMidiOut;
 
 
@@ -29,9 +36,22 @@ class MidiOut {
     public:
         MidiOut();
         ~MidiOut();
+        void setBackend(const int &backend);
         bool open(const unsigned int &port);
+        bool openVirtual(const std::string &name);
+        void close();
+        bool isOpen();
         bool write(Message &sysex);
 
+        // Scheduled output: time is in seconds, relative to time(). Needs the
+        // ALSA sequencer, otherwise the message is sent immediately.
+        double time();
+        bool isScheduled(); // false if writeAt() sends immediately
+        bool writeAt(Message &message, const double &time);
+        bool nrpnAt(const unsigned char &channel, const int &nrpn, const int &value, const double &time);
+        bool controlChangeAt(const unsigned char &channel, const unsigned char &controller, const unsigned char &value, const double &time);
+        void setJitterMeasurement(const bool &enabled);
+
         // Wrappers:
         bool nrpn(const unsigned char &channel, const int &nrpn, const int &value);
         bool noteOn(const unsigned char &channel, const unsigned char &note, const unsigned char &velocity);
@@ -41,6 +61,23 @@ class MidiOut {
         bool programChangeSequence(const unsigned char &channel, const int &sequence);
         bool controlChange(const unsigned char &channel, const unsigned char &controller, const unsigned char &value);
 
+        // Sends the message (or NRPN) to all channels in one batch, nothing
+        // else is sent in between. The channel of message is replaced.
+        bool writeBroadcast(const std::vector<unsigned char> &channels, Message &message);
+        bool nrpnBroadcast(const std::vector<unsigned char> &channels, const int &nrpn, const int &value);
+
+        // Sends all messages under one lock:
+        bool writeBatch(std::vector<Message> &messages);
+        // For the thru callback, never waits for the port: if another thread
+        // is sending (e.g. a SysEx dump on a raw MIDI port), the messages are
+        // queued and sent right after the current message or group. The
+        // messages of one call stay together. Returns false only if the port
+        // isn't open.
+        bool thru(Message &message);
+        bool thru(std::vector<Message> &messages);
+        // Appends the four controller messages of a NRPN:
+        static void encodeNrpn(std::vector<Message> &messages, const unsigned char &channel, const int &nrpn, const int &value);
+
         // Requests:
         bool patchTransferRequest();
         bool sequenceTransferRequest();
@@ -54,6 +91,14 @@ class MidiOut {
         MidiOut(const MidiOut&); //forbid copying
         MidiOut &operator=(const MidiOut&); //forbid assignment
 
+        friend class OutputLocker;
+        void unlock();
+        void sendThru();
+        bool send(Message &message);
+        bool schedule(Message &message, const double &time);
+        void closePort();
+        bool openScheduler();
+
         // Wrappers:
         bool write(const unsigned char &c1, const unsigned char &c2, const unsigned char &c3);
         bool write(const unsigned char &c1, const unsigned char &c2);
@@ -61,9 +106,22 @@ class MidiOut {
         bool writeRequest(const int &slot, const unsigned char &which);
 
         RtMidiOut* midiout;
+        RawMidiOut* rawout;
+        MidiScheduler* scheduler;
+        bool measureJitter;
+        bool schedulerFailed; // don't retry until the port changes
+        int backend;
         bool opened;
+        bool virtualPort;
         unsigned int output;
         bool initialized;
+
+        // MidiOut is shared between the editor thread and the thru callback:
+        QMutex mutex;
+        QMutex thruMutex; // only for the queue, never held while sending
+        std::deque<Message> thruQueue;
+        QAtomicInt thruPending;
+        QAtomicInt thruOpened; // opened, for thru(); published by unlock()
 };
 
 
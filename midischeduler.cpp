@@ -0,0 +1,407 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "midischeduler.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <math.h>
+#include <stddef.h> // for NULL
+#include <stdlib.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "log.h"
+#ifdef __LINUX_ALSA__
+#include <alsa/asoundlib.h>
+#endif
+
+
+class MidiSchedulerReader : public QThread {
+    public:
+        MidiSchedulerReader(MidiScheduler *scheduler): scheduler(scheduler) {}
+
+    protected:
+        void run() {
+            scheduler->read();
+        }
+
+    private:
+        MidiScheduler *scheduler;
+};
+
+
+#ifdef __LINUX_ALSA__
+static snd_seq_real_time_t toRealTime(const double &time) {
+    snd_seq_real_time_t rt;
+    const double &t = time < 0 ? 0 : time;
+    rt.tv_sec = (unsigned int) t;
+    rt.tv_nsec = (unsigned int) ((t - rt.tv_sec) * 1e9);
+    return rt;
+}
+
+
+static double fromRealTime(const snd_seq_real_time_t *rt) {
+    return rt->tv_sec + rt->tv_nsec / 1e9;
+}
+#endif
+
+
+MidiScheduler::MidiScheduler():
+    seq(NULL),
+    coder(NULL),
+    coderSize(0),
+    port(-1),
+    queue(-1),
+    reader(NULL),
+    running(0),
+    measuring(0) {
+    resetJitter();
+}
+
+
+MidiScheduler::~MidiScheduler() {
+    close();
+}
+
+
+bool MidiScheduler::available() {
+#ifdef __LINUX_ALSA__
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool MidiScheduler::open(const std::string &name) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiScheduler::open(" << name.c_str() << ")";
+    close();
+#ifdef __LINUX_ALSA__
+    // RtMidi appends " client:port" to the port name.
+    int client = -1;
+    int destination = -1;
+    const size_t &space = name.rfind(' ');
+    if (space == std::string::npos ||
+            sscanf(name.c_str() + space + 1, "%d:%d", &client, &destination) != 2) {
+        LOG_WARNING(LogCategory::MIDI) << "MidiScheduler::open(): can't parse port name" << name.c_str();
+        return false;
+    }
+
+    if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0) {
+        LOG_WARNING(LogCategory::MIDI) << "MidiScheduler::open(): could not open the ALSA sequencer.";
+        seq = NULL;
+        return false;
+    }
+    snd_seq_set_client_name(seq, "shruthi-editor");
+
+    // Writable (but not subscribable), so echo events reach us.
+    port = snd_seq_create_simple_port(seq, "Scheduled Out",
+                                      SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ | SND_SEQ_PORT_CAP_WRITE,
+                                      SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    queue = snd_seq_alloc_named_queue(seq, "shruthi-editor");
+    if (port < 0 || queue < 0 || snd_midi_event_new(256, &coder) < 0) {
+        LOG_WARNING(LogCategory::MIDI) << "MidiScheduler::open(): could not set up the sequencer queue.";
+        coder = NULL;
+        close();
+        return false;
+    }
+    coderSize = 256;
+
+    // Prefer the high resolution timer, the system timer ticks with HZ.
+    snd_seq_queue_timer_t *timer;
+    snd_seq_queue_timer_alloca(&timer);
+    snd_timer_id_t *id;
+    snd_timer_id_alloca(&id);
+    if (snd_seq_get_queue_timer(seq, queue, timer) == 0) {
+        snd_timer_id_set_class(id, SND_TIMER_CLASS_GLOBAL);
+        snd_timer_id_set_sclass(id, SND_TIMER_SCLASS_NONE);
+        snd_timer_id_set_card(id, -1);
+        snd_timer_id_set_device(id, SND_TIMER_GLOBAL_HRTIMER);
+        snd_timer_id_set_subdevice(id, 0);
+        snd_seq_queue_timer_set_id(timer, id);
+        if (snd_seq_set_queue_timer(seq, queue, timer) < 0) {
+            LOG_DEBUG(LogCategory::MIDI) << "MidiScheduler::open(): hrtimer not available, using the system timer.";
+        }
+    }
+
+    if (snd_seq_connect_to(seq, port, client, destination) < 0) {
+        LOG_WARNING(LogCategory::MIDI) << "MidiScheduler::open(): could not connect to" << name.c_str();
+        close();
+        return false;
+    }
+
+    snd_seq_start_queue(seq, queue, NULL);
+    snd_seq_drain_output(seq);
+
+    portName = name;
+    resetJitter();
+    running.fetchAndStoreOrdered(1);
+    reader = new MidiSchedulerReader(this);
+    reader->start();
+    return true;
+#else
+    LOG_WARNING(LogCategory::MIDI) << "MidiScheduler::open(): scheduled output needs the ALSA sequencer.";
+    return false;
+#endif
+}
+
+
+void MidiScheduler::close() {
+    if (reader) {
+        running.fetchAndStoreOrdered(0);
+        reader->wait();
+        delete reader;
+        reader = NULL;
+        if (jitterCount > 0) {
+            LOG_INFO(LogCategory::MIDI) << jitterReport();
+        }
+    }
+#ifdef __LINUX_ALSA__
+    if (coder) {
+        snd_midi_event_free(coder);
+    }
+    if (seq) {
+        if (queue >= 0) {
+            snd_seq_stop_queue(seq, queue, NULL);
+            snd_seq_drain_output(seq);
+            snd_seq_free_queue(seq, queue);
+        }
+        snd_seq_close(seq);
+    }
+#endif
+    seq = NULL;
+    coder = NULL;
+    coderSize = 0;
+    port = -1;
+    queue = -1;
+    portName.clear();
+}
+
+
+bool MidiScheduler::isOpen() {
+    return seq != NULL;
+}
+
+
+const std::string &MidiScheduler::getPortName() {
+    return portName;
+}
+
+
+double MidiScheduler::time() {
+    QMutexLocker locker(&seqMutex);
+    return queueTime();
+}
+
+
+double MidiScheduler::queueTime() {
+    // Note: the caller has to hold seqMutex.
+#ifdef __LINUX_ALSA__
+    if (!seq) {
+        return 0;
+    }
+    snd_seq_queue_status_t *status;
+    snd_seq_queue_status_alloca(&status);
+    if (snd_seq_get_queue_status(seq, queue, status) < 0) {
+        return 0;
+    }
+    return fromRealTime(snd_seq_queue_status_get_real_time(status));
+#else
+    return 0;
+#endif
+}
+
+
+bool MidiScheduler::schedule(const Message &message, const double &time) {
+    QMutexLocker locker(&seqMutex);
+    return enqueue(message, time, false);
+}
+
+
+bool MidiScheduler::send(const Message &message) {
+    // Relative time 0: due now, queued behind everything that is due
+    QMutexLocker locker(&seqMutex);
+    return enqueue(message, 0, true);
+}
+
+
+bool MidiScheduler::enqueue(const Message &message, const double &time, const bool &relative) {
+    // Note: the caller has to hold seqMutex.
+#ifdef __LINUX_ALSA__
+    if (!seq || message.empty()) {
+        return false;
+    }
+
+    if (message.size() > coderSize) {
+        if (snd_midi_event_resize_buffer(coder, message.size()) < 0) {
+            return false;
+        }
+        coderSize = message.size();
+    }
+
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_midi_event_reset_encode(coder);
+    const long &encoded = snd_midi_event_encode(coder, &message[0], message.size(), &ev);
+    if (encoded < (long) message.size() || ev.type == SND_SEQ_EVENT_NONE) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiScheduler::schedule(): could not encode message.";
+        return false;
+    }
+
+    snd_seq_ev_set_source(&ev, port);
+    snd_seq_ev_set_subs(&ev);
+    snd_seq_real_time_t rt = toRealTime(time);
+    snd_seq_ev_schedule_real(&ev, queue, relative ? 1 : 0, &rt);
+
+    // Large SysEx messages don't fit into the default output buffer:
+    if (message.size() + sizeof(ev) > snd_seq_get_output_buffer_size(seq)) {
+        snd_seq_set_output_buffer_size(seq, message.size() + sizeof(ev));
+    }
+    if (snd_seq_event_output(seq, &ev) < 0) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiScheduler::schedule(): could not queue message.";
+        return false;
+    }
+    if (!relative && measuring.fetchAndAddRelaxed(0)) {
+        scheduleEcho(time);
+    }
+    snd_seq_drain_output(seq);
+    return true;
+#else
+    Q_UNUSED(message);
+    Q_UNUSED(time);
+    Q_UNUSED(relative);
+    return false;
+#endif
+}
+
+
+bool MidiScheduler::scheduleEcho(const double &time) {
+    // Note: the caller has to hold seqMutex.
+#ifdef __LINUX_ALSA__
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    ev.type = SND_SEQ_EVENT_ECHO;
+    snd_seq_ev_set_source(&ev, port);
+    snd_seq_ev_set_dest(&ev, snd_seq_client_id(seq), port);
+    snd_seq_real_time_t rt = toRealTime(time);
+    snd_seq_ev_schedule_real(&ev, queue, 0, &rt);
+    return snd_seq_event_output(seq, &ev) >= 0;
+#else
+    Q_UNUSED(time);
+    return false;
+#endif
+}
+
+
+void MidiScheduler::setJitterMeasurement(const bool &enabled) {
+    measuring.fetchAndStoreOrdered(enabled ? 1 : 0);
+}
+
+
+void MidiScheduler::probe(const int &count, const double &interval) {
+#ifdef __LINUX_ALSA__
+    QMutexLocker locker(&seqMutex);
+    if (!seq) {
+        return;
+    }
+    // Start a little ahead, so the first probe isn't already late.
+    const double &start = queueTime() + 0.01;
+    for (int i = 0; i < count; i++) {
+        scheduleEcho(start + i * interval);
+        if (i % 64 == 63) {
+            snd_seq_drain_output(seq);
+        }
+    }
+    snd_seq_drain_output(seq);
+#else
+    Q_UNUSED(count);
+    Q_UNUSED(interval);
+#endif
+}
+
+
+void MidiScheduler::read() {
+    // Runs on the reader thread.
+#ifdef __LINUX_ALSA__
+    const int &count = snd_seq_poll_descriptors_count(seq, POLLIN);
+    std::vector<struct pollfd> fds(count);
+    snd_seq_poll_descriptors(seq, &fds[0], count, POLLIN);
+
+    while (running.fetchAndAddRelaxed(0)) {
+        // Wake up regularly to check whether the scheduler is being closed.
+        if (poll(&fds[0], count, 50) <= 0) {
+            continue;
+        }
+        QMutexLocker seqLocker(&seqMutex);
+        snd_seq_event_t *ev = NULL;
+        do {
+            if (snd_seq_event_input(seq, &ev) < 0 || ev == NULL) {
+                break;
+            }
+            if (ev->type != SND_SEQ_EVENT_ECHO) {
+                continue;
+            }
+            const double &late = queueTime() - fromRealTime(&ev->time.time);
+
+            QMutexLocker locker(&jitterMutex);
+            jitterCount++;
+            jitterSum += late;
+            jitterSumSq += late * late;
+            if (late < jitterMin) {
+                jitterMin = late;
+            }
+            if (late > jitterMax) {
+                jitterMax = late;
+            }
+            if (jitterCount % 1000 == 0) {
+                locker.unlock();
+                LOG_INFO(LogCategory::MIDI) << jitterReport();
+            }
+        } while (snd_seq_event_input_pending(seq, 0) > 0);
+    }
+#endif
+}
+
+
+void MidiScheduler::resetJitter() {
+    QMutexLocker locker(&jitterMutex);
+    jitterCount = 0;
+    jitterSum = 0;
+    jitterSumSq = 0;
+    jitterMin = 1e9;
+    jitterMax = -1e9;
+}
+
+
+std::string MidiScheduler::jitterReport() {
+    QMutexLocker locker(&jitterMutex);
+    std::ostringstream os;
+    os << "Scheduled output jitter: ";
+    if (jitterCount == 0) {
+        os << "no samples.";
+        return os.str();
+    }
+    const double &mean = jitterSum / jitterCount;
+    const double &variance = jitterSumSq / jitterCount - mean * mean;
+    os << jitterCount << " samples, late by mean " << mean * 1e6
+       << " us, sd " << sqrt(variance > 0 ? variance : 0) * 1e6
+       << " us, min " << jitterMin * 1e6 << " us, max " << jitterMax * 1e6 << " us.";
+    return os.str();
+}
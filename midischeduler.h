@@ -0,0 +1,102 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_MIDISCHEDULER_H
+#define SHRUTHI_MIDISCHEDULER_H
+
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <string>
+#include "message.h"
+struct _snd_seq;
+struct snd_midi_event;
+class MidiSchedulerReader;
+
+
+// Sends timestamped messages through an ALSA sequencer queue, so they are
+// delivered by the kernel at the given time instead of whenever the editor
+// thread gets to them. Only available with the ALSA sequencer, see available().
+//
+// While it is open, MidiOut sends its immediate messages through the same
+// queue (send()), so they can't get between the controllers of a scheduled
+// NRPN: the queue delivers events of the same time in the order they were
+// queued. The sequencer handle is shared with the reader thread under
+// seqMutex.
+//
+// In jitter measurement mode every scheduled message is followed by an echo
+// event to ourselves, scheduled for the same time. The difference between the
+// queue time at which the echo arrives and its timestamp is collected.
+class MidiScheduler {
+    public:
+        MidiScheduler();
+        ~MidiScheduler();
+        static bool available();
+
+        // portName as listed by RtMidi, ie "client:port c:p".
+        bool open(const std::string &portName);
+        void close();
+        bool isOpen();
+        const std::string &getPortName();
+
+        // Queue time in seconds.
+        double time();
+        bool schedule(const Message &message, const double &time);
+        bool send(const Message &message); // as soon as possible, behind the due messages
+
+        void setJitterMeasurement(const bool &enabled);
+        // Schedules count echo-only events, interval seconds apart.
+        void probe(const int &count, const double &interval);
+        std::string jitterReport();
+
+    private:
+        MidiScheduler(const MidiScheduler&); //forbid copying
+        MidiScheduler &operator=(const MidiScheduler&); //forbid assignment
+
+        friend class MidiSchedulerReader;
+        void read();
+        double queueTime();
+        bool enqueue(const Message &message, const double &time, const bool &relative);
+        bool scheduleEcho(const double &time);
+        void resetJitter();
+
+        _snd_seq *seq;
+        snd_midi_event *coder;
+        unsigned int coderSize;
+        int port;
+        int queue;
+        std::string portName;
+
+        MidiSchedulerReader *reader;
+        QAtomicInt running;
+        QAtomicInt measuring;
+        QMutex seqMutex; // alsa-lib handles aren't thread-safe
+
+        // Jitter statistics in seconds, written by the reader thread:
+        QMutex jitterMutex;
+        unsigned int jitterCount;
+        double jitterSum;
+        double jitterSumSq;
+        double jitterMin;
+        double jitterMax;
+};
+
+
+#endif // SHRUTHI_MIDISCHEDULER_H
@@ -0,0 +1,290 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "midithru.h"
+#include <stddef.h> // for NULL
+#include <string>
+#include <vector>
+#include "RtMidi.h"
+#include "log.h"
+#include "midiout.h"
+#include "patch.h"
+#include "voiceallocator.h"
+
+
+void thrucallback(double deltatime, Message *message, void *userData) {
+    Q_UNUSED(deltatime);
+    ((MidiThru*)userData)->process(message);
+    // Don't try to delete the message!
+}
+
+
+MidiThru::MidiThru(MidiOut *out, const bool &automation, VoiceAllocator *voices):
+    midiout(out),
+    voices(voices),
+    midiin(NULL),
+    opened(false),
+    input(-1),
+    initialized(false),
+    automation(automation),
+    channel(0),
+    shruthiFilterBoard(0),
+    morphController(-1) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::MidiThru()";
+    try {
+        midiin = new RtMidiIn(RtMidi::UNSPECIFIED, "shruthi-editor");
+        midiin->setCallback(&thrucallback, this);
+        initialized = true;
+    }
+    catch (RtMidiError &error) {
+        error.printMessage();
+        LOG_WARNING(LogCategory::MIDI) << "MidiThru::MidiThru(): could not initilize midi port for thru.";
+    }
+}
+
+
+MidiThru::~MidiThru() {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::~MidiThru()";
+    if (initialized) {
+        initialized = false;
+        delete midiin;
+        midiin = NULL;
+    }
+}
+
+
+bool MidiThru::isNRPN(const unsigned char &n0, const unsigned char &n1) {
+    return (n0 & 0xf0) == 176 && (n1 == 6 || n1 == 38 || n1 == 98 || n1 == 99);
+}
+
+
+bool MidiThru::forward(Message &message) {
+    // MidiOut::thru() doesn't wait for SysEx transfers of the editor:
+    if (!voices || !voices->isEnabled()) {
+        return midiout->thru(message);
+    }
+    const std::vector<unsigned char> &channels = voices->channels();
+    std::vector<Message> messages(channels.size(), message);
+    for (unsigned int i = 0; i < channels.size(); i++) {
+        messages[i][0] = (message.at(0) & 0xf0) | channels.at(i);
+    }
+    return midiout->thru(messages);
+}
+
+
+bool MidiThru::forwardNrpn(const unsigned char &channel, const int &nrpn, const int &value) {
+    std::vector<Message> messages;
+    if (voices && voices->isEnabled()) {
+        const std::vector<unsigned char> &channels = voices->channels();
+        for (unsigned int i = 0; i < channels.size(); i++) {
+            MidiOut::encodeNrpn(messages, channels.at(i), nrpn, value);
+        }
+    } else {
+        MidiOut::encodeNrpn(messages, channel, nrpn, value);
+    }
+    return midiout->thru(messages);
+}
+
+
+void MidiThru::process(Message *message) {
+    // Runs on the RtMidi callback thread.
+    const unsigned int &size = message->size();
+    if (size < 2 || size > 3) {
+        return;
+    }
+
+    const unsigned char &status = message->at(0) & 0xf0;
+    switch (status) {
+        case 0x80: // note off
+        case 0x90: // note on
+        case 0xa0: // polyphonic aftertouch
+        case 0xb0: // control change
+        case 0xd0: // channel aftertouch
+        case 0xe0: // pitch bend
+            break;
+        default:
+            return;
+    }
+
+    // Notes are played by the voices of a polychain:
+    if (voices && voices->isEnabled() && size == 3 && (status == 0x80 || status == 0x90)) {
+        if (status == 0x90) {
+            voices->noteOn(message->at(1), message->at(2));
+        } else {
+            voices->noteOff(message->at(1));
+        }
+        return;
+    }
+
+    // (fetchAndAddRelaxed(0) is used as a portable atomic load for Qt 4 and 5.)
+    const unsigned char &ch = channel.fetchAndAddRelaxed(0);
+    (*message)[0] = status | ch;
+
+    if (status != 0xb0 || size != 3) {
+        forward(*message);
+        return;
+    }
+
+    if (isNRPN(message->at(0), message->at(1))) {
+        forward(*message);
+        if (nrpn.parse(0xb0, message->at(1), message->at(2))) {
+            QueueItem signal(QueueAction::PATCH_PARAMETER_CHANGE_MIDI, nrpn.getNRPN(), nrpn.getValue(), automation);
+            emit enqueue(signal);
+        }
+        return;
+    }
+
+    if (message->at(1) == morphController.fetchAndAddRelaxed(0)) {
+        QueueItem signal(QueueAction::MORPH_POSITION, message->at(2));
+        emit enqueue(signal);
+        return;
+    }
+
+    const int &filter = shruthiFilterBoard.fetchAndAddRelaxed(0);
+    int id = Patch::ccToId(message->at(1), filter);
+    if (id >= Patch::parameterCount) {
+        forward(*message); // not a patch parameter
+        return;
+    }
+    const int &value = Patch::convertCCValue(message->at(2), id, filter);
+
+    // Forward first, the editor can catch up later.
+    if (automation && Patch::sendAsNRPN(id)) {
+        forwardNrpn(ch, id, value);
+    } else {
+        forward(*message);
+    }
+
+    QueueItem signal(QueueAction::PATCH_PARAMETER_CHANGE_MIDI, id, value, automation); // int2: not mirrored
+    emit enqueue(signal);
+}
+
+
+void MidiThru::setMidiThruPort(int thru) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::setMidiThruPort:" << thru;
+    if (thru < 0) {
+        close();
+    } else {
+        open(thru);
+    }
+}
+
+
+void MidiThru::setVirtualPorts(bool enabled) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::setVirtualPorts:" << enabled;
+    if (enabled) {
+        openVirtual();
+    } else {
+        close();
+    }
+}
+
+
+void MidiThru::setMidiChannel(unsigned char channel) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::setMidiChannel:" << channel;
+    MidiThru::channel.fetchAndStoreRelaxed(channel);
+}
+
+
+void MidiThru::setShruthiFilterBoard(int filter) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::setShruthiFilterBoard:" << filter;
+    shruthiFilterBoard.fetchAndStoreRelaxed(filter);
+}
+
+
+void MidiThru::setMorphController(int cc) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::setMorphController:" << cc;
+    morphController.fetchAndStoreRelaxed(cc);
+}
+
+
+void MidiThru::close() {
+    if (opened) {
+        midiin->closePort();
+        opened = false;
+        input = -1;
+    }
+}
+
+
+bool MidiThru::open(const int &port) {
+    LOG_DEBUG(LogCategory::MIDI) << "MidiThru::open(" << port << ")";
+    if (!initialized) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiThru::open(): Can't open Midi port, RtMidi was not initialized.";
+        return false;
+    }
+
+    if (input == port && opened) {
+        return true;
+    }
+
+    close();
+
+    if (port >= (int) midiin->getPortCount()) {
+        LOG_WARNING(LogCategory::MIDI) << "MidiThru::open(): trying to open midi port for thru which doesn't exist.";
+        return false;
+    }
+    try {
+        midiin->openPort(port, "Thru");
+        // Ignore SysEx, timing and active sensing:
+        midiin->ignoreTypes(true, true, true);
+        opened = true;
+    }
+    catch (RtMidiError) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiThru::open(" << port << "): RtMidiError on openPort().";
+        opened = false;
+    }
+    if (opened) {
+        input = port;
+    } else {
+        LOG_WARNING(LogCategory::MIDI) << "MidiThru::open(): could not open midi port for thru.";
+    }
+    return opened;
+}
+
+
+bool MidiThru::openVirtual() {
+    if (!initialized) {
+        LOG_DEBUG(LogCategory::MIDI) << "MidiThru::openVirtual(): Can't open Midi port, RtMidi was not initialized.";
+        return false;
+    }
+
+    if (input == VIRTUAL_PORT && opened) {
+        return true;
+    }
+
+    close();
+
+    try {
+        // Not supported by all apis (e.g. windows mm):
+        midiin->openVirtualPort("Automation In");
+        midiin->ignoreTypes(true, true, true);
+        opened = true;
+    }
+    catch (RtMidiError &error) {
+        error.printMessage();
+        opened = false;
+    }
+    if (opened) {
+        input = VIRTUAL_PORT;
+    } else {
+        LOG_WARNING(LogCategory::MIDI) << "MidiThru::openVirtual(): could not open virtual midi port.";
+    }
+    return opened;
+}
@@ -0,0 +1,94 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SHRUTHI_MIDITHRU_H
+#define SHRUTHI_MIDITHRU_H
+
+
+#include <QAtomicInt>
+#include <QObject>
+#include "message.h"
+#include "midiin.h" // for NRPN
+#include "queueitem.h"
+class MidiOut;
+class RtMidiIn;
+class VoiceAllocator;
+
+
+// Forwards note and controller messages of an external controller (e.g. a
+// master keyboard) to the Shruthi. Forwarding happens directly on the RtMidi
+// callback thread and never waits for the editor queue or for SysEx transfers
+// on the output (see MidiOut::thru()). Controller changes are additionally
+// enqueued, so the editor's patch stays in sync.
+//
+// In automation mode the input is published as a virtual port (e.g. for a
+// DAW) and CCs of patch parameters are translated into NRPNs, which carry the
+// full parameter range.
+//
+// With a polychain (see VoiceAllocator) notes are distributed over the voices
+// and all other messages go to all of them.
+class MidiThru : public QObject {
+        Q_OBJECT
+
+    public:
+        MidiThru(MidiOut *out, const bool &automation = false, VoiceAllocator *voices = NULL);
+        ~MidiThru();
+        void process(Message *message);
+
+    private:
+        MidiThru(const MidiThru&); //forbid copying
+        MidiThru &operator=(const MidiThru&); //forbid assignment
+
+        bool open(const int &port);
+        bool openVirtual();
+        void close();
+        static bool isNRPN(const unsigned char &n0, const unsigned char &n1);
+        bool forward(Message &message);
+        bool forwardNrpn(const unsigned char &channel, const int &nrpn, const int &value);
+
+        NRPN nrpn;
+
+        MidiOut *midiout;
+        VoiceAllocator *voices; // configured before the port is opened
+        RtMidiIn *midiin;
+        bool opened;
+        int input;
+        bool initialized;
+        bool automation;
+
+        static const int VIRTUAL_PORT = -2;
+
+        // Written by the slots, read on the RtMidi callback thread:
+        QAtomicInt channel;
+        QAtomicInt shruthiFilterBoard;
+        QAtomicInt morphController; // -1 if disabled
+
+    public slots:
+        void setMidiThruPort(int thru);
+        void setVirtualPorts(bool enabled);
+        void setMidiChannel(unsigned char channel);
+        void setShruthiFilterBoard(int filter);
+        void setMorphController(int cc); // the CC drives the morph instead of being forwarded
+
+    signals:
+        void enqueue(QueueItem);
+};
+
+
+#endif // SHRUTHI_MIDITHRU_H
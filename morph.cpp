@@ -0,0 +1,173 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "morph.h"
+#include <algorithm> // for min, max
+#include <math.h> // for floor
+#include "metrics.h"
+
+
+Morph::Morph():
+    active(false),
+    filter(0),
+    mPosition(0),
+    cursor(0),
+    ramping(false),
+    rampStart(0),
+    rampTarget(0),
+    rampDuration(0) {
+    for (int i = 0; i < Patch::parameterCount; i++) {
+        sent[i] = 0;
+    }
+}
+
+
+bool Morph::morphable(const int &id) {
+    // Portamento and legato (108, 109) are CC only and not morphed:
+    return Patch::sendAsNRPN(id);
+}
+
+
+void Morph::start(const Patch &from, const Patch &to, const Patch &current) {
+    this->from.set(from);
+    this->to.set(to);
+    // The Shruthi plays current, only differences to it are sent:
+    patch.set(current);
+    for (int i = 0; i < Patch::parameterCount; i++) {
+        sent[i] = current.getValue(i);
+    }
+    patch.setName(from.getName());
+    active = true;
+    ramping = false;
+    cursor = 0;
+    setPosition(0);
+}
+
+
+void Morph::stop() {
+    active = false;
+    ramping = false;
+}
+
+
+bool Morph::isActive() const {
+    return active;
+}
+
+
+void Morph::setFilterBoard(const int &filter) {
+    this->filter = filter;
+}
+
+
+void Morph::setPosition(const double &position) {
+    ramping = false;
+    mPosition = std::max(0.0, std::min(1.0, position));
+}
+
+
+void Morph::rampTo(const double &position, const int &duration) {
+    rampStart = mPosition;
+    rampTarget = std::max(0.0, std::min(1.0, position));
+    rampDuration = std::max(duration, 1);
+    ramping = true;
+    clock.start();
+}
+
+
+const double &Morph::position() const {
+    return mPosition;
+}
+
+
+bool Morph::isRamping() const {
+    return ramping;
+}
+
+
+bool Morph::isIdle() const {
+    if (ramping) {
+        return false;
+    }
+    for (int i = 0; i < Patch::parameterCount; i++) {
+        if (morphable(i) && interpolate(i) != sent[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int Morph::interpolate(const int &id) const {
+    const int &a = from.getValue(id);
+    const int &b = to.getValue(id);
+    if (Patch::parameter(id, filter).string_values) {
+        return mPosition < 0.5 ? a : b;
+    }
+    return (int) floor(a + (b - a) * mPosition + 0.5);
+}
+
+
+bool Morph::frame(std::vector<int> &ids) {
+    ids.clear();
+    if (!active) {
+        return false;
+    }
+
+    if (ramping) {
+        const double &progress = std::min(1.0, (double) clock.elapsed() / rampDuration);
+        mPosition = rampStart + (rampTarget - rampStart) * progress;
+        ramping = progress < 1.0;
+    }
+
+    // Round robin over the changed parameters, so all of them progress when
+    // there are more than fit into a frame:
+    const unsigned int first = cursor;
+    unsigned int pending = 0;
+    for (int n = 0; n < Patch::parameterCount; n++) {
+        const int &id = (first + n) % Patch::parameterCount;
+        if (!morphable(id)) {
+            continue;
+        }
+        const int &value = interpolate(id);
+        patch.setValue(id, value);
+        if (value == sent[id]) {
+            continue;
+        }
+        if (ids.size() < MAX_PARAMETERS_PER_FRAME) {
+            ids.push_back(id);
+            sent[id] = value;
+            cursor = (id + 1) % Patch::parameterCount;
+        } else {
+            pending++;
+        }
+    }
+
+    static MetricsCounter *frames = Metrics::counter("morph.frames");
+    static MetricsCounter *deferred = Metrics::counter("morph.deferred_parameters");
+    frames->add();
+    deferred->add(pending);
+    return !ids.empty();
+}
+
+
+const Patch &Morph::current() const {
+    return patch;
+}
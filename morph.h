@@ -0,0 +1,92 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_MORPH_H
+#define SHRUTHI_MORPH_H
+
+
+#include <QElapsedTimer>
+#include <vector>
+#include "patch.h"
+
+
+// Morphs between two patches.
+//
+// Continuous parameters are interpolated, parameters with named values
+// (waveforms, modulation sources, ...) switch to the second patch at the
+// middle. The position is set directly (slider, CC) or ramps to a target.
+//
+// frame() is called once per FRAME_INTERVAL and returns the parameters whose
+// value changed since they were last returned. Changes between two frames are
+// coalesced, and at most MAX_PARAMETERS_PER_FRAME parameters are returned per
+// frame (the others follow in the next frames), which keeps the NRPN stream
+// to a share of the MIDI link, so notes and thru traffic still get through
+// during a ramp.
+class Morph {
+    public:
+        static const int FRAME_INTERVAL = 20; // ms
+        static const int LINK_SHARE = 40; // percent of the link used by the morph
+        // A frame has room for 62 bytes at 31250 baud, a NRPN takes 12 bytes
+        // (2 parameters per frame):
+        static const unsigned int MAX_PARAMETERS_PER_FRAME = FRAME_INTERVAL * 3125 / 1000 * LINK_SHARE / 100 / 12;
+
+        Morph();
+
+        void start(const Patch &from, const Patch &to, const Patch &current);
+        void stop();
+        bool isActive() const;
+
+        void setFilterBoard(const int &filter);
+        void setPosition(const double &position); // 0 (from) to 1 (to)
+        void rampTo(const double &position, const int &duration); // ms
+        const double &position() const;
+        bool isRamping() const;
+        bool isIdle() const; // nothing left to send and not ramping
+
+        bool frame(std::vector<int> &ids);
+        const Patch &current() const;
+
+        static bool morphable(const int &id);
+
+    private:
+        Morph(const Morph&); //forbid copying
+        Morph &operator=(const Morph&); //forbid assignment
+
+        int interpolate(const int &id) const;
+
+        Patch from;
+        Patch to;
+        Patch patch; // morphed values, sent or not
+        int sent[110]; // last values returned by frame()
+        bool active;
+        int filter;
+        double mPosition;
+        unsigned int cursor; // first parameter checked by the next frame
+
+        // Ramp:
+        QElapsedTimer clock;
+        bool ramping;
+        double rampStart;
+        double rampTarget;
+        int rampDuration;
+};
+
+
+#endif // SHRUTHI_MORPH_H
@@ -0,0 +1,230 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "parameterrecorder.h"
+#include <algorithm> // for min, max
+#include "log.h"
+#include "metrics.h"
+#include "patch.h"
+
+
+ParameterRecorder::ParameterRecorder():
+    recordingStart(0),
+    mLength(0),
+    recording(false),
+    playbackLength(0),
+    position(0),
+    loopOffset(0),
+    loop(false),
+    playing(false) {
+    // Room for a few minutes of knob turning:
+    events.reserve(16384);
+}
+
+
+void ParameterRecorder::startRecording(const qint64 &now) {
+    stopPlayback();
+    events.clear();
+    recordingStart = now;
+    mLength = 0;
+    recording = true;
+}
+
+
+void ParameterRecorder::record(const qint64 &time, const unsigned char &source, const int &id, const int &value) {
+    if (!recording || id < 0 || id >= Patch::parameterCount) {
+        return;
+    }
+    // Changes queued before the start count as the first event:
+    const qint64 &t = std::max(time - recordingStart, (qint64) 0);
+    if (t > 0xffffffffLL) {
+        LOG_INFO(LogCategory::EDITOR) << "ParameterRecorder::record(): maximum length reached, recording stopped.";
+        stopRecording(time);
+        return;
+    }
+    Event event;
+    event.time = (quint32) t;
+    event.id = (unsigned char) id;
+    event.source = source;
+    event.value = (short) value;
+    // Items are processed in the order of their creation, but be safe:
+    if (!events.empty() && events.back().time > event.time) {
+        event.time = events.back().time;
+    }
+    events.push_back(event);
+
+    static MetricsCounter *recorded = Metrics::counter("recorder.events");
+    recorded->add(1);
+}
+
+
+void ParameterRecorder::stopRecording(const qint64 &now) {
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    const qint64 &t = now - recordingStart;
+    mLength = (quint32) std::min(std::max(t, (qint64) 0), (qint64) 0xffffffffLL);
+    if (!events.empty() && events.back().time > mLength) {
+        mLength = events.back().time;
+    }
+    LOG_INFO(LogCategory::EDITOR) << "ParameterRecorder: recorded" << (unsigned int) events.size() << "events in" << mLength / 1000 << "ms.";
+}
+
+
+bool ParameterRecorder::isRecording() const {
+    return recording;
+}
+
+
+bool ParameterRecorder::startPlayback(const bool &loop, const int &quantize, const int &thin) {
+    if (recording) {
+        return false;
+    }
+    prepare(quantize, thin);
+    if (playback.empty()) {
+        playing = false;
+        return false;
+    }
+    this->loop = loop;
+    position = 0;
+    loopOffset = 0;
+    playing = true;
+    clock.start();
+    return true;
+}
+
+
+void ParameterRecorder::stopPlayback() {
+    playing = false;
+}
+
+
+bool ParameterRecorder::isPlaying() const {
+    return playing;
+}
+
+
+bool ParameterRecorder::next(const qint64 &until, Event &event, qint64 &time) {
+    if (!playing) {
+        return false;
+    }
+    if (position >= playback.size()) {
+        if (!loop) {
+            playing = false;
+            return false;
+        }
+        position = 0;
+        loopOffset += playbackLength;
+    }
+    const Event &e = playback.at(position);
+    if (loopOffset + e.time >= until) {
+        return false;
+    }
+    event = e;
+    time = loopOffset + e.time;
+    position++;
+    return true;
+}
+
+
+qint64 ParameterRecorder::playbackTime() const {
+    return playing ? clock.nsecsElapsed() / 1000 : 0;
+}
+
+
+unsigned int ParameterRecorder::size() const {
+    return events.size();
+}
+
+
+unsigned int ParameterRecorder::playbackSize() const {
+    return playback.size();
+}
+
+
+quint32 ParameterRecorder::length() const {
+    return mLength;
+}
+
+
+void ParameterRecorder::prepare(const int &quantize, const int &thin) {
+    playback = events;
+    playbackLength = mLength;
+
+    // Rounding to the grid keeps the order of the events:
+    if (quantize > 0) {
+        const quint32 &grid = quantize * 1000;
+        for (unsigned int i = 0; i < playback.size(); i++) {
+            Event &e = playback.at(i);
+            e.time = (e.time + grid / 2) / grid * grid;
+        }
+        playbackLength = (playbackLength + grid - 1) / grid * grid;
+    }
+    // A loop must not play two events at the same time:
+    if (playbackLength == 0) {
+        playbackLength = 1000;
+    }
+
+    // Index of the next event of the same parameter:
+    std::vector<int> following(playback.size(), -1);
+    int last[256];
+    for (int i = 0; i < 256; i++) {
+        last[i] = -1;
+    }
+    for (int i = playback.size() - 1; i >= 0; i--) {
+        following.at(i) = last[playback.at(i).id];
+        last[playback.at(i).id] = i;
+    }
+
+    const quint32 &interval = std::max(thin, 0) * 1000;
+    bool kept[256];
+    short keptValue[256];
+    quint32 keptTime[256];
+    for (int i = 0; i < 256; i++) {
+        kept[i] = false;
+    }
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < playback.size(); i++) {
+        const Event &e = playback.at(i);
+        const int &next = following.at(i);
+        bool keep = true;
+        if (next >= 0 && playback.at(next).time == e.time) {
+            // overwritten at the same time (e.g. after quantizing)
+            keep = false;
+        } else if (kept[e.id] && keptValue[e.id] == e.value) {
+            keep = false;
+        } else if (interval > 0 && next >= 0 && kept[e.id] &&
+                   playback.at(next).time - e.time < interval &&
+                   e.time - keptTime[e.id] < interval) {
+            // an intermediate value of a fast change
+            keep = false;
+        }
+        if (keep) {
+            kept[e.id] = true;
+            keptValue[e.id] = e.value;
+            keptTime[e.id] = e.time;
+            playback.at(count++) = e;
+        }
+    }
+    static MetricsCounter *thinned = Metrics::counter("recorder.thinned_events");
+    thinned->add(playback.size() - count);
+    playback.resize(count);
+}
@@ -0,0 +1,100 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_PARAMETERRECORDER_H
+#define SHRUTHI_PARAMETERRECORDER_H
+
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <vector>
+
+
+// Records the patch parameter changes of the editor and of the Shruthi's
+// knobs with their time, and plays them back.
+//
+// Playback works on a prepared copy of the recording: quantize moves the
+// events to a grid, thinning drops values that would be overwritten within
+// the thinning interval (the last value before a pause is always kept) and
+// values that don't change the parameter. Like this a fast knob sweep fits
+// the bandwidth of the MIDI link. The recording itself is never changed.
+class ParameterRecorder {
+    public:
+        static const unsigned char EDITOR = 0;
+        static const unsigned char SHRUTHI = 1;
+
+        // The editor sends the events LOOKAHEAD ahead on the scheduled
+        // output, every PLAYBACK_INTERVAL. Without the ALSA sequencer the
+        // events are sent when due, checked every millisecond.
+        static const int PLAYBACK_INTERVAL = 10; // ms
+        static const int LOOKAHEAD = 50000; // us
+
+        struct Event {
+            quint32 time; // microseconds since the start of the recording
+            unsigned char id;
+            unsigned char source;
+            short value;
+        };
+
+        ParameterRecorder();
+
+        // Times are Trace::now() timestamps (microseconds):
+        void startRecording(const qint64 &now);
+        void record(const qint64 &time, const unsigned char &source, const int &id, const int &value);
+        void stopRecording(const qint64 &now);
+        bool isRecording() const;
+
+        // quantize and thin in ms, 0 disables them. Returns false if there
+        // is nothing to play.
+        bool startPlayback(const bool &loop, const int &quantize, const int &thin);
+        void stopPlayback();
+        bool isPlaying() const;
+
+        // Returns the next event due before until (microseconds since the
+        // start of the playback) and its playback time. Loops wrap around.
+        bool next(const qint64 &until, Event &event, qint64 &time);
+        qint64 playbackTime() const; // microseconds since the start
+
+        unsigned int size() const;
+        unsigned int playbackSize() const; // after quantizing and thinning
+        quint32 length() const; // microseconds
+
+    private:
+        ParameterRecorder(const ParameterRecorder&); //forbid copying
+        ParameterRecorder &operator=(const ParameterRecorder&); //forbid assignment
+
+        void prepare(const int &quantize, const int &thin);
+
+        std::vector<Event> events;
+        qint64 recordingStart;
+        quint32 mLength;
+        bool recording;
+
+        std::vector<Event> playback;
+        quint32 playbackLength;
+        unsigned int position;
+        qint64 loopOffset;
+        bool loop;
+        bool playing;
+        QElapsedTimer clock;
+};
+
+
+#endif // SHRUTHI_PARAMETERRECORDER_H
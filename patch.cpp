@@ -19,11 +19,10 @@
 
 #include "patch.h"
 #include <math.h> // for ceil, floor
-#include <stdlib.h> // for srand, rand
-#include <time.h>
 #include <QStringList>
 #include <iostream>
 #include "labels.h"
+#include "log.h"
 #include "midi.h"
 
 
@@ -219,9 +218,7 @@ const PatchParameter Patch::parameter93 [8] = {
 
 PatchParameter Patch::parameter(const int &id, int filter) {
     if (id >= parameterCount || filter >= filterBoardCount) {
-#ifdef DEBUGMSGS
-        qDebug() << "Patch::parameter() called with invalid arguments." << id << filter;
-#endif
+        LOG_DEBUG(LogCategory::PATCH) << "Patch::parameter() called with invalid arguments." << id << filter;
         return param_blank;
     }
 
@@ -283,13 +280,11 @@ bool Patch::belongsToModMatrix(const int &id) {
 
 Patch::Patch() {
     reset();
-    srand(time(NULL));
 }
 
 
 Patch::Patch(const unsigned int &version) {
     reset(version);
-    srand(time(NULL));
 }
 
 
@@ -356,15 +351,23 @@ void Patch::reset(unsigned int version) {
 }
 
 
-void Patch::randomize(const int &filter) {
-    unpackData(INIT_PATCH);
-    for (int i=0; i < parameterCount; i++) {
-        if (enabled(i)) { // do we want to randomize sequencer settings?
-            const PatchParameter param = parameter(i, filter);
-            data[i] = (rand() %(param.max-param.min))+param.min;
-        }
+bool Patch::upgrade() {
+    if (version != 33) {
+        return false;
+    }
+
+    // 1.xx patches store the portamento, sequencer and arpeggiator settings
+    // in the bytes 76-83, where 0.9x patches keep the performance page. The
+    // Shruthi fills them with its current settings when it converts a patch;
+    // the settings of the init patch are used instead, so the result does
+    // not depend on the state of the Shruthi.
+    unsigned char temp[92];
+    packData(temp);
+    for (int i = 76; i <= 83; i++) {
+        temp[i] = INIT_PATCH[i];
     }
-    name = "random";
+    temp[91] = 37;
+    return unpackData(temp);
 }
 
 
@@ -393,9 +396,7 @@ bool Patch::unpackData(const unsigned char sysex[]) {
     temp[98] = temp[90]>>3; // op 2 in 2
     temp[99] = temp[90]%8; // op 2 out
     version = temp[91];
-#ifdef DEBUGMSGS
-    std::cout << "Parsed patch with version " << version << "/" << (int)version << "." << std::endl;
-#endif
+    LOG_TRACE(LogCategory::PATCH) << "Parsed patch with version" << version;
     // uncompress v1.00 data:
     if (version == 37) {
         // temp[76] holds (system_settings.legato ? 0x40 : 0x00) | system_settings.portamento
@@ -580,6 +581,17 @@ int Patch::convertCCValue(const unsigned int &val, int &id, const int &filter) {
 }
 
 
+int Patch::convertToCCValue(const int &id, const int &value, const int &filter) {
+    // Inverse of convertCCValue(), clamped to a valid data byte:
+    const PatchParameter &param = parameter(id, filter);
+    if (param.max <= param.min) {
+        return 0;
+    }
+    const int &cc = 127.0 * (value - param.min) / (param.max - param.min);
+    return qBound(0, cc, 127);
+}
+
+
 bool Patch::parseSysex(const Message *message) {
     Message payload;
     if (!Midi::parseSysex(message, &payload)) {
@@ -62,7 +62,7 @@ class Patch {
         QString getVersionString() const;
 
         void reset(unsigned int version = 1000);
-        void randomize(const int &filter);
+        bool upgrade(); // converts a 0.9x patch to the 1.xx format
 
         bool unpackData(const unsigned char *sysex);
         void packData(unsigned char res[]) const;
@@ -74,6 +74,7 @@ class Patch {
 
         static unsigned char ccToId(const unsigned char &cc, const int &filter);
         static int convertCCValue(const unsigned int &val, int &id, const int &filter);
+        static int convertToCCValue(const int &id, const int &value, const int &filter); // value of the CC sent for id
 
         static const unsigned char parameterCount;
         static const unsigned char filterBoardCount;
@@ -0,0 +1,269 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+
+#include "patchgenerator.h"
+#include <QStringList>
+#include <math.h> // for cos, log, sqrt
+#include "log.h"
+#include "patch.h"
+
+
+static const char *profileNames[] = {"random", "bass", "pad"};
+static const double TWO_PI = 6.283185307179586;
+
+
+PatchGenerator::PatchGenerator(const quint64 &seed) :
+    state(0),
+    increment(1),
+    mSeed(0),
+    profile(RANDOM),
+    keep(0),
+    filter(0) {
+    this->seed(seed);
+    setProfile(RANDOM);
+}
+
+
+void PatchGenerator::seed(const quint64 &seed) {
+    mSeed = seed;
+    reseed(seed, 0);
+}
+
+
+const quint64 &PatchGenerator::getSeed() const {
+    return mSeed;
+}
+
+
+void PatchGenerator::advanceSeed() {
+    // One step of the 64 bit LCG of PCG:
+    seed(mSeed * Q_UINT64_C(6364136223846793005) + Q_UINT64_C(1442695040888963407));
+}
+
+
+void PatchGenerator::reseed(const quint64 &seed, const quint64 &stream) {
+    // Initialization as in the PCG reference implementation; every stream
+    // is an independent sequence:
+    state = 0;
+    increment = (stream << 1) | 1;
+    next();
+    state += seed;
+    next();
+}
+
+
+quint32 PatchGenerator::next() {
+    // PCG32 (XSH RR): 64 bit LCG, permuted 32 bit output
+    const quint64 old = state;
+    state = old * Q_UINT64_C(6364136223846793005) + increment;
+    const quint32 xorshifted = (quint32) (((old >> 18) ^ old) >> 27);
+    const quint32 rot = (quint32) (old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+
+int PatchGenerator::uniform(const int &min, const int &max) {
+    if (max <= min) {
+        return min;
+    }
+    const quint32 range = (quint32) (max - min) + 1;
+    // Rejects the lowest 2^32 % range outputs, so that every value is
+    // equally likely (a plain modulo favours the low values):
+    const quint32 threshold = (0u - range) % range;
+    quint32 r;
+    do {
+        r = next();
+    } while (r < threshold);
+    return min + (int) (r % range);
+}
+
+
+double PatchGenerator::normal() {
+    // Box-Muller; u1 is in (0, 1], so the log is finite:
+    const double u1 = (next() + 1.0) / 4294967296.0;
+    const double u2 = next() / 4294967296.0;
+    return sqrt(-2.0 * log(u1)) * cos(TWO_PI * u2);
+}
+
+
+bool PatchGenerator::setProfile(const QString &spec) {
+    const QStringList &parts = spec.split(",");
+    int profile = -1;
+    for (int i = 0; i <= PAD; i++) {
+        if (parts.at(0) == profileNames[i]) {
+            profile = i;
+        }
+    }
+    if (profile < 0) {
+        LOG_WARNING(LogCategory::PATCH) << "PatchGenerator::setProfile(): unknown profile" << parts.at(0);
+        return false;
+    }
+
+    int keep = 0;
+    for (int i = 1; i < parts.size(); i++) {
+        if (parts.at(i) == "keep-filter") {
+            keep |= KEEP_FILTER;
+        } else if (parts.at(i) == "keep-mod-matrix") {
+            keep |= KEEP_MOD_MATRIX;
+        } else if (parts.at(i) == "keep-sequencer") {
+            keep |= KEEP_SEQUENCER;
+        } else {
+            LOG_WARNING(LogCategory::PATCH) << "PatchGenerator::setProfile(): unknown option" << parts.at(i);
+            return false;
+        }
+    }
+    setProfile(profile, keep);
+    return true;
+}
+
+
+void PatchGenerator::setProfile(const int &profile, const int &keep) {
+    this->profile = profile;
+    this->keep = keep;
+
+    // Full ranges:
+    for (int id = 0; id < Patch::parameterCount; id++) {
+        if (Patch::enabled(id)) {
+            const PatchParameter param = Patch::parameter(id, filter);
+            set(id, UNIFORM, param.min, param.max);
+        } else {
+            set(id, KEEP, 0, 0);
+        }
+    }
+
+    if (profile == BASS) {
+        // Low oscillators, closed filter, short envelopes:
+        set(2, NORMAL, -24, 0, -12, 6);
+        set(6, NORMAL, -24, 0, -12, 6);
+        set(7, UNIFORM, 0, 20);
+        set(9, UNIFORM, 16, 63);
+        set(10, UNIFORM, 0, 8);
+        set(12, NORMAL, 0, 100, 40, 15);
+        set(13, UNIFORM, 0, 45);
+        set(14, UNIFORM, 16, 63);
+        set(16, UNIFORM, 0, 10);
+        set(17, UNIFORM, 20, 90);
+        set(18, UNIFORM, 0, 60);
+        set(19, UNIFORM, 0, 40);
+        set(20, UNIFORM, 0, 5);
+        set(21, UNIFORM, 30, 110);
+        set(22, UNIFORM, 60, 127);
+        set(23, UNIFORM, 0, 30);
+        set(108, UNIFORM, 0, 16);
+    } else if (profile == PAD) {
+        // Detuned oscillators around the root, open filter, slow envelopes:
+        set(2, NORMAL, -12, 12, 0, 6);
+        set(6, NORMAL, -12, 12, 0, 6);
+        set(7, UNIFORM, 4, 40);
+        set(9, UNIFORM, 0, 32);
+        set(10, UNIFORM, 0, 16);
+        set(12, NORMAL, 20, 127, 70, 20);
+        set(13, UNIFORM, 0, 32);
+        set(14, UNIFORM, 0, 40);
+        set(16, UNIFORM, 30, 110);
+        set(17, UNIFORM, 40, 127);
+        set(18, UNIFORM, 40, 127);
+        set(19, UNIFORM, 50, 127);
+        set(20, UNIFORM, 40, 110);
+        set(21, UNIFORM, 60, 127);
+        set(22, UNIFORM, 80, 127);
+        set(23, UNIFORM, 60, 127);
+        set(108, UNIFORM, 0, 40);
+    }
+    if (profile != RANDOM) {
+        // The sequencer settings belong to the performance, not the sound:
+        keepRange(100, 107);
+    }
+
+    if (keep & KEEP_FILTER) {
+        keepRange(12, 15);
+        keepRange(84, 85);
+        keepRange(92, 93);
+    }
+    if (keep & KEEP_MOD_MATRIX) {
+        keepRange(32, 67);
+        keepRange(94, 99);
+    }
+    if (keep & KEEP_SEQUENCER) {
+        keepRange(100, 107);
+    }
+}
+
+
+void PatchGenerator::setFilterBoard(const int &filter) {
+    // The ranges of the filter board parameters depend on the board:
+    this->filter = filter;
+    setProfile(profile, keep);
+}
+
+
+void PatchGenerator::set(const int &id, const int &type, const int &min, const int &max, const int &center, const int &spread) {
+    const Distribution distribution = {type, min, max, center, spread};
+    distributions[id] = distribution;
+}
+
+
+void PatchGenerator::keepRange(const int &from, const int &to) {
+    for (int id = from; id <= to; id++) {
+        distributions[id].type = KEEP;
+    }
+}
+
+
+void PatchGenerator::setDistribution(const int &id, const Distribution &distribution) {
+    distributions[id] = distribution;
+}
+
+
+const PatchGenerator::Distribution &PatchGenerator::distribution(const int &id) const {
+    return distributions[id];
+}
+
+
+void PatchGenerator::generate(Patch &patch) {
+    for (int id = 0; id < Patch::parameterCount; id++) {
+        const Distribution &d = distributions[id];
+        switch (d.type) {
+            case UNIFORM:
+                patch.setValue(id, uniform(d.min, d.max));
+                break;
+            case NORMAL:
+                patch.setValue(id, qBound(d.min, qRound(d.center + d.spread * normal()), d.max));
+                break;
+            case FIXED:
+                patch.setValue(id, d.center);
+                break;
+            default: // KEEP
+                break;
+        }
+    }
+    patch.setName(profileNames[profile]);
+}
+
+
+void PatchGenerator::generate(Patch &patch, const unsigned int &index) {
+    const quint64 savedState = state;
+    const quint64 savedIncrement = increment;
+    reseed(mSeed, (quint64) index + 1); // stream 0 is the sequence
+    generate(patch);
+    state = savedState;
+    increment = savedIncrement;
+}
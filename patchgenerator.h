@@ -0,0 +1,109 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+
+#ifndef SHRUTHI_PATCHGENERATOR_H
+#define SHRUTHI_PATCHGENERATOR_H
+
+
+#include <QString>
+#include <QtGlobal>
+class Patch;
+
+
+// Generates random patches. The generator has its own random number
+// generator (PCG32), so the same seed, profile and starting patches always
+// give the same patches, and nothing else touches the global rand().
+//
+// Every parameter has a distribution; a profile sets them all at once (e.g.
+// short envelopes and low ranges for "bass") and can keep parts of the
+// starting patch (filter, mod matrix, sequencer settings).
+class PatchGenerator {
+    public:
+        // Distributions:
+        static const int KEEP = 0; // value of the starting patch
+        static const int UNIFORM = 1; // min..max, both included
+        static const int NORMAL = 2; // center +- spread (standard deviation), clamped to min..max
+        static const int FIXED = 3; // center
+
+        struct Distribution {
+            int type;
+            int min;
+            int max;
+            int center;
+            int spread;
+        };
+
+        // Profiles:
+        static const int RANDOM = 0; // all parameters uniform
+        static const int BASS = 1;
+        static const int PAD = 2;
+
+        // Parts of the starting patch to keep (flags):
+        static const int KEEP_FILTER = 1; // cutoff, resonance, filter board
+        static const int KEEP_MOD_MATRIX = 2; // modulations and operators
+        static const int KEEP_SEQUENCER = 4; // sequencer and arpeggiator settings
+
+        PatchGenerator(const quint64 &seed = 0);
+
+        void seed(const quint64 &seed);
+        const quint64 &getSeed() const;
+        // Seeds with the next seed of a fixed sequence, so repeated library
+        // runs give new patches and --random-seed still reproduces them:
+        void advanceSeed();
+
+        // spec: profile name ("random", "bass" or "pad"), optionally followed
+        // by ",keep-filter", ",keep-mod-matrix" and ",keep-sequencer"
+        bool setProfile(const QString &spec);
+        void setProfile(const int &profile, const int &keep = 0);
+        void setFilterBoard(const int &filter); // re-applies the profile
+        void setDistribution(const int &id, const Distribution &distribution);
+        const Distribution &distribution(const int &id) const;
+
+        // Replaces the parameters of patch (the starting patch) with the next
+        // random patch of the sequence:
+        void generate(Patch &patch);
+        // Same, but generates patch number index of the seed, independent of
+        // the sequence and of the other indices (for library ranges):
+        void generate(Patch &patch, const unsigned int &index);
+
+        // Random numbers:
+        quint32 next();
+        int uniform(const int &min, const int &max); // unbiased, both included
+        double normal(); // standard normal distribution
+
+    private:
+        void reseed(const quint64 &seed, const quint64 &stream);
+        void set(const int &id, const int &type, const int &min, const int &max, const int &center = 0, const int &spread = 0);
+        void keepRange(const int &from, const int &to);
+
+        // PCG32 state:
+        quint64 state;
+        quint64 increment;
+        quint64 mSeed;
+
+        int profile;
+        int keep;
+        int filter;
+        Distribution distributions[110];
+};
+
+
+#endif // SHRUTHI_PATCHGENERATOR_H
@@ -22,6 +22,9 @@
 
 
 #include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include "trace.h"
 
 
 namespace QueueAction {
@@ -33,8 +36,33 @@ enum QueueAction {
     NOTE_PANIC, SYSEX_SHRUTHI_INFO_REQUEST, SEQUENCE_PARAMETER_CHANGE_EDITOR,
     SYSEX_FETCH_SEQUENCE, SYSEX_SEND_SEQUENCE, RESET_SEQUENCE,
     LIBRARY_FETCH, LIBRARY_STORE, LIBRARY_RECALL, LIBRARY_SEND, LIBRARY_MOVE,
-    LIBRARY_LOAD, LIBRARY_SAVE, LIBRARY_REMOVE, LIBRARY_INSERT, LIBRARY_RESET
+    LIBRARY_LOAD, LIBRARY_SAVE, LIBRARY_REMOVE, LIBRARY_INSERT, LIBRARY_RESET,
+    FILEIO_LOADED, FILEIO_SAVED, LIBRARY_LOADED, LIBRARY_SAVED, FILEIO_CANCEL,
+    LIBRARY_IMPORT, LIBRARY_IMPORTED, LIBRARY_CANCEL_TRANSFER, UPGRADE_PATCH,
+    LIBRARY_UPGRADE, MORPH_START, MORPH_POSITION, MORPH_RAMP, MORPH_STOP,
+    RECORDER_RECORD, RECORDER_PLAY, RECORDER_STOP, LIBRARY_GENERATE
 };
+
+static const int COUNT = LIBRARY_GENERATE + 1;
+
+// Keep in sync with the enum above.
+inline const char *name(const int &action) {
+    static const char *names[COUNT] = {
+        "NOOP", "PATCH_PARAMETER_CHANGE_EDITOR", "SYSEX_FETCH_REQUEST",
+        "SYSEX_SEND_DATA", "PATCH_PARAMETER_CHANGE_MIDI", "SYSEX_RECEIVED",
+        "SET_PATCHNAME", "FILEIO_LOAD", "FILEIO_SAVE",
+        "RESET_PATCH", "RANDOMIZE_PATCH", "NOTE_ON", "NOTE_OFF",
+        "NOTE_PANIC", "SYSEX_SHRUTHI_INFO_REQUEST", "SEQUENCE_PARAMETER_CHANGE_EDITOR",
+        "SYSEX_FETCH_SEQUENCE", "SYSEX_SEND_SEQUENCE", "RESET_SEQUENCE",
+        "LIBRARY_FETCH", "LIBRARY_STORE", "LIBRARY_RECALL", "LIBRARY_SEND", "LIBRARY_MOVE",
+        "LIBRARY_LOAD", "LIBRARY_SAVE", "LIBRARY_REMOVE", "LIBRARY_INSERT", "LIBRARY_RESET",
+        "FILEIO_LOADED", "FILEIO_SAVED", "LIBRARY_LOADED", "LIBRARY_SAVED", "FILEIO_CANCEL",
+        "LIBRARY_IMPORT", "LIBRARY_IMPORTED", "LIBRARY_CANCEL_TRANSFER", "UPGRADE_PATCH",
+        "LIBRARY_UPGRADE", "MORPH_START", "MORPH_POSITION", "MORPH_RAMP", "MORPH_STOP",
+        "RECORDER_RECORD", "RECORDER_PLAY", "RECORDER_STOP", "LIBRARY_GENERATE"
+    };
+    return (action >= 0 && action < COUNT) ? names[action] : "UNKNOWN";
+}
 }
 
 
@@ -44,8 +72,11 @@ struct QueueItem {
         int int1;
         int int2;
         QString string;
+        QStringList strings; // only used by LIBRARY_IMPORT(ED)
         unsigned int size;
         unsigned char *message;
+        qint64 created; // Trace::now() at construction
+        quint32 traceId; // 0 if tracing is disabled
         // constructors:
         QueueItem() {
             action = QueueAction::NOOP;
@@ -55,6 +86,8 @@ struct QueueItem {
             string = QString::null;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = 0;
         }
         QueueItem(QueueAction::QueueAction a) {
             action = a;
@@ -64,6 +97,8 @@ struct QueueItem {
             string = QString::null;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
         QueueItem(QueueAction::QueueAction a, int i0, int i1, int i2) {
             action = a;
@@ -73,6 +108,8 @@ struct QueueItem {
             string = QString::null;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
         QueueItem(QueueAction::QueueAction a, int i0, int i1) {
             action = a;
@@ -82,6 +119,8 @@ struct QueueItem {
             string = QString::null;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
         QueueItem(QueueAction::QueueAction a, int i0) {
             action = a;
@@ -91,6 +130,8 @@ struct QueueItem {
             string = QString::null;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
         QueueItem(QueueAction::QueueAction a, QString s) {
             action = a;
@@ -100,6 +141,8 @@ struct QueueItem {
             string = s;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
         QueueItem(QueueAction::QueueAction a, QString s, int i0) {
             action = a;
@@ -109,6 +152,20 @@ struct QueueItem {
             string = s;
             size = 0;
             message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
+        }
+        QueueItem(QueueAction::QueueAction a, QStringList l, int i0) {
+            action = a;
+            int0 = i0;
+            int1 = 0;
+            int2 = 0;
+            string = QString::null;
+            strings = l;
+            size = 0;
+            message = NULL;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
         QueueItem(QueueAction::QueueAction a, unsigned char *m, unsigned int s) {
             action = a;
@@ -118,6 +175,8 @@ struct QueueItem {
             string = QString::null;
             size = s;
             message = m;
+            created = Trace::now();
+            traceId = Trace::begin(QueueAction::name(a), created);
         }
 };
 
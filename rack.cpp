@@ -0,0 +1,176 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "rack.h"
+#include <QDir>
+#include <QThread>
+#include "device.h"
+#include "log.h"
+#include "metrics.h"
+
+
+Rack::Rack():
+    running(0),
+    failed(0) {
+}
+
+
+Rack::~Rack() {
+    // The devices are deleted by their threads when they finished (see
+    // addDevice()), so their timers and MIDI input stop in the right thread:
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        disconnect(devices.at(i), NULL, this, NULL);
+        QMetaObject::invokeMethod(devices.at(i), "cancel", Qt::BlockingQueuedConnection);
+        threads.at(i)->quit();
+        threads.at(i)->wait();
+        delete threads.at(i);
+    }
+    devices.clear();
+    threads.clear();
+}
+
+
+bool Rack::addDevice(const QString &spec) {
+    const QStringList &fields = spec.split(":");
+    if (fields.size() < 3 || fields.size() > 4) {
+        LOG_WARNING(LogCategory::GENERAL) << "Rack::addDevice(): invalid device" << spec;
+        return false;
+    }
+    bool ok[4] = {true, true, true, true};
+    const int &input = fields.at(0).toInt(&ok[0]);
+    const int &output = fields.at(1).toInt(&ok[1]);
+    const int &channel = fields.at(2).toInt(&ok[2]);
+    const int &filter = fields.size() > 3 ? fields.at(3).toInt(&ok[3]) : 0;
+    if (!ok[0] || !ok[1] || !ok[2] || !ok[3] || channel < 1 || channel > 16) {
+        LOG_WARNING(LogCategory::GENERAL) << "Rack::addDevice(): invalid device" << spec;
+        return false;
+    }
+
+    const int &unit = devices.size() + 1;
+    Device *device = new Device(unit, input, output, channel - 1, filter);
+    QThread *thread = new QThread;
+    thread->setObjectName(QString("Rack unit %1").arg(unit));
+    device->moveToThread(thread);
+    connect(device, SIGNAL(progress(int,QString)), this, SLOT(deviceProgress(int,QString)));
+    connect(device, SIGNAL(finished(int,bool,QString)), this, SLOT(deviceFinished(int,bool,QString)));
+    connect(thread, SIGNAL(finished()), device, SLOT(deleteLater()));
+    thread->start();
+
+    devices.push_back(device);
+    threads.push_back(thread);
+    progress.push_back(QString());
+    LOG_INFO(LogCategory::GENERAL) << "Rack: unit" << unit << "on ports" << input << output << "channel" << channel;
+    return true;
+}
+
+
+int Rack::size() const {
+    return devices.size();
+}
+
+
+QString Rack::libraryPath(const QString &directory, const int &unit) {
+    return QDir(directory).filePath(QString("unit-%1.slb").arg(unit));
+}
+
+
+void Rack::start(const char *method, const QString &directory) {
+    if (devices.empty()) {
+        emit displayStatusbar("No rack devices, add them with --device <input>:<output>:<channel>.");
+        return;
+    }
+    if (running > 0) {
+        emit displayStatusbar("The rack is busy.");
+        return;
+    }
+    running = devices.size();
+    failed = 0;
+    results.clear();
+    clock.start();
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        progress.at(i) = "0%";
+        QMetaObject::invokeMethod(devices.at(i), method, Qt::QueuedConnection,
+                                  Q_ARG(QString, libraryPath(directory, devices.at(i)->unit())));
+    }
+}
+
+
+//
+// Slots:
+//
+
+
+void Rack::setMidiBackend(int backend) {
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        QMetaObject::invokeMethod(devices.at(i), "setMidiBackend", Qt::QueuedConnection, Q_ARG(int, backend));
+    }
+}
+
+
+void Rack::backup(QString directory) {
+    start("backup", directory);
+}
+
+
+void Rack::restore(QString directory) {
+    start("restore", directory);
+}
+
+
+void Rack::cancel() {
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        QMetaObject::invokeMethod(devices.at(i), "cancel", Qt::QueuedConnection);
+    }
+}
+
+
+void Rack::deviceProgress(int unit, QString status) {
+    if (unit < 1 || unit > (int) progress.size()) {
+        return;
+    }
+    progress.at(unit - 1) = status.remove(":").trimmed();
+    QStringList units;
+    for (unsigned int i = 0; i < progress.size(); i++) {
+        units << QString("unit %1: %2").arg(i + 1).arg(progress.at(i));
+    }
+    emit displayStatusbar("Rack " + units.join(", "));
+}
+
+
+void Rack::deviceFinished(int unit, bool ok, QString status) {
+    if (running == 0) {
+        return;
+    }
+    if (unit >= 1 && unit <= (int) progress.size()) {
+        progress.at(unit - 1) = ok ? "done" : "failed";
+    }
+    results << QString("unit %1 %2").arg(unit).arg(status);
+    if (!ok) {
+        failed++;
+    }
+    if (--running > 0) {
+        return;
+    }
+
+    const qint64 &elapsed = clock.elapsed();
+    static MetricsHistogram *duration = Metrics::histogram("rack.job_duration");
+    duration->record(elapsed * 1000);
+    emit displayStatusbar(QString("Rack done in %1 s (%2 failed): %3.").arg(elapsed / 1000.0, 0, 'f', 1).arg(failed).arg(results.join("; ")));
+}
@@ -0,0 +1,82 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_RACK_H
+#define SHRUTHI_RACK_H
+
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStringList>
+#include <vector>
+class Device;
+class QThread;
+
+
+// The Shruthis of the rack besides the one of the editor (see Device), each
+// on its own thread. Backups and restores run on all devices at once, so they
+// take as long as the slowest device instead of the sum of all of them.
+//
+// The libraries are saved to and loaded from unit-<n>.slb (indexed library
+// format, see LibraryFile) in a directory.
+class Rack : public QObject {
+        Q_OBJECT
+
+    public:
+        Rack();
+        ~Rack();
+
+        // spec is "<input port>:<output port>:<channel 1-16>[:<filter board>]"
+        bool addDevice(const QString &spec);
+        int size() const;
+
+        static QString libraryPath(const QString &directory, const int &unit);
+
+    private:
+        Rack(const Rack&); //forbid copying
+        Rack &operator=(const Rack&); //forbid assignment
+
+        void start(const char *method, const QString &directory);
+
+        std::vector<Device*> devices;
+        std::vector<QThread*> threads;
+        std::vector<QString> progress; // per device
+
+        int running;
+        int failed;
+        QStringList results;
+        QElapsedTimer clock;
+
+    public slots:
+        void setMidiBackend(int backend);
+        void backup(QString directory);
+        void restore(QString directory);
+        void cancel();
+
+    private slots:
+        void deviceProgress(int unit, QString status);
+        void deviceFinished(int unit, bool ok, QString status);
+
+    signals:
+        void displayStatusbar(QString);
+};
+
+
+#endif // SHRUTHI_RACK_H
@@ -0,0 +1,479 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "rawmidi.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <stddef.h> // for NULL
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "log.h"
+#ifdef __LINUX_ALSA__
+#include <alsa/asoundlib.h>
+#endif
+
+
+//
+// RawMidi
+//
+
+
+#ifdef __LINUX_ALSA__
+struct RawMidiPort {
+    std::string device;
+    std::string name;
+};
+
+
+static std::vector<RawMidiPort> listPorts(const snd_rawmidi_stream_t &stream) {
+    std::vector<RawMidiPort> ports;
+    char hw[32];
+    int card = -1;
+
+    while (snd_card_next(&card) == 0 && card >= 0) {
+        snprintf(hw, sizeof(hw), "hw:%d", card);
+        snd_ctl_t *ctl;
+        if (snd_ctl_open(&ctl, hw, 0) < 0) {
+            continue;
+        }
+
+        int device = -1;
+        while (snd_ctl_rawmidi_next_device(ctl, &device) == 0 && device >= 0) {
+            snd_rawmidi_info_t *info;
+            snd_rawmidi_info_alloca(&info);
+            snd_rawmidi_info_set_device(info, device);
+            snd_rawmidi_info_set_subdevice(info, 0);
+            snd_rawmidi_info_set_stream(info, stream);
+            if (snd_ctl_rawmidi_info(ctl, info) < 0) {
+                continue;
+            }
+
+            const int &subdevices = snd_rawmidi_info_get_subdevices_count(info);
+            for (int sub = 0; sub < subdevices; sub++) {
+                snd_rawmidi_info_set_subdevice(info, sub);
+                if (snd_ctl_rawmidi_info(ctl, info) < 0) {
+                    continue;
+                }
+                snprintf(hw, sizeof(hw), "hw:%d,%d,%d", card, device, sub);
+
+                RawMidiPort port;
+                port.device = hw;
+                const char *name = snd_rawmidi_info_get_subdevice_name(info);
+                if (name == NULL || name[0] == 0) {
+                    name = snd_rawmidi_info_get_name(info);
+                }
+                port.name = std::string(name) + " (" + hw + ")";
+                ports.push_back(port);
+            }
+        }
+        snd_ctl_close(ctl);
+    }
+    return ports;
+}
+#endif
+
+
+bool RawMidi::available() {
+#ifdef __LINUX_ALSA__
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+unsigned int RawMidi::getInputCount() {
+#ifdef __LINUX_ALSA__
+    return listPorts(SND_RAWMIDI_STREAM_INPUT).size();
+#else
+    return 0;
+#endif
+}
+
+
+unsigned int RawMidi::getOutputCount() {
+#ifdef __LINUX_ALSA__
+    return listPorts(SND_RAWMIDI_STREAM_OUTPUT).size();
+#else
+    return 0;
+#endif
+}
+
+
+std::string RawMidi::getInputName(const unsigned int &port) {
+#ifdef __LINUX_ALSA__
+    const std::vector<RawMidiPort> &ports = listPorts(SND_RAWMIDI_STREAM_INPUT);
+    if (port < ports.size()) {
+        return ports[port].name;
+    }
+#else
+    Q_UNUSED(port);
+#endif
+    return std::string();
+}
+
+
+std::string RawMidi::getOutputName(const unsigned int &port) {
+#ifdef __LINUX_ALSA__
+    const std::vector<RawMidiPort> &ports = listPorts(SND_RAWMIDI_STREAM_OUTPUT);
+    if (port < ports.size()) {
+        return ports[port].name;
+    }
+#else
+    Q_UNUSED(port);
+#endif
+    return std::string();
+}
+
+
+std::string RawMidi::getInputDevice(const unsigned int &port) {
+#ifdef __LINUX_ALSA__
+    const std::vector<RawMidiPort> &ports = listPorts(SND_RAWMIDI_STREAM_INPUT);
+    if (port < ports.size()) {
+        return ports[port].device;
+    }
+#else
+    Q_UNUSED(port);
+#endif
+    return std::string();
+}
+
+
+std::string RawMidi::getOutputDevice(const unsigned int &port) {
+#ifdef __LINUX_ALSA__
+    const std::vector<RawMidiPort> &ports = listPorts(SND_RAWMIDI_STREAM_OUTPUT);
+    if (port < ports.size()) {
+        return ports[port].device;
+    }
+#else
+    Q_UNUSED(port);
+#endif
+    return std::string();
+}
+
+
+//
+// RawMidiOut
+//
+
+
+RawMidiOut::RawMidiOut() {
+    handle = NULL;
+    runningStatusEnabled = true;
+    runningStatus = 0;
+}
+
+
+RawMidiOut::~RawMidiOut() {
+    close();
+}
+
+
+bool RawMidiOut::open(const std::string &device) {
+    LOG_DEBUG(LogCategory::MIDI) << "RawMidiOut::open(" << device.c_str() << ")";
+    close();
+#ifdef __LINUX_ALSA__
+    if (device.empty()) {
+        LOG_WARNING(LogCategory::MIDI) << "RawMidiOut::open(): trying to open rawmidi port for writing which doesn't exist.";
+        return false;
+    }
+    // Blocking mode: large SysEx dumps are paced by the driver.
+    const int &err = snd_rawmidi_open(NULL, &handle, device.c_str(), 0);
+    if (err < 0) {
+        LOG_WARNING(LogCategory::MIDI) << "RawMidiOut::open(): could not open" << device.c_str() << ":" << snd_strerror(err);
+        handle = NULL;
+        return false;
+    }
+    runningStatus = 0;
+    return true;
+#else
+    LOG_WARNING(LogCategory::MIDI) << "RawMidiOut::open(): rawmidi is not available on this platform.";
+    return false;
+#endif
+}
+
+
+void RawMidiOut::close() {
+#ifdef __LINUX_ALSA__
+    if (handle) {
+        snd_rawmidi_drain(handle);
+        snd_rawmidi_close(handle);
+    }
+#endif
+    handle = NULL;
+    runningStatus = 0;
+}
+
+
+bool RawMidiOut::isOpen() {
+    return handle != NULL;
+}
+
+
+void RawMidiOut::setRunningStatus(const bool &enabled) {
+    runningStatusEnabled = enabled;
+    runningStatus = 0;
+}
+
+
+bool RawMidiOut::send(const Message &message) {
+    if (!handle || message.empty()) {
+        return false;
+    }
+
+    const unsigned char &status = message[0];
+    if (status >= 0xf8) {
+        // Real-time messages may be interleaved and don't touch running status.
+        return write(&message[0], message.size());
+    }
+    if (status >= 0xf0) {
+        // SysEx and system common messages cancel running status.
+        runningStatus = 0;
+        return write(&message[0], message.size());
+    }
+    if (runningStatusEnabled && status == runningStatus && message.size() > 1) {
+        return write(&message[1], message.size() - 1);
+    }
+    runningStatus = status;
+    return write(&message[0], message.size());
+}
+
+
+bool RawMidiOut::write(const unsigned char *data, const unsigned int &size) {
+#ifdef __LINUX_ALSA__
+    unsigned int written = 0;
+    while (written < size) {
+        const ssize_t &n = snd_rawmidi_write(handle, data + written, size - written);
+        if (n < 0) {
+            LOG_DEBUG(LogCategory::MIDI) << "RawMidiOut::write(): could not send:" << snd_strerror(n);
+            // The receiver may have lost sync, resend the status byte next time.
+            runningStatus = 0;
+            return false;
+        }
+        written += n;
+    }
+    return true;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+
+//
+// RawMidiIn
+//
+
+
+class RawMidiReader : public QThread {
+    public:
+        RawMidiReader(RawMidiIn *in): in(in) {}
+
+    protected:
+        void run() {
+            in->read();
+        }
+
+    private:
+        RawMidiIn *in;
+};
+
+
+RawMidiIn::RawMidiIn():
+    handle(NULL),
+    reader(NULL),
+    running(0),
+    callback(NULL),
+    userData(NULL),
+    runningStatus(0),
+    expected(0),
+    sysex(false),
+    currentTime(0),
+    lastTime(-1) {
+}
+
+
+RawMidiIn::~RawMidiIn() {
+    close();
+}
+
+
+void RawMidiIn::setCallback(Callback cb, void *data) {
+    callback = cb;
+    userData = data;
+}
+
+
+bool RawMidiIn::open(const std::string &device) {
+    LOG_DEBUG(LogCategory::MIDI) << "RawMidiIn::open(" << device.c_str() << ")";
+    close();
+#ifdef __LINUX_ALSA__
+    if (device.empty()) {
+        LOG_WARNING(LogCategory::MIDI) << "RawMidiIn::open(): trying to open rawmidi port for reading which doesn't exist.";
+        return false;
+    }
+    const int &err = snd_rawmidi_open(&handle, NULL, device.c_str(), SND_RAWMIDI_NONBLOCK);
+    if (err < 0) {
+        LOG_WARNING(LogCategory::MIDI) << "RawMidiIn::open(): could not open" << device.c_str() << ":" << snd_strerror(err);
+        handle = NULL;
+        return false;
+    }
+
+    message.clear();
+    runningStatus = 0;
+    expected = 0;
+    sysex = false;
+    currentTime = 0;
+    lastTime = -1;
+
+    running.fetchAndStoreOrdered(1);
+    reader = new RawMidiReader(this);
+    reader->start();
+    return true;
+#else
+    LOG_WARNING(LogCategory::MIDI) << "RawMidiIn::open(): rawmidi is not available on this platform.";
+    return false;
+#endif
+}
+
+
+void RawMidiIn::close() {
+    if (reader) {
+        running.fetchAndStoreOrdered(0);
+        reader->wait();
+        delete reader;
+        reader = NULL;
+    }
+#ifdef __LINUX_ALSA__
+    if (handle) {
+        snd_rawmidi_close(handle);
+    }
+#endif
+    handle = NULL;
+}
+
+
+bool RawMidiIn::isOpen() {
+    return handle != NULL;
+}
+
+
+void RawMidiIn::read() {
+    // Runs on the reader thread.
+#ifdef __LINUX_ALSA__
+    QElapsedTimer timer;
+    timer.start();
+
+    const int &count = snd_rawmidi_poll_descriptors_count(handle);
+    std::vector<struct pollfd> fds(count);
+    snd_rawmidi_poll_descriptors(handle, &fds[0], count);
+
+    unsigned char buffer[256];
+    while (running.fetchAndAddRelaxed(0)) {
+        // Wake up regularly to check whether the port is being closed.
+        if (poll(&fds[0], count, 50) <= 0) {
+            continue;
+        }
+        const ssize_t &n = snd_rawmidi_read(handle, buffer, sizeof(buffer));
+        if (n == -EAGAIN) {
+            continue;
+        }
+        if (n < 0) {
+            LOG_WARNING(LogCategory::MIDI) << "RawMidiIn::read(): stopped reading:" << snd_strerror(n);
+            return;
+        }
+        currentTime = timer.nsecsElapsed() / 1e9;
+        for (ssize_t i = 0; i < n; i++) {
+            parse(buffer[i]);
+        }
+    }
+#endif
+}
+
+
+void RawMidiIn::parse(const unsigned char &byte) {
+    if (byte >= 0xf8) {
+        // Real-time messages (clock, active sensing, ...) are ignored, just
+        // like RtMidi's ignoreTypes(false, true, true) in MidiIn.
+        return;
+    }
+
+    if (byte == 0xf0) {
+        message.clear();
+        message.push_back(byte);
+        sysex = true;
+        runningStatus = 0;
+        return;
+    }
+
+    if (byte == 0xf7) {
+        if (sysex) {
+            message.push_back(byte);
+            deliver();
+        }
+        sysex = false;
+        return;
+    }
+
+    if (byte & 0x80) {
+        // Any other status byte terminates an unfinished SysEx.
+        sysex = false;
+        message.clear();
+        if (byte >= 0xf0) {
+            // System common messages cancel running status and are ignored.
+            runningStatus = 0;
+            return;
+        }
+        runningStatus = byte;
+        const unsigned char &type = byte & 0xf0;
+        expected = (type == 0xc0 || type == 0xd0) ? 2 : 3;
+        message.push_back(byte);
+        return;
+    }
+
+    // Data byte:
+    if (sysex) {
+        message.push_back(byte);
+        return;
+    }
+    if (runningStatus == 0) {
+        return; // data of a system common message
+    }
+    if (message.empty()) {
+        message.push_back(runningStatus);
+    }
+    message.push_back(byte);
+    if (message.size() == expected) {
+        deliver();
+    }
+}
+
+
+void RawMidiIn::deliver() {
+    if (callback) {
+        // Like RtMidi, the first message has a delta time of 0.
+        const double &delta = lastTime < 0 ? 0 : currentTime - lastTime;
+        lastTime = currentTime;
+        callback(delta, &message, userData);
+    }
+    message.clear();
+}
@@ -0,0 +1,117 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_RAWMIDI_H
+#define SHRUTHI_RAWMIDI_H
+
+
+#include <QAtomicInt>
+#include <string>
+#include "message.h"
+struct _snd_rawmidi;
+class RawMidiReader;
+
+
+// Selects how the editor talks to the Shruthi:
+//  * SEQUENCER: RtMidi (ALSA sequencer, CoreMIDI, Windows MM).
+//  * RAWMIDI: ALSA rawmidi, bytes are written straight to the device. This
+//    avoids the sequencer's per-event encoding and scheduling (Linux only).
+class MidiBackend {
+    public:
+        static const int SEQUENCER = 0;
+        static const int RAWMIDI = 1;
+};
+
+
+// Enumeration of the rawmidi (hw:card,device,subdevice) ports.
+class RawMidi {
+    public:
+        static bool available();
+        static unsigned int getInputCount();
+        static unsigned int getOutputCount();
+        static std::string getInputName(const unsigned int &port);
+        static std::string getOutputName(const unsigned int &port);
+        static std::string getInputDevice(const unsigned int &port);
+        static std::string getOutputDevice(const unsigned int &port);
+};
+
+
+class RawMidiOut {
+    public:
+        RawMidiOut();
+        ~RawMidiOut();
+        bool open(const std::string &device);
+        void close();
+        bool isOpen();
+        bool send(const Message &message);
+        void setRunningStatus(const bool &enabled);
+
+    private:
+        RawMidiOut(const RawMidiOut&); //forbid copying
+        RawMidiOut &operator=(const RawMidiOut&); //forbid assignment
+
+        bool write(const unsigned char *data, const unsigned int &size);
+
+        _snd_rawmidi *handle;
+        bool runningStatusEnabled;
+        // Last channel voice status byte on the wire, 0 if unknown:
+        unsigned char runningStatus;
+};
+
+
+class RawMidiIn {
+    public:
+        // Same signature as RtMidiIn::RtMidiCallback:
+        typedef void (*Callback)(double deltatime, Message *message, void *userData);
+
+        RawMidiIn();
+        ~RawMidiIn();
+        bool open(const std::string &device);
+        void close();
+        bool isOpen();
+        void setCallback(Callback callback, void *userData);
+
+    private:
+        RawMidiIn(const RawMidiIn&); //forbid copying
+        RawMidiIn &operator=(const RawMidiIn&); //forbid assignment
+
+        friend class RawMidiReader;
+        void read();
+        void parse(const unsigned char &byte);
+        void deliver();
+
+        _snd_rawmidi *handle;
+        RawMidiReader *reader;
+        QAtomicInt running;
+
+        Callback callback;
+        void *userData;
+
+        // Parser state, only touched by the reader thread:
+        Message message;
+        unsigned char runningStatus;
+        unsigned int expected;
+        bool sysex;
+        double currentTime;
+        double lastTime;
+};
+
+
+#endif // SHRUTHI_RAWMIDI_H
@@ -18,10 +18,10 @@
 
 
 #include "sequence.h"
-#include <QDebug>
 #include <QStringList>
 #include <iostream>
 #include "labels.h"
+#include "log.h"
 #include "midi.h"
 
 
@@ -36,7 +36,7 @@ const int Sequence::ERROR_RETURN = -111;
 bool Sequence::parseSysex(const Message *message) {
     // len should be 75
     if (message->size() != 75) {
-        qDebug() << "Sequence::parseFullSysex(): wrong length.";
+        LOG_DEBUG(LogCategory::PATCH) << "Sequence::parseFullSysex(): wrong length.";
         return false;
     }
 
@@ -0,0 +1,202 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "session.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm> // for equal
+#include "log.h"
+#include "midiin.h"
+#include "trace.h" // for Trace::now()
+
+
+static const char MAGIC[8] = {'S', 'H', 'R', 'S', 'E', 'S', 'S', 1};
+
+
+QAtomicInt MidiSession::active(0);
+
+
+struct SessionFile {
+    SessionFile() :
+        last(0) {
+    }
+
+    QMutex mutex;
+    QFile file;
+    qint64 last;
+};
+
+
+static SessionFile &session() {
+    static SessionFile s;
+    return s;
+}
+
+
+static void appendUInt32(QByteArray &data, const quint32 &value) {
+    for (int i = 0; i < 4; i++) {
+        data.append((char) ((value >> (8 * i)) & 0xff));
+    }
+}
+
+
+static quint32 readUInt32(const unsigned char *data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (quint32) data[3] << 24;
+}
+
+
+bool MidiSession::startRecording(const QString &path) {
+    QMutexLocker locker(&session().mutex);
+    if (session().file.isOpen()) {
+        session().file.close();
+    }
+    session().file.setFileName(path);
+    if (!session().file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARNING(LogCategory::FILEIO) << "MidiSession::startRecording(): could not open" << path;
+        return false;
+    }
+    session().file.write(MAGIC, sizeof(MAGIC));
+    session().last = Trace::now();
+    active.fetchAndStoreRelaxed(1);
+    LOG_INFO(LogCategory::MIDI) << "Recording the MIDI session to" << path;
+    return true;
+}
+
+
+void MidiSession::stopRecording() {
+    active.fetchAndStoreRelaxed(0);
+    QMutexLocker locker(&session().mutex);
+    if (session().file.isOpen()) {
+        session().file.close();
+    }
+}
+
+
+void MidiSession::record(const unsigned char &direction, const Message &message) {
+    if (!recording()) {
+        return;
+    }
+    QMutexLocker locker(&session().mutex);
+    if (!session().file.isOpen()) {
+        return;
+    }
+    const qint64 &time = Trace::now();
+    const qint64 &delta = qMin(time - session().last, (qint64) 0xffffffff);
+    session().last = time;
+
+    QByteArray data;
+    data.reserve(9 + message.size());
+    appendUInt32(data, delta);
+    data.append((char) direction);
+    appendUInt32(data, message.size());
+    if (!message.empty()) {
+        data.append((const char*) &message[0], message.size());
+    }
+    session().file.write(data);
+}
+
+
+bool MidiSession::load(const QString &path, std::vector<MidiSessionRecord> &records) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        LOG_WARNING(LogCategory::FILEIO) << "MidiSession::load(): could not open" << path;
+        return false;
+    }
+    const QByteArray &data = file.readAll();
+    file.close();
+
+    const unsigned char *bytes = (const unsigned char*) data.constData();
+    const unsigned int &size = data.size();
+    if (size < sizeof(MAGIC) || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), data.constData())) {
+        LOG_WARNING(LogCategory::FILEIO) << "MidiSession::load():" << path << "is not a session recording.";
+        return false;
+    }
+
+    qint64 time = 0;
+    unsigned int pos = sizeof(MAGIC);
+    while (pos + 9 <= size) {
+        MidiSessionRecord record;
+        time += readUInt32(bytes + pos);
+        record.time = time;
+        record.direction = bytes[pos + 4];
+        const quint32 &length = readUInt32(bytes + pos + 5);
+        pos += 9;
+        if (length > size - pos) {
+            LOG_WARNING(LogCategory::FILEIO) << "MidiSession::load():" << path << "is truncated.";
+            break;
+        }
+        record.message.assign(bytes + pos, bytes + pos + length);
+        pos += length;
+        records.push_back(record);
+    }
+    return true;
+}
+
+
+//
+// MidiReplay
+//
+
+
+MidiReplay::MidiReplay(MidiIn *midiin, const QString &path, const double &speed):
+    midiin(midiin),
+    path(path),
+    speed(speed),
+    stopRequested(0) {
+}
+
+
+void MidiReplay::stop() {
+    stopRequested.fetchAndStoreOrdered(1);
+    wait();
+}
+
+
+void MidiReplay::run() {
+    std::vector<MidiSessionRecord> records;
+    if (!MidiSession::load(path, records)) {
+        return;
+    }
+    LOG_INFO(LogCategory::MIDI) << "Replaying" << records.size() << "messages from" << path;
+
+    QElapsedTimer timer;
+    timer.start();
+    unsigned int replayed = 0;
+    for (unsigned int i = 0; i < records.size() && !stopRequested.fetchAndAddRelaxed(0); i++) {
+        MidiSessionRecord &record = records[i];
+        if (record.direction != MidiSession::IN) {
+            continue; // the editor generates its own output
+        }
+        if (speed > 0) {
+            const qint64 &due = record.time / speed;
+            qint64 wait = due - timer.nsecsElapsed() / 1000;
+            while (wait > 0 && !stopRequested.fetchAndAddRelaxed(0)) {
+                // Sleep in slices, so stop() doesn't have to wait for long pauses:
+                QThread::usleep(qMin(wait, (qint64) 100000));
+                wait = due - timer.nsecsElapsed() / 1000;
+            }
+        }
+        midiin->process(&record.message);
+        replayed++;
+    }
+    LOG_INFO(LogCategory::MIDI) << "Replayed" << replayed << "messages in" << timer.elapsed() << "ms.";
+}
@@ -0,0 +1,91 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_SESSION_H
+#define SHRUTHI_SESSION_H
+
+
+#include <QAtomicInt>
+#include <QString>
+#include <QThread>
+#include <vector>
+#include "message.h"
+class MidiIn;
+
+
+struct MidiSessionRecord {
+    qint64 time; // microseconds since the start of the recording
+    unsigned char direction;
+    Message message;
+};
+
+
+// Records the raw MIDI messages exchanged with the Shruthi (at MidiIn::process
+// and MidiOut::send) into a binary file, e.g. to capture a slow library fetch.
+//
+// File format, integers are little endian:
+//   header: "SHRSESS" and a version byte (1)
+//   records: time since the previous record in microseconds (uint32),
+//            direction (uint8), length (uint32), message bytes
+class MidiSession {
+    public:
+        static const unsigned char IN = 0; // Shruthi to editor
+        static const unsigned char OUT = 1; // editor to Shruthi
+
+        static bool startRecording(const QString &path);
+        static void stopRecording();
+        static inline bool recording() {
+            return active.fetchAndAddRelaxed(0) != 0;
+        }
+        static void record(const unsigned char &direction, const Message &message);
+
+        static bool load(const QString &path, std::vector<MidiSessionRecord> &records);
+
+    private:
+        MidiSession(); // static only
+
+        static QAtomicInt active;
+};
+
+
+// Feeds the incoming messages of a recorded session through MidiIn::process,
+// so they reach the SignalRouter and Editor as if they came from the Shruthi.
+// A speed of 1 keeps the original timing, 2 replays twice as fast and 0 as
+// fast as possible. Don't replay while a real input port is open.
+class MidiReplay : public QThread {
+    public:
+        MidiReplay(MidiIn *midiin, const QString &path, const double &speed = 1);
+        void stop();
+
+    protected:
+        void run();
+
+    private:
+        MidiReplay(const MidiReplay&); //forbid copying
+        MidiReplay &operator=(const MidiReplay&); //forbid assignment
+
+        MidiIn *midiin;
+        QString path;
+        double speed;
+        QAtomicInt stopRequested; // set by stop() only, also before run() started
+};
+
+
+#endif // SHRUTHI_SESSION_H
@@ -33,55 +33,102 @@ HEADERS = \
     ui/keyboard_widget.h \
     ui/library_dialog.h \
     ui/main_window.h \
+    ui/metrics_dialog.h \
+    ui/morph_dialog.h \
+    ui/recorder_dialog.h \
     ui/sequence_editor.h \
     ui/sequence_step.h \
     ui/settings_dialog.h \
     ui/shruthi_editor_dial.h \
     RtMidi.h \
+    broadcast.h \
     config.h \
+    device.h \
     editor.h \
     fileio.h \
+    fileworker.h \
     flag.h \
     labels.h \
     library.h \
+    libraryfile.h \
+    libraryjournal.h \
+    log.h \
     message.h \
+    metrics.h \
     midi.h \
     midiin.h \
+    midischeduler.h \
+    midithru.h \
     midiout.h \
+    morph.h \
+    parameterrecorder.h \
     patch.h \
+    patchgenerator.h \
     queueitem.h \
+    rack.h \
+    rawmidi.h \
     sequence.h \
     sequence_parameter.h \
+    session.h \
     signalrouter.h \
-    version.h
+    trace.h \
+    transferqueue.h \
+    version.h \
+    virtualshruthi.h \
+    voiceallocator.h
 
 SOURCES = \
     ui/keyboard_dialog.cpp \
     ui/keyboard_widget.cpp \
     ui/library_dialog.cpp \
     ui/main_window.cpp \
+    ui/metrics_dialog.cpp \
+    ui/morph_dialog.cpp \
+    ui/recorder_dialog.cpp \
     ui/sequence_editor.cpp \
     ui/sequence_step.cpp \
     ui/settings_dialog.cpp \
     ui/shruthi_editor_dial.cpp \
     RtMidi.cpp \
+    broadcast.cpp \
     config.cpp \
+    device.cpp \
     editor.cpp \
     fileio.cpp \
+    fileworker.cpp \
     labels.cpp \
     library.cpp \
+    libraryfile.cpp \
+    libraryjournal.cpp \
+    log.cpp \
     main.cpp \
+    metrics.cpp \
     midi.cpp \
     midiin.cpp \
+    midischeduler.cpp \
+    midithru.cpp \
     midiout.cpp \
+    morph.cpp \
+    parameterrecorder.cpp \
     patch.cpp \
+    patchgenerator.cpp \
+    rack.cpp \
+    rawmidi.cpp \
     sequence.cpp \
-    signalrouter.cpp
+    session.cpp \
+    signalrouter.cpp \
+    trace.cpp \
+    transferqueue.cpp \
+    virtualshruthi.cpp \
+    voiceallocator.cpp
 
 FORMS = \
     ui/keyboard_dialog.ui \
     ui/library_dialog.ui \
     ui/main_window.ui \
+    ui/metrics_dialog.ui \
+    ui/morph_dialog.ui \
+    ui/recorder_dialog.ui \
     ui/sequence_editor.ui \
     ui/sequence_step.ui \
     ui/settings_dialog.ui \
@@ -103,7 +150,7 @@ include(translations.pri)
 #
 
 QT += core gui
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 CONFIG += qt
 
@@ -123,7 +170,7 @@ equals(QT_MAJOR_VERSION, 4): DEFINES += CLEANLOOKS
 
 
 unix:!macx {
-    message(RtMidi will use linux alsaseq.)
+    message(RtMidi will use linux alsaseq, rawmidi backend available.)
     # alsa:
     DEFINES += __LINUX_ALSA__
     LIBS += -lasound
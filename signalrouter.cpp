@@ -18,35 +18,36 @@
 
 
 #include "signalrouter.h"
-#ifdef DEBUGMSGS
-#include <QDebug>
-#endif
+#include "log.h"
+#include "metrics.h"
+#include "rawmidi.h" // for MidiBackend
+#include "trace.h"
 
 
 SignalRouter::SignalRouter() {
-#ifdef DEBUGMSGS
-    qDebug() << "SignalRouter::SignalRouter()";
-#endif
+    LOG_DEBUG(LogCategory::GENERAL) << "SignalRouter::SignalRouter()";
     // load config
     config = Config();
     config.load();
+
+    queueDepth = Metrics::gauge("router.queue.depth");
+    queueItems = Metrics::counter("router.queue.items");
 }
 
 
 SignalRouter::~SignalRouter() {
-#ifdef DEBUGMSGS
-    qDebug() << "SignalRouter::~SignalRouter()";
-#endif
+    LOG_DEBUG(LogCategory::GENERAL) << "SignalRouter::~SignalRouter()";
     editorEnabled = false;
 }
 
 
 void SignalRouter::run() {
-#ifdef DEBUGMSGS
-    qDebug() << "SignalRouter::run()";
-#endif
+    LOG_DEBUG(LogCategory::GENERAL) << "SignalRouter::run()";
+    emit setMidiBackend(config.midiBackend());
     emit setMidiInputPort(config.midiInputPort());
     emit setMidiOutputPort(config.midiOutputPort());
+    emit setMidiThruPort(thruPort(config));
+    emit setMidiVirtualPorts(config.midiVirtualPorts());
     emit setMidiChannel(config.midiChannel());
     emit setShruthiFilterBoard(config.shruthiFilterBoard());
     editorEnabled = true;
@@ -55,11 +56,15 @@ void SignalRouter::run() {
 
 
 void SignalRouter::enqueue(QueueItem item) {
+    queueItems->add();
+    Trace::instant("enqueue", item.traceId);
     if (editorWorking) {
         queue.enqueue(item);
+        queueDepth->set(queue.size());
     } else if (editorEnabled) {
         editorWorking = true;
 
+        Trace::instant("dispatch", item.traceId);
         emit editorProcess(item);
     }
 }
@@ -68,7 +73,10 @@ void SignalRouter::enqueue(QueueItem item) {
 void SignalRouter::editorFinished() {
     if (editorEnabled) {
         if (!queue.isEmpty()) {
-            emit editorProcess(queue.dequeue());
+            const QueueItem &item = queue.dequeue();
+            queueDepth->set(queue.size());
+            Trace::instant("dispatch", item.traceId);
+            emit editorProcess(item);
         } else {
             editorWorking = false;
         }
@@ -77,23 +85,36 @@ void SignalRouter::editorFinished() {
 
 
 void SignalRouter::settingsChanged(Config conf) {
-#ifdef DEBUGMSGS
-    qDebug() << "SignalRouter::settingsChanged: in" << conf.midiInputPort() << ", out:" << conf.midiOutputPort() << ", channel:" << conf.midiChannel() << ", filter:" << conf.shruthiFilterBoard();
-#endif
+    LOG_DEBUG(LogCategory::GENERAL) << "SignalRouter::settingsChanged: backend" << conf.midiBackend() << ", in" << conf.midiInputPort() << ", out:" << conf.midiOutputPort() << ", thru:" << conf.midiThruPort() << ", channel:" << conf.midiChannel() << ", filter:" << conf.shruthiFilterBoard();
     // setMidiInputPort and setMidiOutputPort have to be emited, even if the value didn't change.
+    // The backend has to be set first, the port numbers depend on it.
+    emit setMidiBackend(conf.midiBackend());
     emit setMidiInputPort(conf.midiInputPort());
     emit setMidiOutputPort(conf.midiOutputPort());
+    emit setMidiThruPort(thruPort(conf));
     emit setMidiChannel(conf.midiChannel());
 
+    if (config.midiVirtualPorts() != conf.midiVirtualPorts()) {
+        emit setMidiVirtualPorts(conf.midiVirtualPorts());
+    }
+
     if (config.shruthiFilterBoard() != conf.shruthiFilterBoard()) {
         emit setShruthiFilterBoard(conf.shruthiFilterBoard());
     }
 
     if (!config.equals(conf)) {
-#ifdef DEBUGMSGS
-        qDebug() << "Config was changed. Saving.";
-#endif
+        LOG_DEBUG(LogCategory::GENERAL) << "Config was changed. Saving.";
         config.set(conf);
         config.save();
     }
 }
+
+
+int SignalRouter::thruPort(const Config &conf) {
+    // Never forward the Shruthi's own output back to it (the thru input always
+    // uses the sequencer, so the port numbers are only comparable there):
+    if (conf.midiBackend() == MidiBackend::SEQUENCER && conf.midiThruPort() == conf.midiInputPort()) {
+        return -1;
+    }
+    return conf.midiThruPort();
+}
@@ -25,6 +25,8 @@
 #include <QQueue>
 #include "config.h"
 #include "queueitem.h"
+class MetricsCounter;
+class MetricsGauge;
 
 
 class SignalRouter : public QObject {
@@ -37,6 +39,8 @@ class SignalRouter : public QObject {
         bool editorWorking;
         bool editorEnabled;
         QQueue<QueueItem> queue;
+        MetricsGauge *queueDepth;
+        MetricsCounter *queueItems;
 
     private:
         SignalRouter(const SignalRouter&); //forbid copying
@@ -44,6 +48,8 @@ class SignalRouter : public QObject {
 
         Config config;
 
+        int thruPort(const Config &conf);
+
     public slots:
         void run();
         void enqueue(QueueItem);
@@ -52,8 +58,11 @@ class SignalRouter : public QObject {
 
     signals:
         void editorProcess(QueueItem);
+        void setMidiBackend(int);
         void setMidiInputPort(int);
         void setMidiOutputPort(int);
+        void setMidiThruPort(int);
+        void setMidiVirtualPorts(bool);
         void setMidiChannel(unsigned char);
         void setShruthiFilterBoard(int);
 };
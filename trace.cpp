@@ -0,0 +1,209 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "trace.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QString>
+#include <QThread>
+#include <map>
+#include <sstream>
+#include <vector>
+
+
+QAtomicInt Trace::active(0);
+
+
+struct TraceEvent {
+    const char *name;
+    char phase;
+    qint64 time;
+    qint64 duration;
+    quint64 thread;
+    quint32 id;
+    int arg;
+};
+
+
+struct TraceBuffer {
+    // ~10 MB, enough for a couple of minutes of dial twiddling.
+    static const unsigned int MAX_EVENTS = 250000;
+
+    TraceBuffer() :
+        nextId(1),
+        dropped(0),
+        current(0) {
+        clock.start();
+    }
+
+    QMutex mutex;
+    std::vector<TraceEvent> events;
+    std::map<quint64, std::string> threads;
+    QElapsedTimer clock;
+    QAtomicInt nextId;
+    unsigned int dropped;
+    QAtomicInt current;
+};
+
+
+// Constructed during static initialization, so the clock starts with the
+// program and the first use is never racing.
+static TraceBuffer buffer;
+
+
+static void record(const char *name, const char &phase, const qint64 &time, const qint64 &duration, const quint32 &id, const int &arg) {
+    const quint64 &thread = (quintptr) QThread::currentThreadId();
+    QMutexLocker locker(&buffer.mutex);
+    if (buffer.events.size() >= TraceBuffer::MAX_EVENTS) {
+        buffer.dropped++;
+        return;
+    }
+    if (buffer.threads.find(thread) == buffer.threads.end()) {
+        const QString &threadName = QThread::currentThread()->objectName();
+        buffer.threads[thread] = threadName.isEmpty() ? "thread" : threadName.toStdString();
+    }
+    TraceEvent event;
+    event.name = name;
+    event.phase = phase;
+    event.time = time;
+    event.duration = duration;
+    event.thread = thread;
+    event.id = id;
+    event.arg = arg;
+    buffer.events.push_back(event);
+}
+
+
+void Trace::start() {
+    QMutexLocker locker(&buffer.mutex);
+    buffer.events.clear();
+    buffer.events.reserve(TraceBuffer::MAX_EVENTS / 8);
+    buffer.dropped = 0;
+    active.fetchAndStoreRelaxed(1);
+}
+
+
+void Trace::stop() {
+    active.fetchAndStoreRelaxed(0);
+}
+
+
+qint64 Trace::now() {
+    return buffer.clock.nsecsElapsed() / 1000;
+}
+
+
+quint32 Trace::begin(const char *name, const qint64 &time) {
+    if (!enabled()) {
+        return 0;
+    }
+    const quint32 &id = buffer.nextId.fetchAndAddRelaxed(1);
+    record(name, 'b', time, 0, id, -1);
+    return id;
+}
+
+
+void Trace::end(const char *name, const quint32 &id) {
+    if (id && enabled()) {
+        record(name, 'e', now(), 0, id, -1);
+    }
+}
+
+
+void Trace::instant(const char *name, const quint32 &id) {
+    if (id && enabled()) {
+        record(name, 'n', now(), 0, id, -1);
+    }
+}
+
+
+void Trace::complete(const char *name, const quint32 &id, const qint64 &start, const int &arg) {
+    if (enabled()) {
+        record(name, 'X', start, now() - start, id, arg);
+    }
+}
+
+
+void Trace::setCurrent(const quint32 &id) {
+    buffer.current.fetchAndStoreRelaxed(id);
+}
+
+
+quint32 Trace::current() {
+    return buffer.current.fetchAndAddRelaxed(0);
+}
+
+
+unsigned int Trace::dropped() {
+    QMutexLocker locker(&buffer.mutex);
+    return buffer.dropped;
+}
+
+
+std::string Trace::toJson() {
+    QMutexLocker locker(&buffer.mutex);
+    std::ostringstream os;
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"shruthi-editor\"}}";
+
+    // Small thread ids read better in the viewers:
+    std::map<quint64, int> tids;
+    for (std::map<quint64, std::string>::const_iterator it = buffer.threads.begin(); it != buffer.threads.end(); ++it) {
+        const int &tid = tids.size() + 1;
+        tids[it->first] = tid;
+        os << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+           << ", \"args\": {\"name\": \"" << it->second << "\"}}";
+    }
+
+    for (unsigned int i = 0; i < buffer.events.size(); i++) {
+        const TraceEvent &event = buffer.events[i];
+        os << ",\n{\"name\": \"" << event.name << "\", \"cat\": \"queue\", \"ph\": \"" << event.phase
+           << "\", \"ts\": " << event.time << ", \"pid\": 1, \"tid\": " << tids[event.thread];
+        if (event.phase == 'X') {
+            os << ", \"dur\": " << event.duration;
+        } else {
+            os << ", \"id\": " << event.id;
+        }
+        if (event.phase == 'X' || event.arg >= 0) {
+            os << ", \"args\": {\"item\": " << event.id;
+            if (event.arg >= 0) {
+                os << ", \"value\": " << event.arg;
+            }
+            os << "}";
+        }
+        os << "}";
+    }
+    os << "\n]}\n";
+    return os.str();
+}
+
+
+bool Trace::dump(const std::string &path) {
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const std::string &json = toJson();
+    const qint64 &written = file.write(json.c_str(), json.size());
+    file.close();
+    return written == (qint64) json.size();
+}
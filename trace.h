@@ -0,0 +1,75 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_TRACE_H
+#define SHRUTHI_TRACE_H
+
+
+#include <QAtomicInt>
+#include <QtGlobal>
+#include <string>
+
+
+// Latency tracing of queue items, exported in the Chrome trace event format
+// (load the file in chrome://tracing or https://ui.perfetto.dev).
+//
+// Every QueueItem carries its creation time and, while tracing is enabled, a
+// trace id. Each item shows up as an async slice from its creation in the GUI
+// (or MIDI input) to the end of Editor::process, with instant events for the
+// stages in between. The stages themselves are recorded as complete events on
+// the thread they ran on.
+//
+// Event names have to be string literals (or other static strings), they are
+// not copied.
+class Trace {
+    public:
+        static void start();
+        static void stop();
+        static inline bool enabled() {
+            return active.fetchAndAddRelaxed(0) != 0;
+        }
+
+        // Monotonic clock in microseconds since program start.
+        static qint64 now();
+
+        // Starts the async slice of a new item. Returns its id, or 0 if
+        // tracing is disabled.
+        static quint32 begin(const char *name, const qint64 &time);
+        static void end(const char *name, const quint32 &id);
+        static void instant(const char *name, const quint32 &id);
+        static void complete(const char *name, const quint32 &id, const qint64 &start, const int &arg = -1);
+
+        // The item the editor is currently processing, to attribute the MIDI
+        // output to it. Only written by the editor thread.
+        static void setCurrent(const quint32 &id);
+        static quint32 current();
+
+        static std::string toJson();
+        static bool dump(const std::string &path);
+        static unsigned int dropped();
+
+    private:
+        Trace(); // static only
+
+        static QAtomicInt active;
+};
+
+
+#endif // SHRUTHI_TRACE_H
@@ -0,0 +1,183 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "transferqueue.h"
+#include <algorithm> // for min, max
+#include "flag.h"
+
+
+static bool overlaps(const TransferQueue::Job &a, const TransferQueue::Job &b) {
+    return a.from <= b.to && b.from <= a.to;
+}
+
+
+static bool touches(const TransferQueue::Job &a, const TransferQueue::Job &b) {
+    return a.from <= b.to + 1 && b.from <= a.to + 1;
+}
+
+
+TransferQueue::TransferQueue():
+    nextId(1) {
+}
+
+
+const TransferQueue::Job &TransferQueue::add(const int &type, const int &flags, const int &from, const int &to) {
+    Job job;
+    job.id = nextId++;
+    job.type = type;
+    job.flags = flags;
+    job.from = std::min(from, to);
+    job.to = std::max(from, to);
+
+    // Behind the last job of the other kind covering some of its programs,
+    // otherwise sorted by the first program:
+    int pos = 0;
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        if (jobs.at(i).type != type && overlaps(jobs.at(i), job)) {
+            pos = i + 1;
+        }
+    }
+    while (pos < (int) jobs.size() && jobs.at(pos).from <= job.from) {
+        pos++;
+    }
+    jobs.insert(jobs.begin() + pos, job);
+
+    while (mergeOnce()) {
+    }
+
+    // Return the job that contains the new one:
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        const Job &j = jobs.at(i);
+        if (j.type == type && (j.flags & flags) == flags && j.from <= job.from && job.to <= j.to) {
+            return j;
+        }
+    }
+    return jobs.back(); // not reached
+}
+
+
+bool TransferQueue::blocked(const int &first, const int &last, const Job &job) const {
+    // Is there a job of the other kind between first and last covering
+    // some programs of job?
+    for (int i = first + 1; i < last; i++) {
+        if (jobs.at(i).type != job.type && overlaps(jobs.at(i), job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool TransferQueue::mergeOnce() {
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        for (unsigned int k = i + 1; k < jobs.size(); k++) {
+            Job &a = jobs.at(i);
+            const Job &b = jobs.at(k);
+            if (a.type != b.type || blocked(i, k, b)) {
+                continue;
+            }
+
+            const bool &sameFlags = a.flags == b.flags;
+            const bool &sameRange = a.from == b.from && a.to == b.to;
+            const bool &sameChanged = (a.flags & Flag::CHANGED) == (b.flags & Flag::CHANGED);
+            if (sameFlags && touches(a, b)) {
+                a.from = std::min(a.from, b.from);
+                a.to = std::max(a.to, b.to);
+            } else if (sameRange && sameChanged) {
+                a.flags |= b.flags;
+            } else {
+                continue;
+            }
+            jobs.erase(jobs.begin() + k);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool TransferQueue::takeNext(Job &job) {
+    if (jobs.empty()) {
+        return false;
+    }
+    job = jobs.front();
+    jobs.pop_front();
+    return true;
+}
+
+
+int TransferQueue::cancel(const int &type, const int &from, const int &to) {
+    Job range;
+    range.from = std::min(from, to);
+    range.to = std::max(from, to);
+
+    int changed = 0;
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        Job &job = jobs.at(i);
+        if ((type >= 0 && job.type != type) || !overlaps(job, range)) {
+            continue;
+        }
+        changed++;
+
+        if (range.from <= job.from && job.to <= range.to) {
+            jobs.erase(jobs.begin() + i);
+            i--;
+        } else if (job.from < range.from && range.to < job.to) {
+            // Split it:
+            Job tail = job;
+            tail.id = nextId++;
+            tail.from = range.to + 1;
+            job.to = range.from - 1;
+            jobs.insert(jobs.begin() + i + 1, tail);
+            i++;
+        } else if (job.from < range.from) {
+            job.to = range.from - 1;
+        } else {
+            job.from = range.to + 1;
+        }
+    }
+    return changed;
+}
+
+
+void TransferQueue::clear(const int &type) {
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        if (type < 0 || jobs.at(i).type == type) {
+            jobs.erase(jobs.begin() + i);
+            i--;
+        }
+    }
+}
+
+
+bool TransferQueue::isEmpty() const {
+    return jobs.empty();
+}
+
+
+int TransferQueue::count(const int &type) const {
+    int num = 0;
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        if (type < 0 || jobs.at(i).type == type) {
+            num++;
+        }
+    }
+    return num;
+}
@@ -0,0 +1,71 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_TRANSFERQUEUE_H
+#define SHRUTHI_TRANSFERQUEUE_H
+
+
+#include <deque>
+
+
+// Pending fetch and send jobs of the library.
+//
+// Jobs of the same kind and flags whose ranges overlap or touch are merged,
+// and a fetch and a send of the same range with different program types
+// (patches, sequences) are combined into one job. The jobs are ordered by
+// their first program, so the Shruthi steps through its programs in one
+// direction; a job is never moved in front of an earlier job of the other
+// kind that covers some of its programs (a fetch after a send has to get the
+// sent programs).
+class TransferQueue {
+    public:
+        static const int FETCH = 0;
+        static const int SEND = 1;
+
+        struct Job {
+            int id;
+            int type; // FETCH or SEND
+            int flags; // see Flag
+            int from;
+            int to;
+        };
+
+        TransferQueue();
+
+        const Job &add(const int &type, const int &flags, const int &from, const int &to);
+        bool takeNext(Job &job);
+        int cancel(const int &type, const int &from, const int &to); // type -1 for all
+        void clear(const int &type); // type -1 for all
+        bool isEmpty() const;
+        int count(const int &type) const; // type -1 for all
+
+    private:
+        TransferQueue(const TransferQueue&); //forbid copying
+        TransferQueue &operator=(const TransferQueue&); //forbid assignment
+
+        bool blocked(const int &first, const int &last, const Job &job) const;
+        bool mergeOnce();
+
+        std::deque<Job> jobs;
+        int nextId;
+};
+
+
+#endif // SHRUTHI_TRANSFERQUEUE_H
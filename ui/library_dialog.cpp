@@ -27,6 +27,9 @@
 #include "flag.h"
 
 
+static const char *LIBRARY_FILTER = "Libraries (*.syx *.slb);;SysEx files (*.syx);;Shruthi libraries (*.slb)";
+
+
 LibraryDialog::LibraryDialog(QWidget *parent) :
     QDialog(parent),
     ui(new Ui::LibraryDialog) {
@@ -61,10 +64,14 @@ LibraryDialog::LibraryDialog(QWidget *parent) :
     patchContextMenu->addAction("Insert Program After", this, SLOT(patchCMInsertAfter()));
     patchContextMenu->addAction("Delete Program", this, SLOT(patchCMRemove()));
     patchContextMenu->addAction("Reset", this, SLOT(patchCMReset()));
+    patchContextMenu->addAction("Convert to 1.xx", this, SLOT(patchCMUpgrade()));
+    patchContextMenu->addAction("Generate Random Patches", this, SLOT(patchCMGenerate()));
+    patchContextMenu->addAction("Morph Between First and Last", this, SLOT(patchCMMorph()));
     patchContextMenu->addSeparator();
     patchContextMenu->addAction("Fetch", this, SLOT(patchCMFetch()));
     patchContextMenu->addAction("Send", this, SLOT(patchCMSend()));
     patchContextMenu->addAction("Send Changed", this, SLOT(patchCMSendChanged()));
+    patchContextMenu->addAction("Cancel Transfer", this, SLOT(patchCMCancelTransfer()));
 
     sequenceContextMenu = new QMenu(this);
     sequenceContextMenu->addAction("Store", this, SLOT(sequenceCMStore()));
@@ -76,6 +83,7 @@ LibraryDialog::LibraryDialog(QWidget *parent) :
     sequenceContextMenu->addAction("Fetch", this, SLOT(sequenceCMFetch()));
     sequenceContextMenu->addAction("Send", this, SLOT(sequenceCMSend()));
     sequenceContextMenu->addAction("Send Changed", this, SLOT(sequenceCMSendChanged()));
+    sequenceContextMenu->addAction("Cancel Transfer", this, SLOT(sequenceCMCancelTransfer()));
 
     connect(ui->patchList, SIGNAL(itemDoubleClicked(QListWidgetItem*)), this, SLOT(patchRecall(QListWidgetItem*)));
     connect(ui->patchList, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(patchOpenContextMenu(QPoint)));
@@ -90,6 +98,14 @@ LibraryDialog::LibraryDialog(QWidget *parent) :
     connect(ui->loadReplace, SIGNAL(clicked()), this, SLOT(loadReplace()));
     connect(ui->loadAppend, SIGNAL(clicked()), this, SLOT(loadAppend()));
     connect(ui->save, SIGNAL(clicked()), this, SLOT(save()));
+    connect(ui->cancelFile, SIGNAL(clicked()), this, SLOT(cancelFile()));
+
+    // Bulk import:
+    importMenu = new QMenu(this);
+    importMenu->addAction("Files...", this, SLOT(importFiles()));
+    importMenu->addAction("Folder...", this, SLOT(importFolder()));
+    ui->importLibraries->setMenu(importMenu);
+    setFileProgress(-1);
 
     // synchronize list widget scrolling:
     connect(ui->patchList->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(copyScrollBarPositionFromPatchToSequence(int)));
@@ -177,6 +193,21 @@ void LibraryDialog::setNumberOfLibraryPrograms(int num) {
 }
 
 
+void LibraryDialog::setFileProgress(int percent) {
+    // Only visible while a library is loaded or saved:
+    ui->fileProgress->setVisible(percent >= 0);
+    ui->cancelFile->setVisible(percent >= 0);
+    if (percent >= 0) {
+        ui->fileProgress->setValue(percent);
+    }
+}
+
+
+int LibraryDialog::verifyFlag() const {
+    return ui->verify->isChecked() ? Flag::VERIFY : 0;
+}
+
+
 void LibraryDialog::recall(const int &flags, const int &id) {
     QueueItem signal(QueueAction::LIBRARY_RECALL);
     signal.int0 = flags;
@@ -218,7 +249,7 @@ void LibraryDialog::send() {
         return;
     }
     QueueItem signal(QueueAction::LIBRARY_SEND);
-    signal.int0 = Flag::PATCH | Flag::SEQUENCE;
+    signal.int0 = Flag::PATCH | Flag::SEQUENCE | verifyFlag();
     signal.int1 = 0;
     signal.int2 = -1;
     emit enqueue(signal);
@@ -231,7 +262,7 @@ void LibraryDialog::sendChanged(){
         return;
     }
     QueueItem signal(QueueAction::LIBRARY_SEND);
-    signal.int0 = Flag::PATCH | Flag::SEQUENCE | Flag::CHANGED;
+    signal.int0 = Flag::PATCH | Flag::SEQUENCE | Flag::CHANGED | verifyFlag();
     signal.int1 = 0;
     signal.int2 = -1;
     emit enqueue(signal);
@@ -239,7 +270,7 @@ void LibraryDialog::sendChanged(){
 
 
 void LibraryDialog::loadReplace() {
-    QString path = QFileDialog::getOpenFileName(this, "Load Library", ".", "SysEx files (*.syx)");
+    QString path = QFileDialog::getOpenFileName(this, "Load Library", ".", LIBRARY_FILTER);
     if (path != "") {
         QueueItem signal(QueueAction::LIBRARY_LOAD, path, Flag::PATCH | Flag::SEQUENCE);
         emit enqueue(signal);
@@ -248,7 +279,7 @@ void LibraryDialog::loadReplace() {
 
 
 void LibraryDialog::loadAppend() {
-    QString path = QFileDialog::getOpenFileName(this, "Load Library", ".", "SysEx files (*.syx)");
+    QString path = QFileDialog::getOpenFileName(this, "Load Library", ".", LIBRARY_FILTER);
     if (path != "") {
         QueueItem signal(QueueAction::LIBRARY_LOAD, path, Flag::PATCH | Flag::SEQUENCE | Flag::APPEND);
         emit enqueue(signal);
@@ -257,10 +288,11 @@ void LibraryDialog::loadAppend() {
 
 
 void LibraryDialog::save() {
-    QString path = QFileDialog::getSaveFileName(this, "Save Library", ".", "SysEx files (*.syx)");
+    QString filter;
+    QString path = QFileDialog::getSaveFileName(this, "Save Library", ".", "SysEx files (*.syx);;Shruthi libraries (*.slb)", &filter);
     if (path != "") {
-        if (!path.endsWith(".syx", Qt::CaseInsensitive)) {
-            path.append(".syx");
+        if (!path.endsWith(".syx", Qt::CaseInsensitive) && !path.endsWith(".slb", Qt::CaseInsensitive)) {
+            path.append(filter.contains("*.slb") ? ".slb" : ".syx");
         }
 
         QueueItem signal(QueueAction::LIBRARY_SAVE, path, Flag::PATCH | Flag::SEQUENCE);
@@ -269,6 +301,31 @@ void LibraryDialog::save() {
 }
 
 
+void LibraryDialog::importFiles() {
+    const QStringList &paths = QFileDialog::getOpenFileNames(this, "Import Libraries", ".", LIBRARY_FILTER);
+    if (!paths.isEmpty()) {
+        QueueItem signal(QueueAction::LIBRARY_IMPORT, paths, Flag::PATCH | Flag::SEQUENCE | Flag::APPEND);
+        emit enqueue(signal);
+    }
+}
+
+
+void LibraryDialog::importFolder() {
+    // All *.syx and *.slb files in the folder and its subfolders are imported.
+    const QString &path = QFileDialog::getExistingDirectory(this, "Import Libraries", ".");
+    if (path != "") {
+        QueueItem signal(QueueAction::LIBRARY_IMPORT, QStringList() << path, Flag::PATCH | Flag::SEQUENCE | Flag::APPEND);
+        emit enqueue(signal);
+    }
+}
+
+
+void LibraryDialog::cancelFile() {
+    QueueItem signal(QueueAction::FILEIO_CANCEL);
+    emit enqueue(signal);
+}
+
+
 void LibraryDialog::libraryRange(const QueueAction::QueueAction &action, const int &flags, const int &from, const int &to) {
 #ifdef DEBUGMSGS
     qDebug() << "LibraryDialog::libraryRange() " << flags << from << to;
@@ -385,7 +442,7 @@ void LibraryDialog::sequenceCMStore() {
 
 
 void LibraryDialog::patchCMSend() {
-    int flag = Flag::PATCH;
+    int flag = Flag::PATCH | verifyFlag();
     if (ui->sync->isChecked()) {
         flag |= Flag::SEQUENCE;
     }
@@ -394,7 +451,7 @@ void LibraryDialog::patchCMSend() {
 
 
 void LibraryDialog::patchCMSendChanged() {
-    int flag = Flag::PATCH | Flag::CHANGED;
+    int flag = Flag::PATCH | Flag::CHANGED | verifyFlag();
     if (ui->sync->isChecked()) {
         flag |= Flag::SEQUENCE;
     }
@@ -403,7 +460,7 @@ void LibraryDialog::patchCMSendChanged() {
 
 
 void LibraryDialog::sequenceCMSend() {
-    int flag = Flag::SEQUENCE;
+    int flag = Flag::SEQUENCE | verifyFlag();
     if (ui->sync->isChecked()) {
         flag |= Flag::PATCH;
     }
@@ -412,7 +469,7 @@ void LibraryDialog::sequenceCMSend() {
 
 
 void LibraryDialog::sequenceCMSendChanged() {
-    int flag = Flag::SEQUENCE | Flag::CHANGED;
+    int flag = Flag::SEQUENCE | Flag::CHANGED | verifyFlag();
     if (ui->sync->isChecked()) {
         flag |= Flag::PATCH;
     }
@@ -438,6 +495,47 @@ void LibraryDialog::sequenceCMFetch() {
 }
 
 
+void LibraryDialog::patchCMCancelTransfer() {
+    librarySelectedRanges(ui->patchList, QueueAction::LIBRARY_CANCEL_TRANSFER, 0);
+}
+
+
+void LibraryDialog::sequenceCMCancelTransfer() {
+    librarySelectedRanges(ui->sequenceList, QueueAction::LIBRARY_CANCEL_TRANSFER, 0);
+}
+
+
+void LibraryDialog::patchCMUpgrade() {
+    librarySelectedRanges(ui->patchList, QueueAction::LIBRARY_UPGRADE, Flag::PATCH);
+}
+
+
+void LibraryDialog::patchCMGenerate() {
+    librarySelectedRanges(ui->patchList, QueueAction::LIBRARY_GENERATE, Flag::PATCH);
+}
+
+
+void LibraryDialog::patchCMMorph() {
+    // Morphs from the first to the last selected patch:
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < ui->patchList->count(); i++) {
+        if (ui->patchList->item(i)->isSelected()) {
+            if (first < 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first == last) {
+        QMessageBox::information(this, "Morph", "Select the patches to morph between, from the first to the last selected one.");
+        return;
+    }
+    QueueItem signal(QueueAction::MORPH_START, first, last);
+    emit enqueue(signal);
+}
+
+
 void LibraryDialog::patchCMRemove() {
 #ifdef DEBUGMSGS
     qDebug() << "LibraryDialog::patchCMDelete()";
@@ -46,6 +46,7 @@ class LibraryDialog : public QDialog {
         void setFont(QListWidgetItem *item, bool edited, bool moved);
         void libraryRange(const QueueAction::QueueAction &action, const int &flags, const int &from, const int &to);
         void move(const int &flags, const int &from, const int &to);
+        int verifyFlag() const; // Flag::VERIFY if sent programs are read back
         void store(const int &flags, const int &id);
         void recall(const int &flags, const int &id);
 
@@ -68,6 +69,7 @@ class LibraryDialog : public QDialog {
 
         QMenu *patchContextMenu;
         QMenu *sequenceContextMenu;
+        QMenu *importMenu;
 
         bool dontCopyScrollBarPosition; // to prevent scroll bar bouncing
         bool dontCopySelection; // to prevent selection bouncing
@@ -76,6 +78,7 @@ class LibraryDialog : public QDialog {
         void redrawLibraryPatchItem(int id, QString identifier, bool edited, bool moved, bool onHardware);
         void redrawLibrarySequenceItem(int id, QString identifier, bool edited, bool moved, bool onHardware);
         void setNumberOfLibraryPrograms(int num);
+        void setFileProgress(int percent);
 
     private slots:
         void patchOpenContextMenu(QPoint p);
@@ -90,6 +93,11 @@ class LibraryDialog : public QDialog {
         void sequenceCMSendChanged();
         void patchCMFetch();
         void sequenceCMFetch();
+        void patchCMCancelTransfer();
+        void patchCMUpgrade();
+        void patchCMGenerate();
+        void patchCMMorph();
+        void sequenceCMCancelTransfer();
         void patchCMRemove();
         void sequenceCMRemove();
         void patchCMReset();
@@ -105,6 +113,9 @@ class LibraryDialog : public QDialog {
         void loadReplace();
         void loadAppend();
         void save();
+        void cancelFile();
+        void importFiles();
+        void importFolder();
 
         void copyScrollBarPositionFromPatchToSequence(int val);
         void copyScrollBarPositionFromSequenceToPatch(int val);
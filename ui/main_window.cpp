@@ -40,9 +40,12 @@ ShruthiEditorMainWindow::ShruthiEditorMainWindow(QWidget *parent):
     MIDI_CHANNEL = 1;
     MIDI_INPUT_PORT = 0;
     MIDI_OUTPUT_PORT = 0;
+    MIDI_THRU_PORT = -1;
+    MIDI_BACKEND = 0;
     SHRUTHI_FILTER_BOARD = 0;
     MIDI_INPUT_STATUS = false;
     MIDI_OUTPUT_STATUS = false;
+    MIDI_VIRTUAL_PORTS = false;
 
     parameter84 = 0;
     parameter85 = 0;
@@ -137,9 +140,14 @@ ShruthiEditorMainWindow::ShruthiEditorMainWindow(QWidget *parent):
     connect(ui->actionAboutShruthiEditor, SIGNAL(triggered()), this, SLOT(aboutShruthiEditor()));
     connect(ui->actionAboutQt, SIGNAL(triggered()), this, SLOT(aboutQt()));
     connect(ui->actionRandomizePatch, SIGNAL(triggered()), this, SLOT(randomizePatch()));
+    connect(ui->actionUpgradePatch, SIGNAL(triggered()), this, SLOT(upgradePatch()));
     connect(ui->actionKeyboard, SIGNAL(triggered()), this, SIGNAL(showKeyboard()));
     connect(ui->actionOpenSequenceEditor, SIGNAL(triggered()), this, SIGNAL(showSequenceEditor()));
     connect(ui->actionOpenLibrary, SIGNAL(triggered()), this, SIGNAL(showLibrary()));
+    connect(ui->actionOpenRecorder, SIGNAL(triggered()), this, SIGNAL(showRecorder()));
+    connect(ui->actionBackupRack, SIGNAL(triggered()), this, SLOT(backupRack()));
+    connect(ui->actionRestoreRack, SIGNAL(triggered()), this, SLOT(restoreRack()));
+    connect(ui->actionOpenMetrics, SIGNAL(triggered()), this, SIGNAL(showMetrics()));
     connect(ui->actionResetSequence, SIGNAL(triggered()), this, SLOT(resetSequence()));
 }
 
@@ -149,6 +157,14 @@ ShruthiEditorMainWindow::~ShruthiEditorMainWindow() {
 }
 
 
+void ShruthiEditorMainWindow::setMidiBackend(int backend) {
+#ifdef DEBUGMSGS
+    qDebug() << "shruthiEditorMainWindow::setMidiBackend(" << backend << ")";
+#endif
+    MIDI_BACKEND = backend;
+}
+
+
 void ShruthiEditorMainWindow::setMidiInputPort(int midiin) {
 #ifdef DEBUGMSGS
     qDebug() << "shruthiEditorMainWindow::setMidiInputPort(" << midiin << ")";
@@ -165,6 +181,22 @@ void ShruthiEditorMainWindow::setMidiOutputPort(int midiout) {
 }
 
 
+void ShruthiEditorMainWindow::setMidiThruPort(int midithru) {
+#ifdef DEBUGMSGS
+    qDebug() << "shruthiEditorMainWindow::setMidiThruPort(" << midithru << ")";
+#endif
+    MIDI_THRU_PORT = midithru;
+}
+
+
+void ShruthiEditorMainWindow::setMidiVirtualPorts(bool enabled) {
+#ifdef DEBUGMSGS
+    qDebug() << "shruthiEditorMainWindow::setMidiVirtualPorts(" << enabled << ")";
+#endif
+    MIDI_VIRTUAL_PORTS = enabled;
+}
+
+
 void ShruthiEditorMainWindow::setMidiChannel(unsigned char channel) {
 #ifdef DEBUGMSGS
     qDebug() << "shruthiEditorMainWindow::setMidiChannel(" << channel << ")";
@@ -495,14 +527,20 @@ void ShruthiEditorMainWindow::sendSequence() {
 void ShruthiEditorMainWindow::openSettings() {
     SettingsDialog prefs(this);
     prefs.setFixedSize(prefs.width(),prefs.height());
+    prefs.setMidiBackend(MIDI_BACKEND);
     prefs.setMidiPorts(MIDI_INPUT_PORT, MIDI_OUTPUT_PORT);
+    prefs.setMidiThruPort(MIDI_THRU_PORT);
+    prefs.setMidiVirtualPorts(MIDI_VIRTUAL_PORTS);
     prefs.setMidiChannel(MIDI_CHANNEL);
     prefs.setShruthiFilterBoard(SHRUTHI_FILTER_BOARD);
     prefs.setWindowIcon(QIcon(":/shruthi_editor.png"));
     if (prefs.exec()) {
         Config conf;
+        conf.setMidiBackend(prefs.getMidiBackend());
         conf.setMidiInputPort(prefs.getMidiInputPort());
         conf.setMidiOutputPort(prefs.getMidiOutputPort());
+        conf.setMidiThruPort(prefs.getMidiThruPort());
+        conf.setMidiVirtualPorts(prefs.getMidiVirtualPorts());
         conf.setMidiChannel(prefs.getMidiChannel());
         conf.setShruthiFilterBoard(prefs.getShruthiFilterBoard());
         emit settingsChanged(conf);
@@ -537,6 +575,28 @@ void ShruthiEditorMainWindow::randomizePatch() {
 }
 
 
+void ShruthiEditorMainWindow::upgradePatch() {
+    QueueItem signal(QueueAction::UPGRADE_PATCH);
+    emit enqueue(signal);
+}
+
+
+void ShruthiEditorMainWindow::backupRack() {
+    const QString &directory = QFileDialog::getExistingDirectory(this, "Back Up Rack");
+    if (!directory.isEmpty()) {
+        emit rackBackup(directory);
+    }
+}
+
+
+void ShruthiEditorMainWindow::restoreRack() {
+    const QString &directory = QFileDialog::getExistingDirectory(this, "Restore Rack");
+    if (!directory.isEmpty()) {
+        emit rackRestore(directory);
+    }
+}
+
+
 
 void ShruthiEditorMainWindow::quitShruthiEditor() {
     QApplication::exit(0);
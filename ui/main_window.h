@@ -47,9 +47,9 @@ class ShruthiEditorMainWindow : public QMainWindow {
         QComboBox *injectQFileDialog(QFileDialog *d);
 
         Ui::MainWindow *ui;
-        int MIDI_INPUT_PORT, MIDI_OUTPUT_PORT, SHRUTHI_FILTER_BOARD;
+        int MIDI_BACKEND, MIDI_INPUT_PORT, MIDI_OUTPUT_PORT, MIDI_THRU_PORT, SHRUTHI_FILTER_BOARD;
         unsigned char MIDI_CHANNEL;
-        bool MIDI_INPUT_STATUS, MIDI_OUTPUT_STATUS;
+        bool MIDI_INPUT_STATUS, MIDI_OUTPUT_STATUS, MIDI_VIRTUAL_PORTS;
         QLabel *statusbarVersionLabel;
 
         int lastProgramFileMode;
@@ -61,7 +61,10 @@ class ShruthiEditorMainWindow : public QMainWindow {
         void redrawPatchName(QString name);
         // ui settings:
         void setMidiInputPort(int midiin);
+        void setMidiBackend(int backend);
         void setMidiOutputPort(int midiout);
+        void setMidiThruPort(int midithru);
+        void setMidiVirtualPorts(bool enabled);
         void setMidiChannel(unsigned char channel);
         void setShruthiFilterBoard(int filter);
         void midiInputStatusChanged(bool st);
@@ -88,6 +91,9 @@ class ShruthiEditorMainWindow : public QMainWindow {
         void resetPatchPre100();
         void resetSequence();
         void randomizePatch();
+        void upgradePatch();
+        void backupRack();
+        void restoreRack();
         void quitShruthiEditor();
         void aboutShruthiEditor();
         void aboutQt();
@@ -98,6 +104,10 @@ class ShruthiEditorMainWindow : public QMainWindow {
         void showKeyboard();
         void showSequenceEditor();
         void showLibrary();
+        void showRecorder();
+        void showMetrics();
+        void rackBackup(QString); // directory
+        void rackRestore(QString);
 };
 
 
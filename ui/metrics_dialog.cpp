@@ -0,0 +1,133 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "ui/metrics_dialog.h"
+#include "ui_metrics_dialog.h"
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QTableWidgetItem>
+#include <QTimer>
+#include <map>
+#include <string>
+#include "metrics.h"
+
+
+MetricsDialog::MetricsDialog(QWidget *parent):
+    QDialog(parent),
+    ui(new Ui::MetricsDialog),
+    timer(new QTimer(this)) {
+    ui->setupUi(this);
+
+    ui->metrics->setColumnCount(3);
+    ui->metrics->setHorizontalHeaderLabels(QStringList() << "Metric" << "Value" << "Details");
+
+    connect(timer, SIGNAL(timeout()), this, SLOT(refresh()));
+    connect(ui->reset, SIGNAL(pressed()), this, SLOT(resetPushed()));
+    connect(ui->save, SIGNAL(pressed()), this, SLOT(savePushed()));
+}
+
+
+MetricsDialog::~MetricsDialog() {
+    delete ui;
+}
+
+
+void MetricsDialog::showEvent(QShowEvent *event) {
+    refresh();
+    timer->start(500);
+    QDialog::showEvent(event);
+}
+
+
+void MetricsDialog::hideEvent(QHideEvent *event) {
+    timer->stop();
+    QDialog::hideEvent(event);
+}
+
+
+void MetricsDialog::setRow(const int &row, const QString &name, const QString &value, const QString &details) {
+    if (ui->metrics->rowCount() <= row) {
+        ui->metrics->setRowCount(row + 1);
+        for (int i = 0; i < 3; i++) {
+            QTableWidgetItem *item = new QTableWidgetItem();
+            item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+            ui->metrics->setItem(row, i, item);
+        }
+    }
+    ui->metrics->item(row, 0)->setText(name);
+    ui->metrics->item(row, 1)->setText(value);
+    ui->metrics->item(row, 2)->setText(details);
+}
+
+
+//
+// Slots:
+//
+
+
+void MetricsDialog::refresh() {
+    int row = 0;
+
+    const std::map<std::string, MetricsCounter*> &counters = Metrics::counters();
+    for (std::map<std::string, MetricsCounter*>::const_iterator it = counters.begin(); it != counters.end(); ++it) {
+        setRow(row++, QString::fromStdString(it->first), QString::number(it->second->get()), "");
+    }
+
+    const std::map<std::string, MetricsGauge*> &gauges = Metrics::gauges();
+    for (std::map<std::string, MetricsGauge*>::const_iterator it = gauges.begin(); it != gauges.end(); ++it) {
+        setRow(row++, QString::fromStdString(it->first), QString::number(it->second->get()),
+               QString("max %1").arg(it->second->max()));
+    }
+
+    // Skip histograms without samples, there is one per QueueAction.
+    const std::map<std::string, MetricsHistogram*> &histograms = Metrics::histograms();
+    for (std::map<std::string, MetricsHistogram*>::const_iterator it = histograms.begin(); it != histograms.end(); ++it) {
+        MetricsHistogram *h = it->second;
+        if (h->count() == 0) {
+            continue;
+        }
+        setRow(row++, QString::fromStdString(it->first), QString("%1 us").arg(h->mean(), 0, 'f', 0),
+               QString("n %1, p50 %2, p90 %3, p99 %4, max %5 us")
+               .arg(h->count()).arg(h->percentile(0.5)).arg(h->percentile(0.9))
+               .arg(h->percentile(0.99)).arg(h->max()));
+    }
+
+    ui->metrics->setRowCount(row);
+    ui->uptime->setText(QString("Uptime: %1 s").arg(Metrics::uptime() / 1000));
+}
+
+
+void MetricsDialog::resetPushed() {
+    Metrics::reset();
+    refresh();
+}
+
+
+void MetricsDialog::savePushed() {
+    QString path = QFileDialog::getSaveFileName(this, "Save Metrics", ".", "JSON files (*.json)");
+    if (path != "") {
+        if (!path.endsWith(".json", Qt::CaseInsensitive)) {
+            path.append(".json");
+        }
+        if (!Metrics::dump(path.toStdString())) {
+            QMessageBox::warning(this, "Save Metrics", "Could not write " + path + ".");
+        }
+    }
+}
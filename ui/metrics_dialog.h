@@ -0,0 +1,60 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef METRICS_DIALOG_H
+#define METRICS_DIALOG_H
+
+
+#include <QDialog>
+class QShowEvent;
+class QHideEvent;
+class QTimer;
+namespace Ui { class MetricsDialog; }
+
+
+// Live view of the metrics registry, refreshed while the dialog is visible.
+class MetricsDialog : public QDialog {
+        Q_OBJECT
+
+    public:
+        explicit MetricsDialog(QWidget *parent = 0);
+        ~MetricsDialog();
+
+    protected:
+        void showEvent(QShowEvent *event);
+        void hideEvent(QHideEvent *event);
+
+    private:
+        MetricsDialog(const MetricsDialog&); //forbid copying
+        MetricsDialog &operator=(const MetricsDialog&); //forbid assignment
+
+        void setRow(const int &row, const QString &name, const QString &value, const QString &details);
+
+        Ui::MetricsDialog *ui;
+        QTimer *timer;
+
+    private slots:
+        void refresh();
+        void resetPushed();
+        void savePushed();
+};
+
+
+#endif // METRICS_DIALOG_H
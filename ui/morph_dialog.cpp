@@ -0,0 +1,106 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "ui/morph_dialog.h"
+#include "ui_morph_dialog.h"
+
+
+MorphDialog::MorphDialog(QWidget *parent):
+    QDialog(parent),
+    ui(new Ui::MorphDialog),
+    active(false) {
+    ui->setupUi(this);
+
+    connect(ui->position, SIGNAL(valueChanged(int)), this, SLOT(positionChanged(int)));
+    connect(ui->rampFrom, SIGNAL(clicked()), this, SLOT(rampToFrom()));
+    connect(ui->rampTo, SIGNAL(clicked()), this, SLOT(rampToTo()));
+    connect(ui->stop, SIGNAL(clicked()), this, SLOT(stop()));
+}
+
+
+MorphDialog::~MorphDialog() {
+    delete ui;
+}
+
+
+void MorphDialog::hideEvent(QHideEvent *event) {
+    // Closing the dialog ends the morph:
+    stop();
+    QDialog::hideEvent(event);
+}
+
+
+void MorphDialog::ramp(const int &position) {
+    QueueItem signal(QueueAction::MORPH_RAMP, position, ui->duration->value());
+    emit enqueue(signal);
+}
+
+
+//
+// Slots:
+//
+
+
+void MorphDialog::morphStarted(QString from, QString to) {
+    active = true;
+    ui->fromName->setText(from);
+    ui->toName->setText(to);
+    morphPositionChanged(0);
+    show();
+    raise();
+}
+
+
+void MorphDialog::morphPositionChanged(int position) {
+    // Don't send it back to the editor:
+    ui->position->blockSignals(true);
+    ui->position->setValue(position);
+    ui->position->blockSignals(false);
+}
+
+
+void MorphDialog::morphStopped() {
+    active = false;
+}
+
+
+void MorphDialog::positionChanged(int position) {
+    QueueItem signal(QueueAction::MORPH_POSITION, position);
+    emit enqueue(signal);
+}
+
+
+void MorphDialog::rampToFrom() {
+    ramp(ui->position->minimum());
+}
+
+
+void MorphDialog::rampToTo() {
+    ramp(ui->position->maximum());
+}
+
+
+void MorphDialog::stop() {
+    if (active) {
+        active = false;
+        QueueItem signal(QueueAction::MORPH_STOP);
+        emit enqueue(signal);
+    }
+}
@@ -0,0 +1,67 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef MORPH_DIALOG_H
+#define MORPH_DIALOG_H
+
+
+#include <QDialog>
+#include "queueitem.h"
+class QHideEvent;
+namespace Ui { class MorphDialog; }
+
+
+// Controls the morph between two library patches (see Morph).
+class MorphDialog : public QDialog {
+        Q_OBJECT
+
+    public:
+        explicit MorphDialog(QWidget *parent = 0);
+        ~MorphDialog();
+
+    protected:
+        void hideEvent(QHideEvent *event);
+
+    private:
+        MorphDialog(const MorphDialog&); //forbid copying
+        MorphDialog &operator=(const MorphDialog&); //forbid assignment
+
+        void ramp(const int &position);
+
+        Ui::MorphDialog *ui;
+        bool active;
+
+    public slots:
+        void morphStarted(QString from, QString to);
+        void morphPositionChanged(int position);
+        void morphStopped();
+
+    private slots:
+        void positionChanged(int position);
+        void rampToFrom();
+        void rampToTo();
+        void stop();
+
+    signals:
+        void enqueue(QueueItem);
+};
+
+
+#endif // MORPH_DIALOG_H
@@ -0,0 +1,70 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "ui/recorder_dialog.h"
+#include "ui_recorder_dialog.h"
+
+
+RecorderDialog::RecorderDialog(QWidget *parent):
+    QDialog(parent),
+    ui(new Ui::RecorderDialog) {
+    ui->setupUi(this);
+
+    connect(ui->record, SIGNAL(clicked()), this, SLOT(record()));
+    connect(ui->play, SIGNAL(clicked()), this, SLOT(play()));
+    connect(ui->stop, SIGNAL(clicked()), this, SLOT(stop()));
+    recorderStateChanged(false, false, "Nothing recorded.");
+}
+
+
+RecorderDialog::~RecorderDialog() {
+    delete ui;
+}
+
+
+//
+// Slots:
+//
+
+
+void RecorderDialog::recorderStateChanged(bool recording, bool playing, QString status) {
+    ui->record->setEnabled(!recording && !playing);
+    ui->play->setEnabled(!recording && !playing);
+    ui->stop->setEnabled(recording || playing);
+    ui->status->setText(status);
+}
+
+
+void RecorderDialog::record() {
+    QueueItem signal(QueueAction::RECORDER_RECORD);
+    emit enqueue(signal);
+}
+
+
+void RecorderDialog::play() {
+    QueueItem signal(QueueAction::RECORDER_PLAY, ui->loop->isChecked(), ui->quantize->value(), ui->thin->value());
+    emit enqueue(signal);
+}
+
+
+void RecorderDialog::stop() {
+    QueueItem signal(QueueAction::RECORDER_STOP);
+    emit enqueue(signal);
+}
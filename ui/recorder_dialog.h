@@ -0,0 +1,58 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef RECORDER_DIALOG_H
+#define RECORDER_DIALOG_H
+
+
+#include <QDialog>
+#include "queueitem.h"
+namespace Ui { class RecorderDialog; }
+
+
+// Records the parameter changes of the editor and the Shruthi and plays them
+// back (see ParameterRecorder).
+class RecorderDialog : public QDialog {
+        Q_OBJECT
+
+    public:
+        explicit RecorderDialog(QWidget *parent = 0);
+        ~RecorderDialog();
+
+    private:
+        RecorderDialog(const RecorderDialog&); //forbid copying
+        RecorderDialog &operator=(const RecorderDialog&); //forbid assignment
+
+        Ui::RecorderDialog *ui;
+
+    public slots:
+        void recorderStateChanged(bool recording, bool playing, QString status);
+
+    private slots:
+        void record();
+        void play();
+        void stop();
+
+    signals:
+        void enqueue(QueueItem);
+};
+
+
+#endif // RECORDER_DIALOG_H
@@ -24,6 +24,7 @@
 #include <string>
 #include "RtMidi.h"
 #include "labels.h"
+#include "rawmidi.h"
 
 
 SettingsDialog::SettingsDialog(QWidget *parent):
@@ -31,12 +32,23 @@ SettingsDialog::SettingsDialog(QWidget *parent):
     ui(new Ui::SettingsDialog) {
     ui->setupUi(this);
 
+    backend = MidiBackend::SEQUENCER;
     input_port = 0;
     output_port = 0;
+    thru_port = -1;
     input_port_error = false;
     output_port_error = false;
 
+    ui->midiBackend->addItem("Sequencer (RtMidi)", MidiBackend::SEQUENCER);
+    if (RawMidi::available()) {
+        ui->midiBackend->addItem("ALSA rawmidi", MidiBackend::RAWMIDI);
+    } else {
+        ui->label_6->setVisible(false);
+        ui->midiBackend->setVisible(false);
+    }
+
     getPortInfo();
+    connect(ui->midiBackend, SIGNAL(currentIndexChanged(int)), this, SLOT(midiBackendChanged(int)));
 
     ui->midiChannel->setMinimum(1);
     ui->midiChannel->setMaximum(16);
@@ -56,6 +68,12 @@ void SettingsDialog::getPortInfo() {
     QString name;
     unsigned int numdev = 0;
 
+    ui->midiInputPort->clear();
+    ui->midiOutputPort->clear();
+    ui->midiThruPort->clear();
+    input_port_error = false;
+    output_port_error = false;
+
     // Input ports:
     try {
         midiin = new RtMidiIn(RtMidi::UNSPECIFIED, "shruthi-editor port probe");
@@ -67,6 +85,8 @@ void SettingsDialog::getPortInfo() {
         input_port_error = true;
     }
 
+    ui->midiThruPort->addItem("Disabled", -1);
+
     if (!input_port_error) {
         numdev = midiin->getPortCount();
 
@@ -84,6 +104,7 @@ void SettingsDialog::getPortInfo() {
             // don't add editor instances:
             if (!name.startsWith("shruthi-editor")) {
                 ui->midiInputPort->addItem(name, i);
+                ui->midiThruPort->addItem(name, i);
             }
         }
         delete midiin;
@@ -124,6 +145,53 @@ void SettingsDialog::getPortInfo() {
         delete midiout;
         midiout = NULL;
     }
+
+    // The thru input always uses the sequencer:
+    if (backend == MidiBackend::RAWMIDI) {
+        getRawMidiPortInfo();
+    }
+}
+
+
+void SettingsDialog::getRawMidiPortInfo() {
+    ui->midiInputPort->clear();
+    ui->midiOutputPort->clear();
+    input_port_error = false;
+    output_port_error = false;
+
+    unsigned int numdev = RawMidi::getInputCount();
+    std::cout << numdev << " rawmidi input ports found." << std::endl;
+    for (unsigned int i = 0; i < numdev; i++) {
+        ui->midiInputPort->addItem(QString::fromStdString(RawMidi::getInputName(i)), i);
+    }
+
+    numdev = RawMidi::getOutputCount();
+    std::cout << numdev << " rawmidi output ports found." << std::endl;
+    for (unsigned int i = 0; i < numdev; i++) {
+        ui->midiOutputPort->addItem(QString::fromStdString(RawMidi::getOutputName(i)), i);
+    }
+}
+
+
+void SettingsDialog::midiBackendChanged(int index) {
+    backend = ui->midiBackend->itemData(index).toInt();
+    getPortInfo();
+    // Port numbers differ between the backends, keep them if they exist:
+    setMidiPorts(input_port, output_port);
+    setMidiThruPort(thru_port);
+}
+
+
+void SettingsDialog::setMidiBackend(const int &b) {
+    const int &index = ui->midiBackend->findData(b);
+    if (index >= 0) {
+        ui->midiBackend->setCurrentIndex(index);
+    }
+}
+
+
+int SettingsDialog::getMidiBackend() {
+    return backend;
 }
 
 
@@ -140,6 +208,23 @@ void SettingsDialog::setMidiPorts(const int &in, const int &out) {
 }
 
 
+void SettingsDialog::setMidiThruPort(const int &thru) {
+    thru_port = thru;
+
+    const int &index = ui->midiThruPort->findData(thru);
+    ui->midiThruPort->setCurrentIndex(index >= 0 ? index : 0);
+}
+
+
+int SettingsDialog::getMidiThruPort() {
+    if (input_port_error) {
+        return thru_port;
+    }
+    // no currentData() in qt 4.8.7
+    return ui->midiThruPort->itemData(ui->midiThruPort->currentIndex()).toInt();
+}
+
+
 int SettingsDialog::getMidiInputPort() {
     if (input_port_error) {
         return input_port;
@@ -176,3 +261,13 @@ void SettingsDialog::setShruthiFilterBoard(const int &index) {
 int SettingsDialog::getShruthiFilterBoard() {
     return ui->shruthiFilterBoard->currentIndex();
 }
+
+
+void SettingsDialog::setMidiVirtualPorts(const bool &enabled) {
+    ui->midiVirtualPorts->setChecked(enabled);
+}
+
+
+bool SettingsDialog::getMidiVirtualPorts() {
+    return ui->midiVirtualPorts->isChecked();
+}
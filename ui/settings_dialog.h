@@ -32,11 +32,17 @@ class SettingsDialog : public QDialog {
         SettingsDialog(QWidget *parent = 0);
         ~SettingsDialog();
 
+        int getMidiBackend();
+        void setMidiBackend(const int &backend);
         int getMidiInputPort();
         int getMidiOutputPort();
         void setMidiPorts(const int &in, const int &out);
+        int getMidiThruPort();
+        void setMidiThruPort(const int &thru);
         void setMidiChannel(const unsigned char &channel);
         unsigned char getMidiChannel();
+        void setMidiVirtualPorts(const bool &enabled);
+        bool getMidiVirtualPorts();
         int getShruthiFilterBoard();
         void setShruthiFilterBoard(const int &index);
 
@@ -45,13 +51,19 @@ class SettingsDialog : public QDialog {
         SettingsDialog &operator=(const SettingsDialog&); //forbid assignment
 
         void getPortInfo();
+        void getRawMidiPortInfo();
 
+        int backend;
         int input_port;
         int output_port;
+        int thru_port;
         bool input_port_error;
         bool output_port_error;
 
         Ui::SettingsDialog *ui;
+
+    private slots:
+        void midiBackendChanged(int index);
 };
 
 
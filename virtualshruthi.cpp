@@ -0,0 +1,500 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "virtualshruthi.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm> // for max
+#include <limits>
+#include <stddef.h> // for NULL
+#include "RtMidi.h"
+#include "log.h"
+#include "midi.h"
+
+
+class VirtualShruthiWorker : public QThread {
+    public:
+        VirtualShruthiWorker(VirtualShruthi *shruthi): shruthi(shruthi) {}
+
+    protected:
+        void run() {
+            shruthi->run();
+        }
+
+    private:
+        VirtualShruthi *shruthi;
+};
+
+
+static void virtualPortCallback(double deltatime, Message *message, void *userData) {
+    Q_UNUSED(deltatime);
+    ((VirtualShruthi*)userData)->write(*message);
+}
+
+
+VirtualShruthi::VirtualShruthi(const unsigned int &firmwareVersion, const int &banks):
+    worker(NULL),
+    portIn(NULL),
+    portOut(NULL),
+    callback(NULL),
+    userData(NULL),
+    running(false),
+    byteTime(320), // 10 bits at 31250 baud
+    bufferSize(128),
+    inputFree(0),
+    outputFree(0),
+    busyUntil(0),
+    lastDelivery(-1),
+    runningStatus(0),
+    expected(0),
+    sysex(false),
+    bank(0),
+    firmwareVersion(firmwareVersion),
+    banks(banks),
+    patch(firmwareVersion),
+    currentPatch(0),
+    currentSequence(0),
+    mOverflows(0),
+    mChecksumErrors(0),
+    mReceived(0),
+    mSent(0) {
+    // Rough figures of the real device, the EEPROM write dominates:
+    delays[PARAMETER] = 50;
+    delays[PROGRAM_CHANGE] = 2000;
+    delays[DATA] = 500;
+    delays[TRANSFER_REQUEST] = 200;
+    delays[WRITE_REQUEST] = 10000;
+    delays[INFO_REQUEST] = 100;
+
+    unsigned char patchData[92];
+    patch.packData(patchData);
+    unsigned char sequenceData[32];
+    sequence.packData(sequenceData);
+    const int &programs = numberOfPrograms();
+    patches.assign(programs, Message(patchData, patchData + 92));
+    sequences.assign(programs, Message(sequenceData, sequenceData + 32));
+
+    clock.start();
+}
+
+
+VirtualShruthi::~VirtualShruthi() {
+    stop();
+    delete portIn;
+    delete portOut;
+}
+
+
+void VirtualShruthi::setWireRate(const int &baud) {
+    QMutexLocker locker(&mutex);
+    byteTime = baud > 0 ? 10000000 / baud : 0;
+}
+
+
+void VirtualShruthi::setInputBufferSize(const unsigned int &bytes) {
+    QMutexLocker locker(&mutex);
+    bufferSize = std::max(bytes, 1u);
+}
+
+
+void VirtualShruthi::setDelay(const int &what, const int &us) {
+    if (what >= 0 && what < DELAYS) {
+        QMutexLocker locker(&mutex);
+        delays[what] = us;
+    }
+}
+
+
+void VirtualShruthi::start() {
+    if (worker) {
+        return;
+    }
+    running = true;
+    worker = new VirtualShruthiWorker(this);
+    worker->setObjectName("Virtual Shruthi");
+    worker->start();
+}
+
+
+void VirtualShruthi::stop() {
+    if (!worker) {
+        return;
+    }
+    mutex.lock();
+    running = false;
+    condition.wakeOne();
+    mutex.unlock();
+    worker->wait();
+    delete worker;
+    worker = NULL;
+}
+
+
+bool VirtualShruthi::openVirtualPorts(const std::string &name) {
+    try {
+        portIn = new RtMidiIn(RtMidi::UNSPECIFIED, name);
+        portIn->setCallback(&virtualPortCallback, this);
+        portIn->ignoreTypes(false, true, true);
+        portIn->openVirtualPort(name + " In");
+        portOut = new RtMidiOut(RtMidi::UNSPECIFIED, name);
+        portOut->openVirtualPort(name + " Out");
+    }
+    catch (RtMidiError &error) {
+        error.printMessage();
+        LOG_WARNING(LogCategory::MIDI) << "VirtualShruthi::openVirtualPorts(): could not open the virtual ports.";
+        delete portIn;
+        delete portOut;
+        portIn = NULL;
+        portOut = NULL;
+        return false;
+    }
+    LOG_INFO(LogCategory::MIDI) << "Virtual Shruthi" << name.c_str() << "is running, firmware" << firmwareVersion << "with" << numberOfPrograms() << "programs.";
+    return true;
+}
+
+
+void VirtualShruthi::setCallback(Callback cb, void *data) {
+    QMutexLocker locker(&mutex);
+    callback = cb;
+    userData = data;
+}
+
+
+void VirtualShruthi::write(const Message &message) {
+    QMutexLocker locker(&mutex);
+    // The bytes leave one after the other, after the bytes still on the wire:
+    qint64 time = std::max(now(), inputFree);
+    for (unsigned int i = 0; i < message.size(); i++) {
+        time += byteTime;
+        WireByte wireByte;
+        wireByte.time = time;
+        wireByte.byte = message.at(i);
+        incoming.push_back(wireByte);
+    }
+    inputFree = time;
+    condition.wakeOne();
+}
+
+
+int VirtualShruthi::numberOfPrograms() {
+    return 16 + banks * 64; // internal + external
+}
+
+
+unsigned int VirtualShruthi::overflows() {
+    QMutexLocker locker(&mutex);
+    return mOverflows;
+}
+
+
+unsigned int VirtualShruthi::checksumErrors() {
+    QMutexLocker locker(&mutex);
+    return mChecksumErrors;
+}
+
+
+unsigned int VirtualShruthi::received() {
+    QMutexLocker locker(&mutex);
+    return mReceived;
+}
+
+
+unsigned int VirtualShruthi::sent() {
+    QMutexLocker locker(&mutex);
+    return mSent;
+}
+
+
+qint64 VirtualShruthi::now() {
+    return clock.nsecsElapsed() / 1000;
+}
+
+
+void VirtualShruthi::run() {
+    const qint64 &never = std::numeric_limits<qint64>::max();
+    QMutexLocker locker(&mutex);
+    while (running) {
+        const qint64 &time = now();
+        step(time);
+
+        // Deliver the replies which have completely left the wire:
+        while (!replies.empty() && replies.front().time <= time) {
+            Message reply = replies.front().message;
+            replies.pop_front();
+            mSent++;
+            Callback cb = callback;
+            void *data = userData;
+            const double &delta = lastDelivery < 0 ? 0 : (time - lastDelivery) / 1000000.0;
+            lastDelivery = time;
+
+            locker.unlock();
+            if (portOut) {
+                try {
+                    portOut->sendMessage(&reply);
+                }
+                catch (RtMidiError &error) {
+                    error.printMessage();
+                }
+            } else if (cb) {
+                cb(delta, &reply, data);
+            }
+            locker.relock();
+        }
+
+        // Sleep until the next byte arrives, the device is ready again or a
+        // reply has to be delivered:
+        qint64 next = never;
+        if (!incoming.empty()) {
+            next = std::min(next, incoming.front().time);
+        }
+        if (!buffer.empty()) {
+            next = std::min(next, busyUntil);
+        }
+        if (!replies.empty()) {
+            next = std::min(next, replies.front().time);
+        }
+        if (next == never) {
+            condition.wait(&mutex);
+        } else if (next > now()) {
+            condition.wait(&mutex, (unsigned long) std::max((qint64) 1, (next - now() + 999) / 1000));
+        }
+    }
+}
+
+
+void VirtualShruthi::step(const qint64 &time) {
+    // Note: the caller has to hold the mutex.
+    for (;;) {
+        const bool &arrived = !incoming.empty() && incoming.front().time <= time;
+        const qint64 &next = arrived ? incoming.front().time : time;
+        if (!buffer.empty() && busyUntil <= next) {
+            // The device is idle, it takes the next byte from the buffer:
+            const WireByte wireByte = buffer.front();
+            buffer.pop_front();
+            parse(wireByte.byte, std::max(busyUntil, wireByte.time));
+        } else if (arrived) {
+            if (buffer.size() >= bufferSize) {
+                mOverflows++;
+                LOG_DEBUG(LogCategory::MIDI) << "VirtualShruthi: input buffer overflow.";
+            } else {
+                buffer.push_back(incoming.front());
+            }
+            incoming.pop_front();
+        } else {
+            break;
+        }
+    }
+}
+
+
+void VirtualShruthi::parse(const unsigned char &byte, const qint64 &time) {
+    if (byte >= 0xf8) {
+        return; // real-time messages
+    }
+
+    if (byte == 0xf0) {
+        message.clear();
+        message.push_back(byte);
+        sysex = true;
+        runningStatus = 0;
+        return;
+    }
+
+    if (byte == 0xf7) {
+        if (sysex) {
+            message.push_back(byte);
+            execute(time);
+        }
+        sysex = false;
+        return;
+    }
+
+    if (byte & 0x80) {
+        // Any other status byte terminates an unfinished SysEx.
+        sysex = false;
+        message.clear();
+        if (byte >= 0xf0) {
+            runningStatus = 0;
+            return;
+        }
+        runningStatus = byte;
+        const unsigned char &type = byte & 0xf0;
+        expected = (type == 0xc0 || type == 0xd0) ? 2 : 3;
+        message.push_back(byte);
+        return;
+    }
+
+    // Data byte:
+    if (sysex) {
+        message.push_back(byte);
+        return;
+    }
+    if (runningStatus == 0) {
+        return;
+    }
+    if (message.empty()) {
+        message.push_back(runningStatus);
+    }
+    message.push_back(byte);
+    if (message.size() == expected) {
+        execute(time);
+    }
+}
+
+
+void VirtualShruthi::execute(const qint64 &time) {
+    // Note: the caller has to hold the mutex.
+    mReceived++;
+    int delay = 0;
+
+    const unsigned char &status = message.at(0);
+    if (status == 0xf0) {
+        delay = executeSysex(time);
+    } else if ((status & 0xf0) == 0xb0) {
+        const unsigned char &controller = message.at(1);
+        const unsigned char &value = message.at(2);
+        if (controller == 6 || controller == 38 || controller == 98 || controller == 99) {
+            // The NRPN parser only knows the first channel:
+            if (nrpn.parse(0xb0, controller, value) && Patch::enabled(nrpn.getNRPN())) {
+                const int &id = nrpn.getNRPN();
+                const int &v = nrpn.getValue();
+                patch.setValue(id, (Patch::parameter(id).min < 0 && v >= 128) ? v - 256 : v); // 2s complement
+            }
+        } else if (controller == 0) {
+            bank = value;
+        } else {
+            int id = Patch::ccToId(controller, 0);
+            const int &converted = Patch::convertCCValue(value, id, 0);
+            if (id < Patch::parameterCount && Patch::enabled(id)) {
+                patch.setValue(id, converted);
+            }
+        }
+        delay = delays[PARAMETER];
+    } else if ((status & 0xf0) == 0xc0) {
+        programChange((bank & 0x3f) * 128 + message.at(1), bank & 0x40);
+        delay = delays[PROGRAM_CHANGE];
+    }
+
+    busyUntil = time + delay;
+    message.clear();
+}
+
+
+int VirtualShruthi::executeSysex(const qint64 &time) {
+    Message payload;
+    if (!Midi::parseSysex(&message, &payload)) {
+        mChecksumErrors++;
+        LOG_DEBUG(LogCategory::MIDI) << "VirtualShruthi: received invalid SysEx.";
+        return 0;
+    }
+
+    const unsigned char &command = Midi::getCommand(&message);
+    const qint64 &ready = time + delays[TRANSFER_REQUEST];
+    const int &slot = payload.size() == 2 ? (payload.at(0) << 8 | payload.at(1)) : -1;
+    Message response;
+
+    switch (command) {
+        case 0x01: // patch
+            if (payload.size() == 92) {
+                patch.unpackData(&payload[0]);
+            }
+            return delays[DATA];
+        case 0x02: // sequence
+            if (payload.size() == 32) {
+                sequence.unpackData(&payload[0]);
+            }
+            return delays[DATA];
+        case 0x11: // patch transfer request
+            patch.generateSysex(&response);
+            reply(response, ready);
+            return delays[TRANSFER_REQUEST];
+        case 0x12: // sequence transfer request
+            sequence.generateSysex(&response);
+            reply(response, ready);
+            return delays[TRANSFER_REQUEST];
+        case 0x21: // patch write request
+            if (slot >= 0 && slot < numberOfPrograms()) {
+                patches[slot].resize(92);
+                patch.packData(&patches[slot][0]);
+            }
+            return delays[WRITE_REQUEST];
+        case 0x22: // sequence write request
+            if (slot >= 0 && slot < numberOfPrograms()) {
+                sequences[slot].resize(32);
+                sequence.packData(&sequences[slot][0]);
+            }
+            return delays[WRITE_REQUEST];
+        case 0x1a: { // current patch and sequence
+            Message numbers;
+            numbers.push_back(currentPatch & 0xff);
+            numbers.push_back(currentPatch >> 8);
+            numbers.push_back(currentSequence & 0xff);
+            numbers.push_back(currentSequence >> 8);
+            Midi::generateSysex(&numbers, 0x0a, 0x00, &response);
+            reply(response, time + delays[INFO_REQUEST]);
+            return delays[INFO_REQUEST];
+        }
+        case 0x1b: { // number of banks
+            const Message empty;
+            Midi::generateSysex(&empty, 0x0b, banks, &response);
+            reply(response, time + delays[INFO_REQUEST]);
+            return delays[INFO_REQUEST];
+        }
+        case 0x1c: { // version
+            Message version;
+            version.push_back(firmwareVersion / 1000);
+            version.push_back(firmwareVersion % 1000);
+            Midi::generateSysex(&version, 0x0c, 0x00, &response);
+            reply(response, time + delays[INFO_REQUEST]);
+            return delays[INFO_REQUEST];
+        }
+        default:
+            LOG_DEBUG(LogCategory::MIDI) << "VirtualShruthi: ignoring SysEx command" << command;
+            return 0;
+    }
+}
+
+
+void VirtualShruthi::reply(const Message &response, const qint64 &time) {
+    // Note: the caller has to hold the mutex.
+    const qint64 &start = std::max(time, outputFree);
+    outputFree = start + (qint64) response.size() * byteTime;
+    Reply r;
+    r.time = outputFree;
+    r.message = response;
+    replies.push_back(r);
+}
+
+
+void VirtualShruthi::programChange(const int &program, const bool &sequenceOnly) {
+    if (program < 0 || program >= numberOfPrograms()) {
+        return;
+    }
+    // Pre 1.00 firmware selects sequences with a separate bank, later versions
+    // load the patch and the sequence together:
+    if (!sequenceOnly) {
+        patch.unpackData(&patches[program][0]);
+        currentPatch = program;
+    }
+    if (sequenceOnly || firmwareVersion >= 1000) {
+        sequence.unpackData(&sequences[program][0]);
+        currentSequence = program;
+    }
+}
@@ -0,0 +1,163 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_VIRTUALSHRUTHI_H
+#define SHRUTHI_VIRTUALSHRUTHI_H
+
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <deque>
+#include <string>
+#include <vector>
+#include "message.h"
+#include "midiin.h" // for NRPN
+#include "patch.h"
+#include "sequence.h"
+class RtMidiIn;
+class RtMidiOut;
+class VirtualShruthiWorker;
+
+
+// Simulates a Shruthi for benchmarking and testing without hardware.
+//
+// It implements the part of the protocol the editor uses: patch/sequence
+// transfer (0x01/0x02, 0x11/0x12), write requests (0x21/0x22), the info
+// requests (0x1a/0x1b/0x1c), program changes and NRPN/CC parameter changes.
+//
+// Timing is emulated: bytes travel at the MIDI wire rate (31250 baud, in both
+// directions), are collected in a bounded input buffer and each message keeps
+// the device busy for a configurable time. Bytes arriving at a full buffer are
+// dropped, like on the real device.
+//
+// The simulator is either published as a pair of virtual sequencer ports (so
+// the editor connects to it like to any other device), or used in process
+// with write() and a callback.
+class VirtualShruthi {
+    public:
+        // Same signature as RtMidiIn::RtMidiCallback:
+        typedef void (*Callback)(double deltatime, Message *message, void *userData);
+
+        // Processing delays (see setDelay()):
+        static const int PARAMETER = 0; // NRPN and CC
+        static const int PROGRAM_CHANGE = 1;
+        static const int DATA = 2; // received patch or sequence
+        static const int TRANSFER_REQUEST = 3;
+        static const int WRITE_REQUEST = 4; // EEPROM write
+        static const int INFO_REQUEST = 5;
+        static const int DELAYS = 6;
+
+        VirtualShruthi(const unsigned int &firmwareVersion = 1002, const int &banks = 0);
+        ~VirtualShruthi();
+
+        // Configuration, before start():
+        void setWireRate(const int &baud); // 0 disables the wire emulation
+        void setInputBufferSize(const unsigned int &bytes);
+        void setDelay(const int &what, const int &us);
+
+        void start();
+        void stop();
+
+        // Transports:
+        bool openVirtualPorts(const std::string &name);
+        void setCallback(Callback callback, void *userData);
+        void write(const Message &message); // editor to Shruthi
+
+        int numberOfPrograms();
+
+        // Statistics:
+        unsigned int overflows();
+        unsigned int checksumErrors();
+        unsigned int received();
+        unsigned int sent();
+
+    private:
+        VirtualShruthi(const VirtualShruthi&); //forbid copying
+        VirtualShruthi &operator=(const VirtualShruthi&); //forbid assignment
+
+        struct WireByte {
+            qint64 time;
+            unsigned char byte;
+        };
+        struct Reply {
+            qint64 time;
+            Message message;
+        };
+
+        friend class VirtualShruthiWorker;
+        void run();
+        qint64 now();
+        void step(const qint64 &time);
+        void parse(const unsigned char &byte, const qint64 &time);
+        void execute(const qint64 &time);
+        int executeSysex(const qint64 &time);
+        void reply(const Message &message, const qint64 &time);
+        void programChange(const int &program, const bool &sequenceOnly);
+
+        VirtualShruthiWorker *worker;
+        RtMidiIn *portIn;
+        RtMidiOut *portOut;
+        Callback callback;
+        void *userData;
+
+        QMutex mutex;
+        QWaitCondition condition;
+        QElapsedTimer clock;
+        bool running;
+
+        // Wire and input buffer:
+        int byteTime; // microseconds
+        unsigned int bufferSize;
+        int delays[DELAYS];
+        std::deque<WireByte> incoming;
+        std::deque<WireByte> buffer;
+        std::deque<Reply> replies;
+        qint64 inputFree;
+        qint64 outputFree;
+        qint64 busyUntil;
+        double lastDelivery;
+
+        // Parser:
+        Message message;
+        unsigned char runningStatus;
+        unsigned int expected;
+        bool sysex;
+        NRPN nrpn;
+        int bank;
+
+        // Device state:
+        unsigned int firmwareVersion;
+        int banks;
+        Patch patch;
+        Sequence sequence;
+        int currentPatch;
+        int currentSequence;
+        std::vector<Message> patches;
+        std::vector<Message> sequences;
+
+        unsigned int mOverflows;
+        unsigned int mChecksumErrors;
+        unsigned int mReceived;
+        unsigned int mSent;
+};
+
+
+#endif // SHRUTHI_VIRTUALSHRUTHI_H
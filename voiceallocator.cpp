@@ -0,0 +1,235 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "voiceallocator.h"
+#include <QMutexLocker>
+#include <QStringList>
+#include "log.h"
+#include "metrics.h"
+#include "midiout.h"
+
+
+// Notes are sent with MidiOut::thru(), so the thru callback doesn't wait for
+// SysEx transfers; the queue keeps the order of each voice's lock.
+static Message noteMessage(const unsigned char &status, const unsigned char &channel, const unsigned char &note, const unsigned char &velocity) {
+    Message message(3);
+    message[0] = status | channel;
+    message[1] = note;
+    message[2] = velocity;
+    return message;
+}
+
+
+VoiceAllocator::VoiceAllocator(MidiOut *out):
+    midiout(out),
+    mode(ROUND_ROBIN),
+    clock(1),
+    cursor(0) {
+    // All voices are free (the states are 0)
+}
+
+
+bool VoiceAllocator::setChannels(const QString &channels) {
+    std::vector<unsigned char> parsed;
+    const QStringList &list = channels.split(",");
+    for (int i = 0; i < list.size() && i < MAX_VOICES; i++) {
+        bool ok = false;
+        const int &channel = list.at(i).trimmed().toInt(&ok);
+        if (!ok || channel < 1 || channel > 16) {
+            LOG_WARNING(LogCategory::MIDI) << "VoiceAllocator::setChannels(): invalid channel" << list.at(i);
+            return false;
+        }
+        parsed.push_back(channel - 1);
+    }
+    mChannels = parsed;
+    LOG_INFO(LogCategory::MIDI) << "VoiceAllocator:" << (unsigned int) mChannels.size() << "voices.";
+    return true;
+}
+
+
+bool VoiceAllocator::setMode(const QString &mode) {
+    if (mode == "round-robin") {
+        this->mode = ROUND_ROBIN;
+    } else if (mode == "oldest") {
+        this->mode = OLDEST;
+    } else if (mode == "lowest") {
+        this->mode = LOWEST;
+    } else {
+        LOG_WARNING(LogCategory::MIDI) << "VoiceAllocator::setMode(): unknown mode" << mode;
+        return false;
+    }
+    return true;
+}
+
+
+bool VoiceAllocator::isEnabled() const {
+    return !mChannels.empty();
+}
+
+
+const std::vector<unsigned char> &VoiceAllocator::channels() const {
+    return mChannels;
+}
+
+
+int VoiceAllocator::age(const int &state, const int &now) const {
+    // Stamps wrap around, ages don't (as long as a voice is younger than
+    // 2^23 notes):
+    return (now - (state >> 8)) & STAMP_MASK;
+}
+
+
+int VoiceAllocator::choose(const unsigned char &note, int &state) {
+    // (fetchAndAddRelaxed(0) is used as a portable atomic load for Qt 4 and 5.)
+    const int &voices = mChannels.size();
+    const int &now = clock.fetchAndAddRelaxed(0) & STAMP_MASK;
+    int current[MAX_VOICES];
+    for (int i = 0; i < voices; i++) {
+        current[i] = states[i].fetchAndAddRelaxed(0);
+    }
+
+    int voice = -1;
+    if (mode == ROUND_ROBIN) {
+        const int &start = (cursor.fetchAndAddRelaxed(1) & 0x7fffffff) % voices;
+        for (int i = 0; i < voices && voice < 0; i++) {
+            if ((current[(start + i) % voices] & NOTE_MASK) == 0) {
+                voice = (start + i) % voices;
+            }
+        }
+        if (voice < 0) {
+            voice = start;
+        }
+    } else {
+        // A free voice released first, so its release phase is over:
+        for (int i = 0; i < voices; i++) {
+            if ((current[i] & NOTE_MASK) == 0 && (voice < 0 || age(current[i], now) > age(current[voice], now))) {
+                voice = i;
+            }
+        }
+        if (voice < 0 && mode == OLDEST) {
+            for (int i = 0; i < voices; i++) {
+                if (voice < 0 || age(current[i], now) > age(current[voice], now)) {
+                    voice = i;
+                }
+            }
+        } else if (voice < 0 && mode == LOWEST) {
+            for (int i = 0; i < voices; i++) {
+                if (voice < 0 || (current[i] & NOTE_MASK) > (current[voice] & NOTE_MASK)) {
+                    voice = i;
+                }
+            }
+            if ((current[voice] & NOTE_MASK) <= note + 1) {
+                voice = -1; // all playing notes are lower
+            }
+        }
+    }
+    if (voice >= 0) {
+        state = current[voice];
+    }
+    return voice;
+}
+
+
+int VoiceAllocator::noteOn(const unsigned char &note, const unsigned char &velocity) {
+    if (velocity == 0) {
+        return noteOff(note);
+    }
+    static MetricsCounter *stolen = Metrics::counter("voices.stolen");
+    static MetricsCounter *dropped = Metrics::counter("voices.dropped");
+    static MetricsCounter *retriggered = Metrics::counter("voices.retriggered");
+
+    // A held note is played again on its voice instead of taking another one:
+    for (int i = 0; i < (int) mChannels.size(); i++) {
+        if ((states[i].fetchAndAddRelaxed(0) & NOTE_MASK) != note + 1) {
+            continue;
+        }
+        QMutexLocker locker(&locks[i]);
+        if ((states[i].fetchAndAddRelaxed(0) & NOTE_MASK) == note + 1) {
+            const int &stamp = clock.fetchAndAddRelaxed(1) & STAMP_MASK;
+            states[i].fetchAndStoreOrdered(stamp << 8 | (note + 1));
+            retriggered->add(1);
+            std::vector<Message> messages;
+            messages.push_back(noteMessage(0x80, mChannels.at(i), note, 0));
+            messages.push_back(noteMessage(0x90, mChannels.at(i), note, velocity));
+            midiout->thru(messages);
+            return i;
+        }
+    }
+
+    for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+        int state = 0;
+        const int &voice = choose(note, state);
+        if (voice < 0) {
+            break;
+        }
+        QMutexLocker locker(&locks[voice]);
+        const int &stamp = clock.fetchAndAddRelaxed(1) & STAMP_MASK;
+        if (!states[voice].testAndSetOrdered(state, stamp << 8 | (note + 1))) {
+            continue; // the other thread was faster
+        }
+        const unsigned char &channel = mChannels.at(voice);
+        std::vector<Message> messages;
+        if (state & NOTE_MASK) {
+            stolen->add(1);
+            messages.push_back(noteMessage(0x80, channel, (state & NOTE_MASK) - 1, 0));
+        }
+        messages.push_back(noteMessage(0x90, channel, note, velocity));
+        midiout->thru(messages);
+        return voice;
+    }
+    dropped->add(1);
+    return -1;
+}
+
+
+int VoiceAllocator::noteOff(const unsigned char &note) {
+    // All voices holding the note (two threads may have played it at once):
+    int released = -1;
+    for (int i = 0; i < (int) mChannels.size(); i++) {
+        if ((states[i].fetchAndAddRelaxed(0) & NOTE_MASK) != note + 1) {
+            continue;
+        }
+        QMutexLocker locker(&locks[i]);
+        if ((states[i].fetchAndAddRelaxed(0) & NOTE_MASK) == note + 1) {
+            // Free, and remember when it was released:
+            const int &stamp = clock.fetchAndAddRelaxed(1) & STAMP_MASK;
+            states[i].fetchAndStoreOrdered(stamp << 8);
+            Message message = noteMessage(0x80, mChannels.at(i), note, 0);
+            midiout->thru(message);
+            released = i;
+        }
+    }
+    // -1: the note was stolen or dropped
+    return released;
+}
+
+
+bool VoiceAllocator::allNotesOff() {
+    for (int i = 0; i < MAX_VOICES; i++) {
+        QMutexLocker locker(&locks[i]);
+        states[i].fetchAndStoreOrdered(0);
+    }
+    // Behind the notes still queued:
+    std::vector<Message> messages;
+    for (unsigned int i = 0; i < mChannels.size(); i++) {
+        messages.push_back(noteMessage(0xb0, mChannels.at(i), 123, 0));
+    }
+    return midiout->thru(messages);
+}
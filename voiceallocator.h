@@ -0,0 +1,90 @@
+// Shruthi-Editor: An unofficial Editor for the Shruthi hardware synthesizer. For
+// informations about the Shruthi, see <http://www.mutable-instruments.net/shruthi1>.
+//
+// Copyright (C) 2011-2018 Manuel Krönig
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef SHRUTHI_VOICEALLOCATOR_H
+#define SHRUTHI_VOICEALLOCATOR_H
+
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QString>
+#include <vector>
+class MidiOut;
+
+
+// Plays a chain of monophonic Shruthis as one polyphonic instrument: every
+// unit listens on its own channel of the output, each channel is a voice.
+//
+// Notes come from the editor thread (keyboard dialog) and the RtMidi callback
+// of the MIDI thru input at the same time. Choosing a voice doesn't lock; the
+// voice is claimed with a compare-and-swap of its state (note and age) under
+// the lock of that voice only, and its note on/off is sent under the same
+// lock, so a unit never gets the note off before the note on. A lost race
+// just picks a voice again. A note that is already held is retriggered on
+// its voice, a note off releases every voice holding the note.
+class VoiceAllocator {
+    public:
+        // Allocation modes:
+        static const int ROUND_ROBIN = 0; // next free voice after the last one
+        static const int OLDEST = 1; // voice released first, steals the oldest note
+        static const int LOWEST = 2; // low note priority, steals the highest note
+
+        static const int MAX_VOICES = 16;
+
+        VoiceAllocator(MidiOut *out);
+
+        // Configuration, before notes are played. channels is a comma
+        // separated list (1-16), mode one of "round-robin", "oldest" and
+        // "lowest".
+        bool setChannels(const QString &channels);
+        bool setMode(const QString &mode);
+        bool isEnabled() const;
+        const std::vector<unsigned char> &channels() const;
+
+        // Return the voice (the last released one), or -1 if the note was
+        // dropped (not found):
+        int noteOn(const unsigned char &note, const unsigned char &velocity);
+        int noteOff(const unsigned char &note);
+        bool allNotesOff();
+
+    private:
+        VoiceAllocator(const VoiceAllocator&); //forbid copying
+        VoiceAllocator &operator=(const VoiceAllocator&); //forbid assignment
+
+        // State of a voice: age stamp << 8 | (note + 1), 0 as note if free
+        static const int NOTE_MASK = 0xff;
+        static const int STAMP_MASK = 0x7fffff;
+        static const int ATTEMPTS = 8; // lost races per note before it is dropped
+
+        int choose(const unsigned char &note, int &state);
+        int age(const int &state, const int &now) const;
+
+        MidiOut *midiout;
+        std::vector<unsigned char> mChannels;
+        int mode;
+
+        QAtomicInt states[MAX_VOICES];
+        QMutex locks[MAX_VOICES]; // held while a state changes and its message is sent
+        QAtomicInt clock; // stamps
+        QAtomicInt cursor; // round robin
+};
+
+
+#endif // SHRUTHI_VOICEALLOCATOR_H